@@ -20,8 +20,30 @@ namespace Servus
     static const unsigned DefaultPrimusReconnectInterval            = 5;        /**< Seconds. */
     static const unsigned DefaultPrimusWaitForResponse              = 5000;     /**< Milliseconds. */
     static const unsigned DefaultPrimusWaitForDatagramCompletion    = 2000;     /**< Milliseconds. */
+    static const unsigned DefaultPrimusTransmissionWindow           = 8;        /**< Requests. */
+    static const unsigned DefaultPrimusMaximalAvisosPerBatch        = 1;        /**< Avisos. */
+    static const unsigned DefaultPrimusMaximalBatchLength           = 16384;    /**< Bytes. */
+    static const unsigned DefaultQueueCriticalSeverity              = 3;
+    static const unsigned DefaultQueueMemoryCeiling                 = 4 * 1024 * 1024;  /**< Bytes. */
+    static const unsigned DefaultQueueCriticalWeight                = 16;       /**< Avisos per round. */
+    static const unsigned DefaultQueueNormalWeight                  = 4;        /**< Avisos per round. */
+    static const unsigned DefaultQueueTelemetryWeight               = 1;        /**< Avisos per round. */
+    static const unsigned DefaultQueueHighWatermarkCount            = 8 * 1024; /**< Avisos. */
+    static const unsigned DefaultQueueLowWatermarkCount             = 4 * 1024; /**< Avisos. */
+    static const unsigned DefaultQueueHighWatermarkBytes            = 3 * 1024 * 1024;  /**< Bytes. */
+    static const unsigned DefaultQueueLowWatermarkBytes             = 2 * 1024 * 1024;  /**< Bytes. */
+    static const unsigned DefaultQueueRetryAfter                    = 2;        /**< Seconds. */
     static const unsigned DefaultListenerWaitForFirstTransmission   = 1000;     /**< Milliseconds. */
     static const unsigned DefaultListenerWaitForTransmissionCompletion = 500;   /**< Milliseconds. */
+    static const unsigned DefaultListenerPipelineDepth              = 16;       /**< Requests. */
+    static const unsigned CongestionRecheckInterval                 = 100;      /**< Milliseconds. */
+    static const unsigned DefaultListenerAcceptors                  = 2;        /**< Threads. */
+    static const unsigned DefaultListenerMaximalSessions            = 1024;     /**< Sessions. */
+    static const unsigned DefaultFabulatoriumWorkers                = 2;        /**< Threads. */
+    static const unsigned DefaultFabulatorRate                      = 100;      /**< Fabulas per second. */
+    static const unsigned DefaultFabulatorBurst                     = 200;      /**< Fabulas. */
+    static const unsigned DefaultSuppressionWindow                  = 1000;     /**< Milliseconds. */
+    static const unsigned DefaultSuppressionCapacity                = 4096;     /**< Fabulas. */
 
     static const unsigned WaitBeforeNetworkRetry                    = 60;       /**< Seconds. */
     static const unsigned WaitBetweenDHTSensors                     = 1000;     /**< Milliseconds. */
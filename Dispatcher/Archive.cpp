@@ -0,0 +1,131 @@
+// System definition files.
+//
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdbool>
+#include <string>
+#include <thread>
+
+// Common definition files.
+//
+#include "Toolkit/Report.h"
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/Archive.hpp"
+#include "Servus/Dispatcher/Aviso.hpp"
+#include "Servus/Dispatcher/Queue.hpp"
+
+/**
+ * @brief   Open the archive file and start reading the queue.
+ *
+ * Must be called before any aviso is enqueued.
+ *
+ * @throw   ArchiveError    If the archive file cannot be opened.
+ */
+Dispatcher::Archive::Archive(
+    const std::string&  filePath,
+    const bool          lossy) :
+filePath(filePath)
+{
+    this->fileDescriptor = open(filePath.c_str(),
+            O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+            S_IRUSR | S_IWUSR | S_IRGRP);
+    if (this->fileDescriptor == -1)
+        throw Dispatcher::ArchiveError("Cannot open archive file", errno);
+
+    this->pending.reserve(Dispatcher::ArchiveFlushLength);
+
+    this->sinkId = Dispatcher::Queue::SharedInstance().registerSink("archive", lossy);
+
+    ReportInfo("[Dispatcher] Archive avisos to %s",
+            filePath.c_str());
+
+    this->thread = std::thread(&Dispatcher::Archive::ThreadHandler, this);
+}
+
+/**
+ * @brief   Thread handler for archive.
+ */
+void
+Dispatcher::Archive::ThreadHandler(Dispatcher::Archive* archive)
+{
+    ReportDebug("[Dispatcher] Archive thread has been started");
+
+    Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
+
+    for (;;)
+    {
+        queue.waitSink(archive->sinkId,
+                std::chrono::milliseconds { Dispatcher::ArchiveWaitInterval });
+
+        archive->collect();
+        archive->flush();
+    }
+}
+
+/**
+ * @brief   Take over all avisos waiting for the archive.
+ *
+ * Avisos are copied as soon as they are read, so that the queue may release them
+ * while the archive writes.
+ */
+void
+Dispatcher::Archive::collect()
+{
+    Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
+
+    for (;;)
+    {
+        Dispatcher::Aviso* aviso = queue.readAviso(this->sinkId);
+        if (aviso == NULL)
+            break;
+
+        this->pending.append(aviso->wire.buffer, aviso->wire.length);
+
+        queue.releaseAviso(this->sinkId);
+
+        if (this->pending.length() >= Dispatcher::ArchiveFlushLength)
+            this->flush();
+    }
+}
+
+/**
+ * @brief   Write collected avisos to the archive file.
+ *
+ * Avisos which cannot be written are lost for the archive, so that a full disk
+ * does not hold back the queue.
+ */
+void
+Dispatcher::Archive::flush()
+{
+    size_t written = 0;
+
+    while (written < this->pending.length())
+    {
+        const ssize_t length = write(this->fileDescriptor,
+                this->pending.data() + written,
+                this->pending.length() - written);
+
+        if (length == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            ReportError("[Dispatcher] Cannot write %zu bytes to archive %s: errno=%d",
+                    this->pending.length() - written,
+                    this->filePath.c_str(),
+                    errno);
+
+            break;
+        }
+
+        written += length;
+    }
+
+    this->pending.clear();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// System definition files.
+//
+#include <cstdbool>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace Dispatcher
+{
+    /**
+     * Encoded avisos are collected up to this length before they are written to the archive.
+     */
+    static const unsigned int ArchiveFlushLength = 64 * 1024;
+
+    /**
+     * Longest time the archive waits for avisos before it writes what it has. Milliseconds.
+     */
+    static const unsigned int ArchiveWaitInterval = 1000;
+
+    /**
+     * Local archive of all avisos, reading the queue as a sink of its own.
+     *
+     * The fields of every aviso are appended to the archive file as they have been
+     * encoded for Primus, each aviso beginning with Aviso-Type.
+     * A lossless archive holds back the release of avisos until it has written them,
+     * a lossy one skips those Primus has acknowledged before it came to read them.
+     */
+    class Archive
+    {
+    private:
+        /**
+         * Thread handler of archive thread.
+         */
+        std::thread         thread;
+
+        std::string         filePath;
+        int                 fileDescriptor;
+        unsigned int        sinkId;
+
+        /**
+         * Avisos read from the queue and not yet written.
+         */
+        std::string         pending;
+
+    public:
+        Archive(
+            const std::string&  filePath,
+            const bool          lossy);
+
+    private:
+        static void
+        ThreadHandler(Dispatcher::Archive*);
+
+        void
+        collect();
+
+        void
+        flush();
+    };
+
+    class ArchiveError : public std::runtime_error
+    {
+    public:
+        int errorNumber;
+
+    public:
+        ArchiveError(const char* const reason, int errorNumber) throw() :
+        std::runtime_error(reason),
+        errorNumber(errorNumber)
+        { }
+    };
+};
@@ -1,6 +1,14 @@
 // System definition files.
 //
 #include <cstdbool>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_set>
+#include <utility>
 
 // Common definition files.
 //
@@ -11,12 +19,231 @@
 //
 #include "Servus/Dispatcher/Aviso.hpp"
 
+static const std::string NoPayload;
+
+static const std::string FabulaType             = "FABULA";
+static const std::string DHTHumidityType        = "DHT_HUMIDITY";
+static const std::string DHTTemperatureType     = "DHT_TEMPERATURE";
+static const std::string DSTemperatureType      = "DS_TEMPERATURE";
+
+/**
+ * Free blocks of the aviso pool, linked through their first bytes.
+ */
+struct FreeBlock
+{
+    FreeBlock*  next;
+};
+
+static std::mutex poolLock;
+static FreeBlock* freeBlocks = NULL;
+
+static std::mutex internLock;
+static std::unordered_set<std::string> internedStrings;
+
+/**
+ * @brief   Take a block from the aviso pool, growing the pool if it is empty.
+ */
+void*
+Dispatcher::Aviso::operator new(size_t size)
+{
+    static_assert(sizeof(Dispatcher::FabulaAviso) <= Dispatcher::AvisoBlockSize,
+            "Aviso block size too small");
+    static_assert(sizeof(Dispatcher::DHTHumidityAviso) <= Dispatcher::AvisoBlockSize,
+            "Aviso block size too small");
+    static_assert(sizeof(Dispatcher::DHTTemperatureAviso) <= Dispatcher::AvisoBlockSize,
+            "Aviso block size too small");
+    static_assert(sizeof(Dispatcher::DSTemperatureAviso) <= Dispatcher::AvisoBlockSize,
+            "Aviso block size too small");
+
+    if (size > Dispatcher::AvisoBlockSize)
+        return ::operator new(size);
+
+    std::lock_guard<std::mutex> lock(poolLock);
+
+    if (freeBlocks == NULL)
+    {
+        char* chunk = (char*) ::operator new(Dispatcher::AvisoBlockSize * Dispatcher::AvisoPoolGrowth);
+
+        for (unsigned int blockIndex = 0;
+             blockIndex < Dispatcher::AvisoPoolGrowth;
+             blockIndex++)
+        {
+            FreeBlock* block = (FreeBlock*) (chunk + blockIndex * Dispatcher::AvisoBlockSize);
+
+            block->next = freeBlocks;
+            freeBlocks = block;
+        }
+    }
+
+    FreeBlock* block = freeBlocks;
+    freeBlocks = block->next;
+
+    return block;
+}
+
+/**
+ * @brief   Give a block back to the aviso pool.
+ */
+void
+Dispatcher::Aviso::operator delete(void* memory, size_t size)
+{
+    if (memory == NULL)
+        return;
+
+    if (size > Dispatcher::AvisoBlockSize)
+    {
+        ::operator delete(memory);
+
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(poolLock);
+
+    FreeBlock* block = (FreeBlock*) memory;
+
+    block->next = freeBlocks;
+    freeBlocks = block;
+}
+
+/**
+ * @brief   Get the shared copy of a string which stays valid for the lifetime of the process.
+ *
+ * Used for sensor tokens, of which there are only as many as sensors.
+ */
+const std::string&
+Dispatcher::Aviso::Intern(const std::string& string)
+{
+    std::lock_guard<std::mutex> lock(internLock);
+
+    std::unordered_set<std::string>::const_iterator interned = internedStrings.find(string);
+
+    if (interned == internedStrings.end())
+        interned = internedStrings.insert(string).first;
+
+    return *interned;
+}
+
+/**
+ * @brief   Tell whether an encoded aviso is of a type.
+ *
+ * Avisos spooled as complete requests carry their type as method, without Aviso-Type.
+ */
+static bool
+IsOfType(
+    RTSP::Datagram&     datagram,
+    const std::string&  avisoType,
+    const std::string&  type)
+{
+    return (avisoType.length() == 0)
+            ? datagram.methodIs(type)
+            : (avisoType == type);
+}
+
+/**
+ * @brief   Recreate an aviso from its encoded form.
+ *
+ * @return  Aviso of the type given by Aviso-Type or by the method of the datagram.
+ * @return  NULL if the datagram does not describe a known aviso type.
+ */
+Dispatcher::Aviso*
+Dispatcher::Aviso::Restore(RTSP::Datagram& datagram)
+{
+    Dispatcher::Aviso* aviso;
+
+    const std::string stamp = datagram["Timestamp"];
+
+    std::string avisoType;
+
+    try
+    {
+        const std::string type = datagram["Aviso-Type"];
+
+        avisoType = type;
+    }
+    catch (RTSP::StatementNotFound&)
+    { }
+
+    if (IsOfType(datagram, avisoType, FabulaType) == true)
+    {
+        const std::string     fabulatorName     = datagram["Originator"];
+        const unsigned short  severityLevel     = datagram["Severity"];
+        const bool            notificationFlag  = datagram["Notification"];
+
+        Dispatcher::FabulaAviso* fabula = new Dispatcher::FabulaAviso(
+                stamp,
+                fabulatorName,
+                severityLevel,
+                notificationFlag,
+                datagram.payload());
+
+        try
+        {
+            const unsigned int  repeatCount = datagram["Repeat-Count"];
+            const std::string   lastSeen    = datagram["Last-Seen"];
+
+            fabula->repeatCount = repeatCount;
+            fabula->lastSeen = Toolkit::Timestamp(lastSeen);
+        }
+        catch (RTSP::StatementNotFound&)
+        { }
+
+        aviso = fabula;
+    }
+    else if (IsOfType(datagram, avisoType, DHTHumidityType) == true)
+    {
+        const std::string sensorToken   = datagram["Sensor-Token"];
+        const std::string humidity      = datagram["Humidity"];
+
+        aviso = new Dispatcher::DHTHumidityAviso(
+                stamp,
+                sensorToken,
+                strtof(humidity.c_str(), NULL));
+    }
+    else if (IsOfType(datagram, avisoType, DHTTemperatureType) == true)
+    {
+        const std::string sensorToken   = datagram["Sensor-Token"];
+        const std::string temperature   = datagram["Temperature"];
+
+        aviso = new Dispatcher::DHTTemperatureAviso(
+                stamp,
+                sensorToken,
+                strtof(temperature.c_str(), NULL));
+    }
+    else if (IsOfType(datagram, avisoType, DSTemperatureType) == true)
+    {
+        const std::string sensorToken   = datagram["Sensor-Token"];
+        const std::string temperature   = datagram["Temperature"];
+
+        aviso = new Dispatcher::DSTemperatureAviso(
+                stamp,
+                sensorToken,
+                strtof(temperature.c_str(), NULL));
+    }
+    else
+    {
+        return NULL;
+    }
+
+    aviso->avisoId = datagram["Aviso-Id"];
+
+    aviso->encode();
+
+    return aviso;
+}
+
+/**
+ * @brief   Aviso keeps a reference to its type, which must be one of the shared constants.
+ */
 Dispatcher::Aviso::Aviso(const std::string& avisoType) :
 avisoType(avisoType)
 {
     this->avisoId = 0;
 
-    this->timestamp = new Toolkit::Timestamp();
+    this->spoolRecord.segment = NULL;
+    this->spoolRecord.offset = 0;
+
+    this->wire.buffer = this->wire.inlineBuffer;
+    this->wire.length = 0;
 }
 
 Dispatcher::Aviso::Aviso(
@@ -26,26 +253,88 @@ avisoType(avisoType)
 {
     this->avisoId = 0;
 
-    if (stamp.length() == 0)
-    {
-        this->timestamp = new Toolkit::Timestamp();
-    }
-    else
+    this->spoolRecord.segment = NULL;
+    this->spoolRecord.offset = 0;
+
+    this->wire.buffer = this->wire.inlineBuffer;
+    this->wire.length = 0;
+
+    if (stamp.length() != 0)
     {
-        this->timestamp = new Toolkit::Timestamp(stamp);
+        this->timestamp = Toolkit::Timestamp(stamp);
     }
 }
 
 Dispatcher::Aviso::~Aviso()
 {
-    delete this->timestamp;
+    if (this->wire.buffer != this->wire.inlineBuffer)
+        delete[] this->wire.buffer;
+}
+
+const std::string&
+Dispatcher::Aviso::payload() const
+{
+    return NoPayload;
 }
 
 void
 Dispatcher::Aviso::prepare(RTSP::Datagram& datagram) const
 {
     datagram["Aviso-Id"]        = this->avisoId;
-    datagram["Timestamp"]       = this->timestamp->floatString();
+    datagram["Timestamp"]       = this->timestamp.floatString();
+}
+
+/**
+ * @brief   Take over the value of a newer aviso of the same source.
+ *
+ * The newer aviso is left with the previous timestamp and is to be deleted.
+ */
+void
+Dispatcher::Aviso::supersede(Dispatcher::Aviso& newer)
+{
+    std::swap(this->timestamp, newer.timestamp);
+}
+
+/**
+ * @brief   Encode the fields of the aviso to be sent to Primus.
+ *
+ * Called by the producer once the aviso has got its id, and again whenever
+ * its value changes, so that the dispatcher thread does not format anything.
+ * The request line is left out, as a batch carries only the fields of its avisos.
+ */
+void
+Dispatcher::Aviso::encode()
+{
+    static thread_local RTSP::Datagram datagram;
+
+    datagram.reset();
+    datagram["Aviso-Type"] = this->avisoType;
+
+    this->prepare(datagram);
+
+    datagram.generateRequest(this->avisoType, "rtsp://primus", this->payload());
+
+    const char* endOfLine = (const char*) memchr(datagram.contentBuffer, '\n', datagram.contentLength);
+
+    const unsigned int requestLineLength = (endOfLine == NULL)
+            ? 0
+            : (unsigned int) (endOfLine - datagram.contentBuffer) + 1;
+
+    const unsigned int length = datagram.contentLength - requestLineLength;
+
+    if (this->wire.buffer != this->wire.inlineBuffer)
+    {
+        delete[] this->wire.buffer;
+
+        this->wire.buffer = this->wire.inlineBuffer;
+    }
+
+    if (length > Dispatcher::AvisoInlineWireSize)
+        this->wire.buffer = new char[length];
+
+    memcpy(this->wire.buffer, datagram.contentBuffer + requestLineLength, length);
+
+    this->wire.length = length;
 }
 
 Dispatcher::FabulaAviso::FabulaAviso(
@@ -54,11 +343,30 @@ Dispatcher::FabulaAviso::FabulaAviso(
     const unsigned short    severityLevel,
     const bool              notificationFlag,
     const std::string&      message) :
-Inherited("FABULA", stamp),
+Inherited(FabulaType, stamp),
 fabulatorName(fabulatorName),
 severityLevel(severityLevel),
 notificationFlag(notificationFlag),
-message(message)
+message(message),
+repeatCount(0)
+{ }
+
+/**
+ * @brief   Take the message straight out of a received datagram.
+ */
+Dispatcher::FabulaAviso::FabulaAviso(
+    const std::string&      stamp,
+    const std::string&      fabulatorName,
+    const unsigned short    severityLevel,
+    const bool              notificationFlag,
+    const char*             message,
+    const size_t            messageLength) :
+Inherited(FabulaType, stamp),
+fabulatorName(fabulatorName),
+severityLevel(severityLevel),
+notificationFlag(notificationFlag),
+message(message, messageLength),
+repeatCount(0)
 { }
 
 void
@@ -69,13 +377,38 @@ Dispatcher::FabulaAviso::prepare(RTSP::Datagram& datagram) const
     datagram["Severity"]        = this->severityLevel;
     datagram["Notification"]    = this->notificationFlag;
     datagram["Originator"]      = this->fabulatorName;
+
+    if (this->repeatCount != 0)
+    {
+        datagram["Repeat-Count"]    = this->repeatCount;
+        datagram["Last-Seen"]       = this->lastSeen.floatString();
+    }
 }
 
+/**
+ * @brief   Let the aviso stand for one more identical fabula seen at the given time.
+ */
+void
+Dispatcher::FabulaAviso::countRepeat(const Toolkit::Timestamp& seen)
+{
+    this->repeatCount++;
+    this->lastSeen = seen;
+}
+
+Dispatcher::DHTHumidityAviso::DHTHumidityAviso(
+    const std::string&  sensorToken,
+    const float         humidity) :
+Inherited(DHTHumidityType),
+sensorToken(Dispatcher::Aviso::Intern(sensorToken)),
+humidity(humidity)
+{ }
+
 Dispatcher::DHTHumidityAviso::DHTHumidityAviso(
+    const std::string&  stamp,
     const std::string&  sensorToken,
     const float         humidity) :
-Inherited("DHT_HUMIDITY"),
-sensorToken(sensorToken),
+Inherited(DHTHumidityType, stamp),
+sensorToken(Dispatcher::Aviso::Intern(sensorToken)),
 humidity(humidity)
 { }
 
@@ -88,11 +421,28 @@ Dispatcher::DHTHumidityAviso::prepare(RTSP::Datagram& datagram) const
     datagram["Humidity"]        = this->humidity;
 }
 
+void
+Dispatcher::DHTHumidityAviso::supersede(Dispatcher::Aviso& newer)
+{
+    Inherited::supersede(newer);
+
+    this->humidity = static_cast<Dispatcher::DHTHumidityAviso&>(newer).humidity;
+}
+
 Dispatcher::DHTTemperatureAviso::DHTTemperatureAviso(
     const std::string&  sensorToken,
     const float         temperature) :
-Inherited("DHT_TEMPERATURE"),
-sensorToken(sensorToken),
+Inherited(DHTTemperatureType),
+sensorToken(Dispatcher::Aviso::Intern(sensorToken)),
+temperature(temperature)
+{ }
+
+Dispatcher::DHTTemperatureAviso::DHTTemperatureAviso(
+    const std::string&  stamp,
+    const std::string&  sensorToken,
+    const float         temperature) :
+Inherited(DHTTemperatureType, stamp),
+sensorToken(Dispatcher::Aviso::Intern(sensorToken)),
 temperature(temperature)
 { }
 
@@ -105,11 +455,28 @@ Dispatcher::DHTTemperatureAviso::prepare(RTSP::Datagram& datagram) const
     datagram["Temperature"]     = this->temperature;
 }
 
+void
+Dispatcher::DHTTemperatureAviso::supersede(Dispatcher::Aviso& newer)
+{
+    Inherited::supersede(newer);
+
+    this->temperature = static_cast<Dispatcher::DHTTemperatureAviso&>(newer).temperature;
+}
+
+Dispatcher::DSTemperatureAviso::DSTemperatureAviso(
+    const std::string&  sensorToken,
+    const float         temperature) :
+Inherited(DSTemperatureType),
+sensorToken(Dispatcher::Aviso::Intern(sensorToken)),
+temperature(temperature)
+{ }
+
 Dispatcher::DSTemperatureAviso::DSTemperatureAviso(
+    const std::string&  stamp,
     const std::string&  sensorToken,
     const float         temperature) :
-Inherited("DS_TEMPERATURE"),
-sensorToken(sensorToken),
+Inherited(DSTemperatureType, stamp),
+sensorToken(Dispatcher::Aviso::Intern(sensorToken)),
 temperature(temperature)
 { }
 
@@ -121,3 +488,11 @@ Dispatcher::DSTemperatureAviso::prepare(RTSP::Datagram& datagram) const
     datagram["Sensor-Token"]    = this->sensorToken;
     datagram["Temperature"]     = this->temperature;
 }
+
+void
+Dispatcher::DSTemperatureAviso::supersede(Dispatcher::Aviso& newer)
+{
+    Inherited::supersede(newer);
+
+    this->temperature = static_cast<Dispatcher::DSTemperatureAviso&>(newer).temperature;
+}
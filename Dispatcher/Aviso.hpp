@@ -3,6 +3,7 @@
 // System definition files.
 //
 #include <cstdbool>
+#include <cstddef>
 #include <string>
 
 // Common definition files.
@@ -12,29 +13,109 @@
 
 namespace Dispatcher
 {
+    /**
+     * Size of a block in the aviso pool. Must hold the largest aviso class.
+     */
+    static const size_t AvisoBlockSize = 512;
+
+    /**
+     * Encoded avisos up to this length are kept inside the aviso itself.
+     */
+    static const unsigned int AvisoInlineWireSize = 288;
+
+    /**
+     * Number of blocks the aviso pool grows by when it runs empty.
+     */
+    static const unsigned int AvisoPoolGrowth = 256;
+
+    class SpoolSegment;
+
+    /**
+     * Avisos are allocated from a pool of fixed-size blocks which is never given
+     * back to the system, so that a running node does not allocate for avisos
+     * once the pool has grown to the size of the backlog. Type names are shared
+     * constants and sensor tokens are interned.
+     *
+     * The queue owns an aviso from the moment it is enqueued and recycles it
+     * as soon as Primus has acknowledged it.
+     */
     class Aviso
     {
     public:
         unsigned int        avisoId;
-        std::string         avisoType;
+        const std::string&  avisoType;
+
+        Toolkit::Timestamp  timestamp;
+
+        /**
+         * Location of the aviso in the spool, if the aviso is stored there.
+         */
+        struct
+        {
+            Dispatcher::SpoolSegment*   segment;
+            unsigned int                offset;
+        }
+        spoolRecord;
 
-        Toolkit::Timestamp* timestamp;
+        /**
+         * Fields of the aviso encoded by the producer, from Aviso-Type to the end of the payload.
+         * Dispatcher puts the request line, CSeq and Agent in front of them, once per request.
+         */
+        struct
+        {
+            char*           buffer;
+            unsigned int    length;
+            char            inlineBuffer[Dispatcher::AvisoInlineWireSize];
+        }
+        wire;
 
     public:
+        static void*
+        operator new(size_t);
+
+        static void
+        operator delete(void*, size_t);
+
+        static const std::string&
+        Intern(const std::string&);
+
+        static Dispatcher::Aviso*
+        Restore(RTSP::Datagram&);
+
         Aviso(const std::string& avisoType);
 
         Aviso(
             const std::string&  avisoType,
             const std::string&  stamp);
 
-        ~Aviso();
+        virtual ~Aviso();
 
         virtual void
         prepare(RTSP::Datagram&) const;
 
-        virtual std::string
-        payload()
-        { return ""; }
+        void
+        encode();
+
+        virtual const std::string&
+        payload() const;
+
+        /**
+         * Approximate memory taken by the aviso.
+         */
+        virtual size_t
+        footprint() const
+        { return Dispatcher::AvisoBlockSize; }
+
+        /**
+         * Avisos of the same type with the same interned token carry the latest value
+         * of the same source, so that a waiting aviso may be replaced by a newer one.
+         */
+        virtual const std::string*
+        coalescingToken() const
+        { return NULL; }
+
+        virtual void
+        supersede(Dispatcher::Aviso&);
     };
 
     class FabulaAviso : public Dispatcher::Aviso
@@ -47,6 +128,12 @@ namespace Dispatcher
         bool                notificationFlag;
         std::string         message;
 
+        /**
+         * Number of identical fabulas the aviso stands for, zero if only for itself.
+         */
+        unsigned int        repeatCount;
+        Toolkit::Timestamp  lastSeen;
+
     public:
         FabulaAviso(
             const std::string&      stamp,
@@ -55,12 +142,30 @@ namespace Dispatcher
             const bool              notificationFlag,
             const std::string&      message);
 
+        FabulaAviso(
+            const std::string&      stamp,
+            const std::string&      fabulatorName,
+            const unsigned short    severityLevel,
+            const bool              notificationFlag,
+            const char*             message,
+            const size_t            messageLength);
+
         virtual void
         prepare(RTSP::Datagram&) const;
 
-        virtual std::string
-        payload()
+        void
+        countRepeat(const Toolkit::Timestamp& seen);
+
+        virtual const std::string&
+        payload() const
         { return this->message; }
+
+        virtual size_t
+        footprint() const
+        {
+            return Dispatcher::AvisoBlockSize + this->wire.length +
+                    this->fabulatorName.length() + this->message.length();
+        }
     };
 
     class DHTHumidityAviso : public Dispatcher::Aviso
@@ -68,16 +173,28 @@ namespace Dispatcher
         typedef Dispatcher::Aviso Inherited;
 
     public:
-        std::string sensorToken;
-        float       humidity;
+        const std::string&  sensorToken;
+        float               humidity;
 
     public:
         DHTHumidityAviso(
             const std::string&  sensorToken,
             const float         humidity);
 
+        DHTHumidityAviso(
+            const std::string&  stamp,
+            const std::string&  sensorToken,
+            const float         humidity);
+
         virtual void
         prepare(RTSP::Datagram&) const;
+
+        virtual const std::string*
+        coalescingToken() const
+        { return &this->sensorToken; }
+
+        virtual void
+        supersede(Dispatcher::Aviso&);
     };
 
     class DHTTemperatureAviso : public Dispatcher::Aviso
@@ -85,16 +202,28 @@ namespace Dispatcher
         typedef Dispatcher::Aviso Inherited;
 
     public:
-        std::string sensorToken;
-        float       temperature;
+        const std::string&  sensorToken;
+        float               temperature;
 
     public:
         DHTTemperatureAviso(
             const std::string&  sensorToken,
             const float         temperature);
 
+        DHTTemperatureAviso(
+            const std::string&  stamp,
+            const std::string&  sensorToken,
+            const float         temperature);
+
         virtual void
         prepare(RTSP::Datagram&) const;
+
+        virtual const std::string*
+        coalescingToken() const
+        { return &this->sensorToken; }
+
+        virtual void
+        supersede(Dispatcher::Aviso&);
     };
 
     class DSTemperatureAviso : public Dispatcher::Aviso
@@ -102,15 +231,27 @@ namespace Dispatcher
         typedef Dispatcher::Aviso Inherited;
 
     public:
-        std::string sensorToken;
-        float       temperature;
+        const std::string&  sensorToken;
+        float               temperature;
 
     public:
         DSTemperatureAviso(
             const std::string&  sensorToken,
             const float         temperature);
 
+        DSTemperatureAviso(
+            const std::string&  stamp,
+            const std::string&  sensorToken,
+            const float         temperature);
+
         virtual void
         prepare(RTSP::Datagram&) const;
+
+        virtual const std::string*
+        coalescingToken() const
+        { return &this->sensorToken; }
+
+        virtual void
+        supersede(Dispatcher::Aviso&);
     };
 };
@@ -0,0 +1,143 @@
+// System definition files.
+//
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// Common definition files.
+//
+#include "Toolkit/Report.h"
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/BufferPool.hpp"
+
+static Dispatcher::BufferPool* instance = NULL;
+
+Dispatcher::BufferPool&
+Dispatcher::BufferPool::InitInstance()
+{
+    if (instance != NULL)
+        throw std::runtime_error("[Dispatcher] Buffer pool already initialized");
+
+    instance = new Dispatcher::BufferPool();
+
+    return *instance;
+}
+
+Dispatcher::BufferPool&
+Dispatcher::BufferPool::SharedInstance()
+{
+    if (instance == NULL)
+        throw std::runtime_error("[Dispatcher] Buffer pool not initialized");
+
+    return *instance;
+}
+
+Dispatcher::BufferPool::BufferPool()
+{
+    for (unsigned int tierIndex = 0;
+         tierIndex < Dispatcher::BufferTiers;
+         tierIndex++)
+    {
+        this->tiers[tierIndex].idle.reserve(Dispatcher::BufferTierRetained[tierIndex]);
+    }
+}
+
+Dispatcher::BufferPool::~BufferPool()
+{
+    for (unsigned int tierIndex = 0;
+         tierIndex < Dispatcher::BufferTiers;
+         tierIndex++)
+    {
+        for (std::vector<char*>::iterator buffer = this->tiers[tierIndex].idle.begin();
+             buffer != this->tiers[tierIndex].idle.end();
+             buffer++)
+        {
+            free(*buffer);
+        }
+    }
+}
+
+/**
+ * @brief   Borrow a buffer of the smallest tier holding at least the given size.
+ *
+ * @param   minimalSize     Number of bytes needed at least.
+ * @param   size            Returns the actual size of the buffer.
+ *
+ * @throw   BufferTooLarge  If no tier is large enough.
+ */
+char*
+Dispatcher::BufferPool::borrow(
+    const uint32_t  minimalSize,
+    uint32_t&       size)
+{
+    const unsigned int tierIndex = Dispatcher::BufferPool::TierFor(minimalSize);
+
+    char* buffer = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(this->tiers[tierIndex].lock);
+
+        if (this->tiers[tierIndex].idle.empty() == false)
+        {
+            buffer = this->tiers[tierIndex].idle.back();
+            this->tiers[tierIndex].idle.pop_back();
+        }
+    }
+
+    if (buffer == NULL)
+    {
+        buffer = (char*) malloc(Dispatcher::BufferTierSizes[tierIndex]);
+        if (buffer == NULL)
+        {
+            ReportSoftAlert("[Dispatcher] Out of memory");
+
+            throw std::runtime_error("[Dispatcher] Out of memory");
+        }
+    }
+
+    size = Dispatcher::BufferTierSizes[tierIndex];
+
+    return buffer;
+}
+
+/**
+ * @brief   Give back a buffer borrowed before, together with the size it was borrowed with.
+ */
+void
+Dispatcher::BufferPool::giveBack(
+    char*           buffer,
+    const uint32_t  size)
+{
+    const unsigned int tierIndex = Dispatcher::BufferPool::TierFor(size);
+
+    {
+        std::lock_guard<std::mutex> lock(this->tiers[tierIndex].lock);
+
+        if (this->tiers[tierIndex].idle.size() < Dispatcher::BufferTierRetained[tierIndex])
+        {
+            this->tiers[tierIndex].idle.push_back(buffer);
+
+            return;
+        }
+    }
+
+    free(buffer);
+}
+
+unsigned int
+Dispatcher::BufferPool::TierFor(const uint32_t size)
+{
+    for (unsigned int tierIndex = 0;
+         tierIndex < Dispatcher::BufferTiers;
+         tierIndex++)
+    {
+        if (size <= Dispatcher::BufferTierSizes[tierIndex])
+            return tierIndex;
+    }
+
+    throw Dispatcher::BufferTooLarge();
+}
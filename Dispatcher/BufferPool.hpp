@@ -0,0 +1,78 @@
+#pragma once
+
+// System definition files.
+//
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace Dispatcher
+{
+    static const unsigned int BufferTiers = 3;
+
+    /**
+     * Sizes of buffers of each tier, from smallest to largest.
+     */
+    static const uint32_t BufferTierSizes[Dispatcher::BufferTiers] = { 512, 4 * 1024, 64 * 1024 };
+
+    /**
+     * Maximal number of idle buffers kept in each tier, the rest is freed.
+     */
+    static const unsigned int BufferTierRetained[Dispatcher::BufferTiers] = { 1024, 128, 16 };
+
+    /**
+     * Pool of receive buffers shared by all connections.
+     *
+     * A connection borrows a buffer only while a datagram is in progress,
+     * so that idle connections hold no buffer at all. Buffers are kept in
+     * tiers of fixed sizes and handed out from the smallest tier that fits.
+     * Buffers given back are kept for the next borrower, up to a limit per tier.
+     */
+    class BufferPool
+    {
+    private:
+        struct
+        {
+            std::mutex              lock;
+            std::vector<char*>      idle;
+        }
+        tiers[Dispatcher::BufferTiers];
+
+    public:
+        static Dispatcher::BufferPool&
+        InitInstance();
+
+        static Dispatcher::BufferPool&
+        SharedInstance();
+
+    private:
+        BufferPool();
+
+        ~BufferPool();
+
+    public:
+        char*
+        borrow(
+            const uint32_t  minimalSize,
+            uint32_t&       size);
+
+        void
+        giveBack(
+            char*           buffer,
+            const uint32_t  size);
+
+    private:
+        static unsigned int
+        TierFor(const uint32_t size);
+    };
+
+    class BufferTooLarge : public std::runtime_error
+    {
+    public:
+        BufferTooLarge() throw() :
+        std::runtime_error("Buffer larger than largest tier")
+        { }
+    };
+};
@@ -1,14 +1,23 @@
 // System definition files.
 //
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <climits>
 #include <cstdbool>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 // Common definition files.
 //
@@ -28,6 +37,19 @@
 
 static Dispatcher::Communicator* instance = NULL;
 
+/**
+ * Constant end of the request line and constant header of every request carrying avisos,
+ * which avisos leave out of their encoded fields.
+ */
+static const std::string RequestLineTemplate = " rtsp://primus RTSP/1.0\r\n";
+static const std::string AgentTemplate = "Agent: " + Servus::SoftwareVersion + "\r\n";
+
+/**
+ * Constant beginning of every batch request.
+ */
+static const std::string BatchRequestTemplate =
+        "AVISO-BATCH" + RequestLineTemplate + AgentTemplate;
+
 Dispatcher::Communicator&
 Dispatcher::Communicator::InitInstance()
 {
@@ -48,9 +70,12 @@ Dispatcher::Communicator::SharedInstance()
     return *instance;
 }
 
-Dispatcher::Communicator::Communicator()
+Dispatcher::Communicator::Communicator() :
+reception(Dispatcher::MaximalMessageLength)
 {
     this->setupDone = false;
+    this->setup.inEffect = false;
+
 
     this->primus.sleepIfRejectedByPrimus =
             Servus::DefaultPrimusSleepIfRejectedByPrimus;
@@ -64,20 +89,49 @@ Dispatcher::Communicator::Communicator()
     this->primus.waitForDatagramCompletion =
             Servus::DefaultPrimusWaitForDatagramCompletion;
 
-    // Allocate resources to be used for receive buffer.
-    //
-    this->receiveBuffer = (char*) malloc(Dispatcher::MaximalMessageLength);
-    if (this->receiveBuffer == NULL)
+    this->primus.transmissionWindow =
+            Servus::DefaultPrimusTransmissionWindow;
+
+    this->primus.maximalAvisosPerBatch =
+            Servus::DefaultPrimusMaximalAvisosPerBatch;
+
+    this->primus.maximalBatchLength =
+            Servus::DefaultPrimusMaximalBatchLength;
+
+    this->events.watchingOutput = false;
+
+    this->events.pollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (this->events.pollDescriptor == -1)
+    {
+        ReportSoftAlert("[Dispatcher] Cannot create poll descriptor: errno=%d",
+                errno);
+
+        throw std::runtime_error("[Dispatcher] Cannot create poll descriptor");
+    }
+
+    this->events.timerDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (this->events.timerDescriptor == -1)
     {
-        ReportSoftAlert("[Dispatcher] Out of memory");
+        ReportSoftAlert("[Dispatcher] Cannot create timer descriptor: errno=%d",
+                errno);
 
-        throw std::runtime_error("[Dispatcher] Out of memory");
+        close(this->events.pollDescriptor);
+
+        throw std::runtime_error("[Dispatcher] Cannot create timer descriptor");
     }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events    = EPOLLIN;
+    event.data.fd   = this->events.timerDescriptor;
+
+    epoll_ctl(this->events.pollDescriptor, EPOLL_CTL_ADD, this->events.timerDescriptor, &event);
 }
 
 Dispatcher::Communicator::~Communicator()
 {
-    free(this->receiveBuffer);
+    close(this->events.timerDescriptor);
+    close(this->events.pollDescriptor);
 }
 
 void
@@ -104,6 +158,47 @@ Dispatcher::Communicator::setConnectionIntervals(
     this->primus.waitForDatagramCompletion  = waitForDatagramCompletion;
 }
 
+void
+Dispatcher::Communicator::setTransmissionWindow(const unsigned int transmissionWindow)
+{
+    this->primus.transmissionWindow = (transmissionWindow == 0) ? 1 : transmissionWindow;
+}
+
+void
+Dispatcher::Communicator::setBatchLimits(
+    const unsigned int maximalAvisosPerBatch,
+    const unsigned int maximalBatchLength)
+{
+    // One vector entry for the batch header and one for each aviso.
+    //
+    this->primus.maximalAvisosPerBatch = std::min(maximalAvisosPerBatch, (unsigned int) IOV_MAX - 1);
+    this->primus.maximalBatchLength = std::min(maximalBatchLength, Dispatcher::MaximalMessageLength);
+}
+
+/**
+ * @brief   Apply configuration cached from last SETUP before Primus is reached.
+ *
+ * Relays and sensors start right at boot instead of waiting for a connection.
+ * SETUP still asks Primus whether the cached configuration is up to date.
+ */
+void
+Dispatcher::Communicator::applyCachedConfiguration()
+{
+    std::string json;
+    std::string hash;
+
+    if (Dispatcher::LoadConfigurationCache(json, hash) == false)
+        return;
+
+    ReportInfo("[Dispatcher] Apply cached configuration %s",
+            hash.c_str());
+
+    Dispatcher::ProcessConfigurationJSON(json);
+
+    this->setup.hash = hash;
+    this->setup.inEffect = true;
+}
+
 void
 Dispatcher::Communicator::start()
 {
@@ -118,6 +213,19 @@ Dispatcher::Communicator::ThreadHandler(Dispatcher::Communicator* communicator)
 {
     ReportDebug("[Dispatcher] Communicator thread has been started");
 
+    // Queue is created after communicator, so its descriptor is watched from here on.
+    //
+    {
+        Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events    = EPOLLIN;
+        event.data.fd   = queue.eventDescriptor();
+
+        epoll_ctl(communicator->events.pollDescriptor, EPOLL_CTL_ADD, queue.eventDescriptor(), &event);
+    }
+
     TCP::Connection connection(
             IP::IPv4,
             communicator->primus.address,
@@ -151,6 +259,17 @@ Dispatcher::Communicator::ThreadHandler(Dispatcher::Communicator* communicator)
 
             connection.disconnect();
         }
+        catch (Dispatcher::ResumptionRefused& exception)
+        {
+            connection.disconnect();
+
+            // Token has been dropped, so that a full handshake follows right away.
+            //
+            ReportNotice("[Dispatcher] %s, reconnect with full handshake",
+                    exception.what());
+
+            continue;
+        }
         catch (Dispatcher::RejectedByPrimus& exception)
         {
             connection.disconnect();
@@ -202,18 +321,92 @@ Dispatcher::Communicator::HandleSession(
     unsigned int expectedCSeq = 1;
 
     RTSP::Datagram request;
-    RTSP::Datagram response;
+    Dispatcher::DatagramView response;
 
+    communicator->reception.reset();
+
+    // Once Primus has issued a token, a broken session is resumed with one request
+    // and avisos follow it without waiting for the response.
+    //
+    bool resuming =
+            (communicator->resumption.token.empty() == false) &&
+            (communicator->setupDone == true);
+
+    if (resuming == true)
     {
-        request.reset();
+        queue.collectInFlight(communicator->resumption.outstanding);
 
-        Workspace::Kernel& kernel = Workspace::Kernel::SharedInstance();
+        // Ids of too many avisos would not fit into a request,
+        // transmit them all again instead.
+        //
+        if (communicator->resumption.outstanding.size() > Dispatcher::MaximalOutstandingAvisos)
+        {
+            ReportNotice("[Dispatcher] Begin new session as %u avisos are outstanding",
+                    (unsigned int) communicator->resumption.outstanding.size());
+
+            resuming = false;
+        }
+    }
+
+    if (resuming == false)
+    {
+        Dispatcher::Communicator::PerformHandshake(communicator, connection, expectedCSeq);
+    }
+
+    // Avisos which were in flight when previous session did break
+    // have to be transmitted again.
+    //
+    queue.rewind();
+
+    const unsigned int resumeCSeq = (resuming == true) ? expectedCSeq : 0;
+
+    {
+        request.reset();
 
         request["CSeq"] = expectedCSeq;
-        request["Authenticator"] = communicator->primus.authenticator;
-        request["Running-Since"] = kernel.timestampOfStart->floatString();
         request["Agent"] = Servus::SoftwareVersion;
-        request.generateRequest("AUTH", "rtsp://primus");
+
+        if (resuming == true)
+        {
+            ReportInfo("[Dispatcher] Resume session with %u avisos outstanding",
+                    (unsigned int) communicator->resumption.outstanding.size());
+
+            request["Session-Token"] = communicator->resumption.token;
+
+            // Every other aviso transmitted so far has been acknowledged,
+            // avisos not yet transmitted follow the request.
+            //
+            if (communicator->resumption.outstanding.empty() == false)
+            {
+                std::string& outstandingIds = communicator->resumption.outstandingIds;
+
+                char avisoId[16];
+
+                outstandingIds.clear();
+
+                for (const unsigned int outstanding : communicator->resumption.outstanding)
+                {
+                    snprintf(avisoId, sizeof(avisoId),
+                            (outstandingIds.empty() == true) ? "%u" : ",%u",
+                            outstanding);
+
+                    outstandingIds.append(avisoId);
+                }
+
+                request["Outstanding-Aviso-Ids"] = outstandingIds;
+            }
+
+            if (communicator->setup.hash.empty() == false)
+            {
+                request["Configuration-Hash"] = communicator->setup.hash;
+            }
+
+            request.generateRequest("RESUME", "rtsp://primus");
+        }
+        else
+        {
+            request.generateRequest("PLAY", "rtsp://primus");
+        }
 
         try
         {
@@ -230,223 +423,214 @@ Dispatcher::Communicator::HandleSession(
         expectedCSeq++;
     }
 
-    {
-        response.reset();
+    // Number of requests sent to Primus and not yet answered.
+    // Response for PLAY or RESUME is still outstanding.
+    //
+    unsigned int outstandingRequests = 1;
 
-        try
-        {
-            ::Communicator::Poll(
-                    connection.socket(),
-                    communicator->primus.waitForResponse);
-        }
-        catch (::Communicator::PollError& exception)
-        {
-            throw Dispatcher::Exception("Keep-alive polling did break",
-                    exception.errorNumber);
-        }
-        catch (::Communicator::PollTimeout&)
-        {
-            throw Dispatcher::Exception("Session timed out");
-        }
+    unsigned int neutrinoInterval = 0;
 
-        // Receive datagram chunks continuously until either complete datagram is received
-        // or timeout ocures.
-        //
-        for (;;)
-        {
-            unsigned int receivedBytes;
+    communicator->transmission.pending.clear();
 
-            try
-            {
-                receivedBytes = ::Communicator::Receive(
-                        connection.socket(),
-                        communicator->receiveBuffer,
-                        Dispatcher::MaximalMessageLength);
-            }
-            catch (::Communicator::TransmissionError& exception)
-            {
-                throw Dispatcher::Exception("Connection is broken",
-                        exception.errorNumber);
-            }
-            catch (::Communicator::NothingReceived&)
-            {
-                throw Dispatcher::Exception("Nothing received");
-            }
+    Dispatcher::Communicator::WatchSocket(communicator, connection, false);
+
+    // Timer fires at the deadline for the next response while requests are outstanding,
+    // otherwise at the end of idle time after which a neutrino is sent.
+    //
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds { communicator->primus.waitForResponse };
+
+    std::chrono::steady_clock::time_point armedDeadline;
 
+    // Manage an event loop where each of the following happens as soon as it can:
+    //   - Send avisos as long as there are some in a queue and transmission window is not full.
+    //   - Receive responses and acknowledge avisos in whatever order Primus confirms them.
+    //   - Send Neutrinos if nothing has been sent or received for a predifined period of time.
+    //
+    for (;;)
+    {
+        while ((outstandingRequests < communicator->primus.transmissionWindow) &&
+               (communicator->transmission.pending.empty() == true))
+        {
             try
             {
-                response.push(communicator->receiveBuffer, receivedBytes);
+                Dispatcher::Communicator::TransmitAvisos(
+                        communicator,
+                        connection,
+                        expectedCSeq);
             }
-            catch (std::exception& exception)
+            catch (Dispatcher::NothingInTheQueue&)
             {
-                ReportWarning("[Dispatcher] Exception: %s",
-                        exception.what());
-
                 break;
             }
 
-            if (response.datagramComplete() == true)
+            if (outstandingRequests == 0)
             {
-                break;
+                deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds { communicator->primus.waitForResponse };
             }
 
-            // Wait until next chunk of datagram is available.
-            // Cancel session in case of timeout.
+            // CSeq for each new datagram should be incremented by one.
             //
-            try
-            {
-                ::Communicator::Poll(
-                        connection.socket(),
-                        communicator->primus.waitForDatagramCompletion);
-            }
-            catch (::Communicator::PollError& exception)
-            {
-                throw Dispatcher::Exception("Poll for chunk did break",
-                        exception.errorNumber);
-            }
-            catch (::Communicator::PollTimeout&)
-            {
-                throw Dispatcher::Exception("Poll for chunk timed out");
-            }
-        }
+            expectedCSeq++;
 
-        if (response.statusCode == RTSP::Unauthorized)
-        {
-            throw Dispatcher::RejectedByPrimus("Rejected by Primus due to wrong authenticator");
+            outstandingRequests++;
         }
 
-        if (response.statusCode == RTSP::Forbidden)
+        // Producers wake up the loop only while it is able to take more avisos.
+        //
+        const bool readyForAvisos =
+                (outstandingRequests < communicator->primus.transmissionWindow) &&
+                (communicator->transmission.pending.empty() == true);
+
+        if ((readyForAvisos == true) && (queue.prepareToSleep() == false))
+            continue;
+
+        if (communicator->events.watchingOutput == communicator->transmission.pending.empty())
         {
-            throw Dispatcher::RejectedByPrimus("Rejected by Primus (Servus disabled)");
+            Dispatcher::Communicator::WatchSocket(
+                    communicator,
+                    connection,
+                    communicator->transmission.pending.empty() == false);
         }
 
-        if (response.statusCode != RTSP::OK)
+        if (deadline != armedDeadline)
         {
-            throw Dispatcher::Exception("Received unexpected response for authentication");
+            Dispatcher::Communicator::ArmTimer(communicator, deadline);
+
+            armedDeadline = deadline;
         }
-    }
 
-    if (communicator->setupDone == false)
-    {
-        {
-            request.reset();
+        struct epoll_event events[3];
 
-            request["CSeq"] = expectedCSeq;
-            request["Agent"] = Servus::SoftwareVersion;
-            request.generateRequest("SETUP", "rtsp://primus");
+        const int numberOfEvents = epoll_wait(
+                communicator->events.pollDescriptor,
+                events,
+                sizeof(events) / sizeof(events[0]),
+                -1);
 
-            try
-            {
-                ::Communicator::Send(
-                        connection.socket(),
-                        request.contentBuffer,
-                        request.contentLength);
-            }
-            catch (std::exception& exception)
-            {
-                throw exception;
-            }
+        if (readyForAvisos == true)
+            queue.awake();
 
-            expectedCSeq++;
+        if (numberOfEvents == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            throw Dispatcher::Exception("Event loop did break", errno);
         }
 
+        for (int eventIndex = 0; eventIndex < numberOfEvents; eventIndex++)
         {
-            response.reset();
-
-            try
-            {
-                ::Communicator::Poll(
-                        connection.socket(),
-                        communicator->primus.waitForResponse);
-            }
-            catch (::Communicator::PollError& exception)
-            {
-                throw Dispatcher::Exception("Keep-alive polling did break",
-                        exception.errorNumber);
-            }
-            catch (::Communicator::PollTimeout&)
-            {
-                throw Dispatcher::Exception("Session timed out");
-            }
+            const int descriptor = events[eventIndex].data.fd;
+            const uint32_t flags = events[eventIndex].events;
 
-            // Receive datagram chunks continuously until either complete datagram is received
-            // or timeout ocures.
-            //
-            for (;;)
+            if (descriptor == connection.socket())
             {
-                unsigned int receivedBytes;
-
-                try
+                if ((flags & EPOLLOUT) != 0)
                 {
-                    receivedBytes = ::Communicator::Receive(
-                            connection.socket(),
-                            communicator->receiveBuffer,
-                            Dispatcher::MaximalMessageLength);
-                }
-                catch (::Communicator::TransmissionError& exception)
-                {
-                    throw Dispatcher::Exception("Connection is broken",
-                            exception.errorNumber);
-                }
-                catch (::Communicator::NothingReceived&)
-                {
-                    throw Dispatcher::Exception("Nothing received");
+                    Dispatcher::Communicator::FlushOutput(communicator, connection);
                 }
 
-                try
+                if ((flags & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0)
                 {
-                    response.push(communicator->receiveBuffer, receivedBytes);
-                }
-                catch (std::exception& exception)
-                {
-                    ReportWarning("[Dispatcher] Exception: %s",
-                            exception.what());
+                    Dispatcher::Communicator::ReceiveAvailable(communicator, connection);
 
-                    break;
-                }
+                    while (Dispatcher::Communicator::TakeResponse(communicator, response) == true)
+                    {
+                        if (outstandingRequests == 0)
+                            throw Dispatcher::Exception("Unexpected response from Primus");
 
-                if (response.datagramComplete() == true)
-                {
-                    break;
-                }
+                        outstandingRequests--;
 
-                // Wait until next chunk of datagram is available.
-                // Cancel session in case of timeout.
-                //
-                try
-                {
-                    ::Communicator::Poll(
-                            connection.socket(),
-                            communicator->primus.waitForDatagramCompletion);
-                }
-                catch (::Communicator::PollError& exception)
-                {
-                    throw Dispatcher::Exception("Poll for chunk did break",
-                            exception.errorNumber);
-                }
-                catch (::Communicator::PollTimeout&)
-                {
-                    throw Dispatcher::Exception("Poll for chunk timed out");
+                        Dispatcher::DatagramSpan cseq;
+
+                        if ((resumeCSeq != 0) &&
+                            (response.find("CSeq", cseq) == true) &&
+                            (strtoul(response.at(cseq), NULL, 10) == resumeCSeq))
+                        {
+                            Dispatcher::Communicator::HandleResumption(communicator, response);
+                        }
+
+                        Dispatcher::Communicator::HandleResponse(response, neutrinoInterval);
+                    }
+
+                    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds {
+                        (communicator->reception.pending() != 0)
+                                ? communicator->primus.waitForDatagramCompletion
+                                : (outstandingRequests != 0)
+                                        ? communicator->primus.waitForResponse
+                                        : neutrinoInterval };
                 }
             }
+            else if (descriptor == communicator->events.timerDescriptor)
+            {
+                uint64_t expirations;
+
+                if (read(communicator->events.timerDescriptor, &expirations, sizeof(expirations)) == -1)
+                    continue;
+
+                if (std::chrono::steady_clock::now() < deadline)
+                    continue;
+
+                if ((outstandingRequests != 0) || (communicator->reception.pending() != 0))
+                    throw Dispatcher::Exception("Poll for response timed out");
 
-            if (response.statusCode != RTSP::OK)
+                ReportDebug("[Dispatcher] Neutrino timed out");
+
+                request.reset();
+                request["CSeq"] = expectedCSeq;
+                request["Agent"] = Servus::SoftwareVersion;
+                request.generateRequest("NEUTRINO", "rtsp://primus");
+
+                struct iovec vector;
+                vector.iov_base = request.contentBuffer;
+                vector.iov_len  = request.contentLength;
+
+                Dispatcher::Communicator::SendVector(communicator, connection, &vector, 1);
+
+                // CSeq for each new datagram should be incremented by one.
+                //
+                expectedCSeq++;
+
+                outstandingRequests++;
+
+                deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds { communicator->primus.waitForResponse };
+            }
+            else if (descriptor == queue.eventDescriptor())
             {
-                throw Dispatcher::Exception("Received unexpected response for configuration");
+                // New avisos are picked up at the beginning of the next pass.
+                // Consume a wake-up which arrived late, so that it does not fire again.
+                //
+                queue.awake();
             }
-
-            Dispatcher::ProcessConfigurationJSON(response.payload());
         }
-
-        communicator->setupDone = true;
     }
+}
+
+/**
+ * @brief   Authenticate to Primus and fetch the configuration unless it is in effect already.
+ */
+void
+Dispatcher::Communicator::PerformHandshake(
+    Dispatcher::Communicator*   communicator,
+    TCP::Connection&            connection,
+    unsigned int&               expectedCSeq)
+{
+    RTSP::Datagram request;
+    Dispatcher::DatagramView response;
 
     {
         request.reset();
 
+        Workspace::Kernel& kernel = Workspace::Kernel::SharedInstance();
+
         request["CSeq"] = expectedCSeq;
+        request["Authenticator"] = communicator->primus.authenticator;
+        request["Running-Since"] = kernel.timestampOfStart->floatString();
         request["Agent"] = Servus::SoftwareVersion;
-        request.generateRequest("PLAY", "rtsp://primus");
+        request.generateRequest("AUTH", "rtsp://primus");
 
         try
         {
@@ -463,181 +647,644 @@ Dispatcher::Communicator::HandleSession(
         expectedCSeq++;
     }
 
-    // Manage an endless loop of:
-    //   - Authenticate.
-    //   - Send Avisos once there are some in a queue.
-    //   - Send Neutrinos if there are no Avisos for a predifined period of time.
-    //
-    for (;;)
     {
-        response.reset();
+        Dispatcher::Communicator::AwaitResponse(communicator, connection, response);
 
-        // Receive datagram chunks continuously until either complete datagram is received
-        // or timeout ocures.
-        //
-        for (;;)
+        if (response.statusCode == RTSP::Unauthorized)
         {
-            unsigned int receivedBytes;
+            throw Dispatcher::RejectedByPrimus("Rejected by Primus due to wrong authenticator");
+        }
 
-            try
-            {
-                receivedBytes = ::Communicator::Receive(
-                        connection.socket(),
-                        communicator->receiveBuffer,
-                        Dispatcher::MaximalMessageLength);
-            }
-            catch (::Communicator::TransmissionError& exception)
-            {
-                throw Dispatcher::Exception("Connection is broken",
-                        exception.errorNumber);
-            }
-            catch (::Communicator::NothingReceived&)
-            {
-                throw Dispatcher::Exception("Nothing received");
-            }
+        if (response.statusCode == RTSP::Forbidden)
+        {
+            throw Dispatcher::RejectedByPrimus("Rejected by Primus (Servus disabled)");
+        }
 
-            try
-            {
-                response.push(communicator->receiveBuffer, receivedBytes);
-            }
-            catch (std::exception& exception)
-            {
-                ReportWarning("[Dispatcher] Exception: %s",
-                        exception.what());
+        if (response.statusCode != RTSP::OK)
+        {
+            throw Dispatcher::Exception("Received unexpected response for authentication");
+        }
 
-                break;
-            }
+        Dispatcher::DatagramSpan token;
+
+        if (response.find("Session-Token", token) == true)
+        {
+            communicator->resumption.token.assign(response.at(token), token.length);
+        }
+        else
+        {
+            communicator->resumption.token.clear();
+        }
+    }
+
+    if (communicator->setupDone == false)
+    {
+        {
+            request.reset();
 
-            if (response.datagramComplete() == true)
+            request["CSeq"] = expectedCSeq;
+            request["Agent"] = Servus::SoftwareVersion;
+
+            if (communicator->setup.hash.empty() == false)
             {
-                break;
+                request["Configuration-Hash"] = communicator->setup.hash;
             }
 
-            // Wait until next chunk of datagram is available.
-            // Cancel session in case of timeout.
-            //
+            request.generateRequest("SETUP", "rtsp://primus");
+
             try
             {
-                ::Communicator::Poll(
+                ::Communicator::Send(
                         connection.socket(),
-                        communicator->primus.waitForDatagramCompletion);
+                        request.contentBuffer,
+                        request.contentLength);
             }
-            catch (::Communicator::PollError& exception)
+            catch (std::exception& exception)
             {
-                throw Dispatcher::Exception("Poll for chunk did break",
-                        exception.errorNumber);
+                throw exception;
             }
-            catch (::Communicator::PollTimeout&)
+
+            expectedCSeq++;
+        }
+
+        {
+            Dispatcher::Communicator::AwaitResponse(communicator, connection, response);
+
+            if ((response.statusCode != RTSP::OK) &&
+                (response.statusCode != RTSP::NotModified))
             {
-                throw Dispatcher::Exception("Poll for chunk timed out");
+                throw Dispatcher::Exception("Received unexpected response for configuration");
             }
+
+            Dispatcher::Communicator::TakeOverConfiguration(communicator, response);
         }
 
-        if (response.statusCode == RTSP::Created)
+        communicator->setupDone = true;
+    }
+}
+
+/**
+ * @brief   Take over the configuration in a response from Primus, unless it is known already.
+ */
+void
+Dispatcher::Communicator::TakeOverConfiguration(
+    Dispatcher::Communicator*   communicator,
+    Dispatcher::DatagramView&   response)
+{
+    if (response.statusCode == RTSP::NotModified)
+    {
+        ReportInfo("[Dispatcher] Configuration %s is up to date",
+                communicator->setup.hash.c_str());
+    }
+    else if (response.statusCode == RTSP::OK)
+    {
+        const std::string json(response.at(response.payload), response.payload.length);
+        const std::string hash = Dispatcher::ConfigurationHash(json);
+
+        if (hash == communicator->setup.hash)
         {
-            try
+            ReportInfo("[Dispatcher] Configuration %s is up to date",
+                    hash.c_str());
+        }
+        else
+        {
+            Dispatcher::StoreConfigurationCache(json, hash);
+
+            if (communicator->setup.inEffect == true)
             {
-                unsigned int avisoId = response["Aviso-Id"];
+                // Peripherals of the configuration in effect are already running
+                // and cannot be set up a second time.
+                //
+                ReportNotice("[Dispatcher] Configuration has changed to %s - takes effect after restart",
+                        hash.c_str());
+            }
+            else
+            {
+                Dispatcher::ProcessConfigurationJSON(json);
+
+                communicator->setup.inEffect = true;
+            }
+
+            // Cache holds the new configuration either way, so that Primus
+            // does not send it again with every session.
+            //
+            communicator->setup.hash = hash;
+        }
+    }
+}
+
+/**
+ * @brief   Check whether Primus has accepted to resume the session.
+ *
+ * Primus may renew the token and send a configuration which differs from the one in effect.
+ * If Primus refuses, the token is dropped and a session with a full handshake begins right away.
+ * Avisos sent meanwhile are transmitted again then.
+ */
+void
+Dispatcher::Communicator::HandleResumption(
+    Dispatcher::Communicator*   communicator,
+    Dispatcher::DatagramView&   response)
+{
+    if (response.statusCode != RTSP::OK)
+    {
+        communicator->resumption.token.clear();
+
+        throw Dispatcher::ResumptionRefused("Primus refused to resume session");
+    }
+
+    Dispatcher::DatagramSpan token;
+
+    if (response.find("Session-Token", token) == true)
+    {
+        communicator->resumption.token.assign(response.at(token), token.length);
+    }
+
+    if (response.payload.length != 0)
+    {
+        Dispatcher::Communicator::TakeOverConfiguration(communicator, response);
+    }
+}
+
+/**
+ * @brief   Call a handler for each aviso id a response refers to.
+ *
+ * Ids of a batch are read in place from Aviso-Ids, the list ends with CR.
+ *
+ * @return  Boolean false if the response refers to no aviso.
+ */
+template <typename Handler>
+static bool
+ForEachAvisoId(
+    Dispatcher::DatagramView&   response,
+    Handler                     handler)
+{
+    Dispatcher::DatagramSpan avisoIds;
+
+    if (response.find("Aviso-Ids", avisoIds) == true)
+    {
+        const char* avisoId = response.at(avisoIds);
+        const char* const end = avisoId + avisoIds.length;
+
+        while (avisoId < end)
+        {
+            char* next;
+
+            const unsigned int referencedId = strtoul(avisoId, &next, 10);
+
+            if (next == avisoId)
+                break;
+
+            handler(referencedId);
+
+            avisoId = (*next == ',') ? next + 1 : next;
+        }
+
+        return true;
+    }
+
+    if (response.find("Aviso-Id", avisoIds) == true)
+    {
+        handler((unsigned int) response.number("Aviso-Id"));
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Acknowledge avisos confirmed by a response and take over the neutrino interval.
+ *
+ * Avisos Primus refuses with a client error are dropped, as sending them again
+ * would not help. Avisos Primus fails to take over otherwise are transmitted again.
+ */
+void
+Dispatcher::Communicator::HandleResponse(
+    Dispatcher::DatagramView&   response,
+    unsigned int&               neutrinoInterval)
+{
+    Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
+
+    const unsigned int statusCode = response.statusCode;
+
+    if (statusCode == RTSP::Created)
+    {
+        // Batch has been acknowledged as a whole.
+        //
+        const bool referenced = ForEachAvisoId(response,
+                [&queue] (const unsigned int avisoId)
+                {
+                    queue.dequeueAviso(avisoId);
+                });
+
+        if (referenced == false)
+            throw Dispatcher::Exception("Missing aviso id in response from Primus");
+    }
+    else if ((statusCode >= 400) && (statusCode < 500))
+    {
+        const bool referenced = ForEachAvisoId(response,
+                [&queue, statusCode] (const unsigned int avisoId)
+                {
+                    ReportWarning("[Dispatcher] Primus refused aviso #%u with %u, drop it",
+                            avisoId,
+                            statusCode);
+
+                    queue.dequeueAviso(avisoId);
+                });
+
+        if (referenced == false)
+            throw Dispatcher::Exception("Primus refused a request");
+    }
+    else if (statusCode != RTSP::OK)
+    {
+        const bool referenced = ForEachAvisoId(response,
+                [&queue, statusCode] (const unsigned int avisoId)
+                {
+                    ReportNotice("[Dispatcher] Primus failed to take over aviso #%u with %u, retransmit it",
+                            avisoId,
+                            statusCode);
+
+                    queue.retransmitAviso(avisoId);
+                });
+
+        // Avisos which cannot be told apart are transmitted again with the next session.
+        //
+        if (referenced == false)
+            throw Dispatcher::Exception("Primus failed to take over avisos");
+    }
+
+    try
+    {
+        neutrinoInterval = response.number("Neutrino-Interval");
+    }
+    catch (RTSP::StatementNotFound&)
+    {
+        // Error responses may leave out the interval, which stays as it was.
+        //
+        if ((statusCode == RTSP::OK) || (statusCode == RTSP::Created))
+            throw Dispatcher::Exception("Broken communication with Primus");
+    }
+
+    ReportDebug("[Dispatcher] Neutrino interval %u milliseconds",
+            neutrinoInterval);
+}
+
+/**
+ * @brief   Transmit next aviso from the queue, or a batch of avisos if several are waiting.
+ *
+ * Avisos have been encoded by their producers. Only the request line, CSeq
+ * and Agent are put in front of them and the pieces are written with one system call.
+ *
+ * A batch is an AVISO-BATCH request whose payload is the concatenation of
+ * the fields of the avisos, each beginning with Aviso-Type.
+ * Primus acknowledges the batch with the list of all aviso ids in one response.
+ *
+ * @throw   NothingInTheQueue   If there is nothing to transmit.
+ */
+void
+Dispatcher::Communicator::TransmitAvisos(
+    Dispatcher::Communicator*   communicator,
+    TCP::Connection&            connection,
+    const unsigned int          cseq)
+{
+    Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
+
+    std::vector<struct iovec>& vector = communicator->transmission.vector;
+
+    Dispatcher::Aviso* aviso = queue.fetchNextAviso();
+
+    char line[64];
+
+    if ((communicator->primus.maximalAvisosPerBatch > 1) &&
+        (queue.pendingAvisos() == true))
+    {
+        std::string& avisoIds = communicator->transmission.header;
+
+        unsigned int numberOfAvisos = 0;
+        unsigned int payloadLength = 0;
+
+        avisoIds.clear();
+        vector.resize(1);
+
+        for (;;)
+        {
+            struct iovec entry;
+            entry.iov_base  = aviso->wire.buffer;
+            entry.iov_len   = aviso->wire.length;
 
-                queue.dequeueAviso(avisoId);
+            vector.push_back(entry);
+
+            payloadLength += aviso->wire.length;
+
+            snprintf(line, sizeof(line), (numberOfAvisos == 0) ? "%u" : ",%u", aviso->avisoId);
+            avisoIds.append(line);
+
+            numberOfAvisos++;
+
+            if (numberOfAvisos == communicator->primus.maximalAvisosPerBatch)
+                break;
+
+            try
+            {
+                aviso = queue.peekNextAviso();
             }
-            catch (RTSP::StatementNotFound&)
+            catch (Dispatcher::NothingInTheQueue&)
             {
-                throw Dispatcher::Exception("Missing aviso id in response from Primus");
+                break;
             }
+
+            // Check whether next aviso still fits into the batch.
+            //
+            if (payloadLength + aviso->wire.length > communicator->primus.maximalBatchLength)
+                break;
+
+            queue.fetchNextAviso();
         }
 
-        unsigned int neutrinoInterval;
+        ReportInfo("[Dispatcher] Transmit batch of %u avisos",
+                numberOfAvisos);
 
-        try
+        // Header is built in front of the list of ids, which is already in place.
+        //
+        snprintf(line, sizeof(line), "CSeq: %u\r\nAviso-Count: %u\r\nAviso-Ids: ",
+                cseq,
+                numberOfAvisos);
+
+        avisoIds.insert(0, line);
+        avisoIds.insert(0, BatchRequestTemplate);
+
+        snprintf(line, sizeof(line), "\r\nContent-Length: %u\r\n\r\n",
+                payloadLength);
+
+        avisoIds.append(line);
+
+        vector[0].iov_base  = (void*) avisoIds.data();
+        vector[0].iov_len   = avisoIds.length();
+    }
+    else
+    {
+        std::string& header = communicator->transmission.header;
+
+        snprintf(line, sizeof(line), "CSeq: %u\r\n", cseq);
+
+        // Aviso type is the method, the fields of the aviso follow the constant header.
+        //
+        header.assign(aviso->avisoType);
+        header.append(RequestLineTemplate);
+        header.append(line);
+        header.append(AgentTemplate);
+
+        vector.resize(2);
+
+        vector[0].iov_base  = (void*) header.data();
+        vector[0].iov_len   = header.length();
+        vector[1].iov_base  = aviso->wire.buffer;
+        vector[1].iov_len   = aviso->wire.length;
+    }
+
+    Dispatcher::Communicator::SendVector(communicator, connection, vector.data(), vector.size());
+}
+
+/**
+ * @brief   Write all pieces of a request to the socket without blocking.
+ *
+ * Whatever the socket does not take is kept and sent by FlushOutput()
+ * once the socket becomes writable.
+ */
+void
+Dispatcher::Communicator::SendVector(
+    Dispatcher::Communicator*   communicator,
+    TCP::Connection&            connection,
+    struct iovec*               vector,
+    unsigned int                count)
+{
+    std::string& pending = communicator->transmission.pending;
+
+    // Keep the order of bytes if earlier ones still wait.
+    //
+    if (pending.empty() == false)
+    {
+        for (unsigned int index = 0; index < count; index++)
+            pending.append((const char*) vector[index].iov_base, vector[index].iov_len);
+
+        return;
+    }
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+
+    message.msg_iov     = vector;
+    message.msg_iovlen  = count;
+
+    ssize_t sent;
+
+    for (;;)
+    {
+        sent = sendmsg(connection.socket(), &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent != -1)
+            break;
+
+        if (errno == EINTR)
+            continue;
+
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
         {
-            neutrinoInterval = response["Neutrino-Interval"];
+            sent = 0;
+            break;
         }
-        catch (RTSP::StatementNotFound&)
+
+        ReportWarning("[Dispatcher] Cannot transmit aviso: errno=%d",
+                errno);
+
+        throw Dispatcher::Exception("Cannot transmit aviso", errno);
+    }
+
+    // Skip pieces which have been sent completely and keep the rest.
+    //
+    for (unsigned int index = 0; index < count; index++)
+    {
+        if ((size_t) sent >= vector[index].iov_len)
         {
-            throw Dispatcher::Exception("Broken communication with Primus");
+            sent -= vector[index].iov_len;
+
+            continue;
         }
 
+        pending.append((const char*) vector[index].iov_base + sent, vector[index].iov_len - sent);
+
+        sent = 0;
+    }
+}
+
+/**
+ * @brief   Send bytes kept by SendVector() as far as the socket takes them.
+ */
+void
+Dispatcher::Communicator::FlushOutput(
+    Dispatcher::Communicator*   communicator,
+    TCP::Connection&            connection)
+{
+    std::string& pending = communicator->transmission.pending;
+
+    while (pending.empty() == false)
+    {
+        ssize_t sent = send(connection.socket(),
+                pending.data(),
+                pending.length(),
+                MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (sent == -1)
         {
-            std::cv_status waitStatus;
+            if (errno == EINTR)
+                continue;
 
-            ReportDebug("[Dispatcher] Neutrino interval %u milliseconds",
-                    neutrinoInterval);
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                return;
 
-            if (queue.pendingAvisos() == false)
-            {
-                waitStatus = queue.wait(std::chrono::milliseconds { neutrinoInterval } );
+            throw Dispatcher::Exception("Cannot transmit aviso", errno);
+        }
 
-                if (waitStatus == std::cv_status::timeout)
-                {
-                    ReportDebug("[Dispatcher] Neutrino timed out");
+        pending.erase(0, sent);
+    }
+}
 
-                    try
-                    {
-                        request.reset();
-                        request["CSeq"] = expectedCSeq;
-                        request["Agent"] = Servus::SoftwareVersion;
-                        request.generateRequest("NEUTRINO", "rtsp://primus");
-
-                        ::Communicator::Send(
-                                connection.socket(),
-                                request.contentBuffer,
-                                request.contentLength);
-
-                        // CSeq for each new datagram should be incremented by one.
-                        //
-                        expectedCSeq++;
-                    }
-                    catch (std::exception& exception)
-                    {
-                        ReportWarning("[Dispatcher] Cannot send neutrino: %s",
-                                exception.what());
+/**
+ * @brief   Watch the socket for incoming data, and for room to write while output is pending.
+ */
+void
+Dispatcher::Communicator::WatchSocket(
+    Dispatcher::Communicator*   communicator,
+    TCP::Connection&            connection,
+    const bool                  output)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events    = (output == true) ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.fd   = connection.socket();
 
-                        throw exception;
-                    }
-                }
-            }
+    // Descriptor of a new session may have the number of the previous one.
+    //
+    if (epoll_ctl(communicator->events.pollDescriptor, EPOLL_CTL_MOD, connection.socket(), &event) == -1)
+    {
+        if (epoll_ctl(communicator->events.pollDescriptor, EPOLL_CTL_ADD, connection.socket(), &event) == -1)
+            throw Dispatcher::Exception("Cannot watch connection", errno);
+    }
 
-            {
-                try
-                {
-                    Dispatcher::Aviso* aviso = queue.fetchFirstAviso();
+    communicator->events.watchingOutput = output;
+}
 
-                    request.reset();
-                    request["CSeq"] = expectedCSeq;
-                    request["Agent"] = Servus::SoftwareVersion;
-                    aviso->prepare(request);
-                    request.generateRequest(aviso->avisoType, "rtsp://primus", aviso->payload());
+/**
+ * @brief   Let the timer fire at the given point in time.
+ */
+void
+Dispatcher::Communicator::ArmTimer(
+    Dispatcher::Communicator*                   communicator,
+    const std::chrono::steady_clock::time_point deadline)
+{
+    std::chrono::nanoseconds remaining = deadline - std::chrono::steady_clock::now();
 
-                    try
-                    {
-                        ::Communicator::Send(
-                                connection.socket(),
-                                request.contentBuffer,
-                                request.contentLength);
-
-                        // CSeq for each new datagram should be incremented by one.
-                        //
-                        expectedCSeq++;
-                    }
-                    catch (std::exception& exception)
-                    {
-                        ReportWarning("[Dispatcher] Cannot transmit aviso: %s",
-                                exception.what());
-                    }
-                }
-                catch (Dispatcher::NothingInTheQueue&)
-                {
-                    // Just skip it.
-                }
-                catch (std::exception& exception)
-                {
-                    ReportWarning("[Dispatcher] Cannot handle aviso: %s",
-                            exception.what());
+    // Zero would disarm the timer.
+    //
+    if (remaining.count() <= 0)
+        remaining = std::chrono::nanoseconds { 1 };
 
-                    throw exception;
-                }
-            }
+    struct itimerspec timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec   = remaining.count() / 1000000000;
+    timer.it_value.tv_nsec  = remaining.count() % 1000000000;
+
+    timerfd_settime(communicator->events.timerDescriptor, 0, &timer, NULL);
+}
+
+/**
+ * @brief   Wait for the response to a request of the handshake.
+ *
+ * The ring keeps the state of framing between chunks, so that each chunk
+ * is examined only once however slowly the response trickles in.
+ */
+void
+Dispatcher::Communicator::AwaitResponse(
+    Dispatcher::Communicator*   communicator,
+    TCP::Connection&            connection,
+    Dispatcher::DatagramView&   response)
+{
+    unsigned int timeout = communicator->primus.waitForResponse;
+
+    while (Dispatcher::Communicator::TakeResponse(communicator, response) == false)
+    {
+        // Cancel session in case of timeout.
+        //
+        try
+        {
+            ::Communicator::Poll(connection.socket(), timeout);
+        }
+        catch (::Communicator::PollError& exception)
+        {
+            throw Dispatcher::Exception("Poll for response did break",
+                    exception.errorNumber);
+        }
+        catch (::Communicator::PollTimeout&)
+        {
+            throw Dispatcher::Exception((communicator->reception.pending() == 0)
+                    ? "Session timed out"
+                    : "Poll for chunk timed out");
         }
+
+        Dispatcher::Communicator::ReceiveAvailable(communicator, connection);
+
+        timeout = communicator->primus.waitForDatagramCompletion;
+    }
+}
+
+/**
+ * @brief   Read whatever Primus has sent so far without blocking.
+ *
+ * Several pipelined responses may arrive in one chunk. They are taken out
+ * of the receive ring one by one by TakeResponse().
+ */
+void
+Dispatcher::Communicator::ReceiveAvailable(
+    Dispatcher::Communicator*   communicator,
+    TCP::Connection&            connection)
+{
+    try
+    {
+        communicator->reception.receive(connection.socket());
+    }
+    catch (Dispatcher::ReceiveError& exception)
+    {
+        if (exception.errorNumber == 0)
+            throw Dispatcher::Exception("Connection closed by Primus");
+
+        throw Dispatcher::Exception("Connection is broken", exception.errorNumber);
+    }
+    catch (Dispatcher::BrokenDatagram&)
+    {
+        throw Dispatcher::Exception("Response from Primus is too long");
+    }
+}
+
+/**
+ * @brief   Take the first complete response out of the receive ring.
+ *
+ * The response is a view into the ring, valid until the next ReceiveAvailable().
+ *
+ * @return  Boolean false if there is no complete response yet.
+ */
+bool
+Dispatcher::Communicator::TakeResponse(
+    Dispatcher::Communicator*   communicator,
+    Dispatcher::DatagramView&   response)
+{
+    try
+    {
+        return communicator->reception.take(response);
+    }
+    catch (Dispatcher::BrokenDatagram& exception)
+    {
+        ReportWarning("[Dispatcher] Exception: %s",
+                exception.what());
+
+        throw Dispatcher::Exception("Broken response from Primus");
     }
 }
@@ -2,19 +2,33 @@
 
 // System definition files.
 //
+#include <sys/uio.h>
+#include <chrono>
 #include <cstdbool>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 // Common definition files.
 //
 #include "Communicator/TCP.hpp"
+#include "RTSP/RTSP.hpp"
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/ReceiveRing.hpp"
 
 namespace Dispatcher
 {
     static const unsigned int MaximalMessageLength = 64 * 1024;
 
+    /**
+     * Avisos in flight a session is resumed with at most, beyond that
+     * a new session with a full handshake begins.
+     */
+    static const unsigned int MaximalOutstandingAvisos = 256;
+
     class Communicator
     {
     private:
@@ -26,6 +40,30 @@ namespace Dispatcher
     private:
         bool                setupDone;
 
+        /**
+         * Hash of the configuration last taken over, empty if there is none yet,
+         * and whether a configuration, cached or received, is in effect already.
+         * A configuration taken over after the one in effect takes effect after restart.
+         */
+        struct
+        {
+            std::string     hash;
+            bool            inEffect;
+        }
+        setup;
+
+        /**
+         * Token issued by Primus for resuming a broken session
+         * and the avisos in flight when the session broke, reused for every resumption.
+         */
+        struct
+        {
+            std::string                 token;
+            std::vector<unsigned int>   outstanding;
+            std::string                 outstandingIds;
+        }
+        resumption;
+
         struct
         {
             std::string     address;
@@ -35,10 +73,43 @@ namespace Dispatcher
             unsigned int    reconnectInterval;
             unsigned int    waitForResponse;
             unsigned int    waitForDatagramCompletion;
+            unsigned int    transmissionWindow;
+            unsigned int    maximalAvisosPerBatch;
+            unsigned int    maximalBatchLength;
         }
         primus;
 
-        char*               receiveBuffer;
+        /**
+         * Responses from Primus, framed and parsed in place.
+         */
+        Dispatcher::ReceiveRing reception;
+
+        /**
+         * Reused for every transmission, so that sending avisos does not allocate.
+         */
+        struct
+        {
+            std::string                 header;
+            std::vector<struct iovec>   vector;
+
+            /**
+             * Bytes the socket did not take yet, sent as soon as it becomes writable.
+             */
+            std::string                 pending;
+        }
+        transmission;
+
+        /**
+         * Event loop of dispatcher thread watching the Primus socket,
+         * the event descriptor of the queue and a timer.
+         */
+        struct
+        {
+            int                         pollDescriptor;
+            int                         timerDescriptor;
+            bool                        watchingOutput;
+        }
+        events;
 
     public:
         static Dispatcher::Communicator&
@@ -66,6 +137,17 @@ namespace Dispatcher
             const unsigned int waitForResponse,
             const unsigned int waitForDatagramCompletion);
 
+        void
+        setTransmissionWindow(const unsigned int transmissionWindow);
+
+        void
+        setBatchLimits(
+            const unsigned int maximalAvisosPerBatch,
+            const unsigned int maximalBatchLength);
+
+        void
+        applyCachedConfiguration();
+
         void
         start();
 
@@ -75,6 +157,66 @@ namespace Dispatcher
 
         static void
         HandleSession(Dispatcher::Communicator*, TCP::Connection&);
+
+        static void
+        PerformHandshake(
+            Dispatcher::Communicator*,
+            TCP::Connection&,
+            unsigned int&               expectedCSeq);
+
+        static void
+        TakeOverConfiguration(
+            Dispatcher::Communicator*,
+            Dispatcher::DatagramView&   response);
+
+        static void
+        HandleResumption(
+            Dispatcher::Communicator*,
+            Dispatcher::DatagramView&   response);
+
+        static void
+        HandleResponse(
+            Dispatcher::DatagramView&   response,
+            unsigned int&               neutrinoInterval);
+
+        static void
+        TransmitAvisos(
+            Dispatcher::Communicator*,
+            TCP::Connection&,
+            const unsigned int cseq);
+
+        static void
+        SendVector(
+            Dispatcher::Communicator*,
+            TCP::Connection&,
+            struct iovec*       vector,
+            unsigned int        count);
+
+        static void
+        FlushOutput(Dispatcher::Communicator*, TCP::Connection&);
+
+        static void
+        WatchSocket(
+            Dispatcher::Communicator*,
+            TCP::Connection&,
+            const bool          output);
+
+        static void
+        ArmTimer(
+            Dispatcher::Communicator*,
+            const std::chrono::steady_clock::time_point deadline);
+
+        static void
+        AwaitResponse(
+            Dispatcher::Communicator*,
+            TCP::Connection&,
+            Dispatcher::DatagramView&   response);
+
+        static void
+        ReceiveAvailable(Dispatcher::Communicator*, TCP::Connection&);
+
+        static bool
+        TakeResponse(Dispatcher::Communicator*, Dispatcher::DatagramView&);
     };
 
     class Exception : public std::runtime_error
@@ -101,4 +243,12 @@ namespace Dispatcher
         std::runtime_error(reason)
         { }
     };
+
+    class ResumptionRefused : public std::runtime_error
+    {
+    public:
+        ResumptionRefused(const char* const reason) throw() :
+        std::runtime_error(reason)
+        { }
+    };
 };
@@ -1,11 +1,23 @@
 // System definition files.
 //
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
 #include <condition_variable>
 #include <cstdbool>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <mutex>
-#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // Common definition files.
 //
@@ -13,8 +25,10 @@
 
 // Local definition files.
 //
+#include "Servus/Configuration.hpp"
 #include "Servus/Dispatcher/Aviso.hpp"
 #include "Servus/Dispatcher/Queue.hpp"
+#include "Servus/Dispatcher/Spool.hpp"
 
 static Dispatcher::Queue* instance = NULL;
 
@@ -40,119 +54,1528 @@ Dispatcher::Queue::SharedInstance()
 
 Dispatcher::Queue::Queue()
 {
-    this->lastAvisoId = 0;
+    static_assert((Dispatcher::QueueCapacity & (Dispatcher::QueueCapacity - 1)) == 0,
+            "Queue capacity must be a power of two");
+    static_assert(Dispatcher::QueueLanes == Dispatcher::SpoolLanes,
+            "Spool must keep a cursor per lane");
+
+    static const unsigned int memoryShares[Dispatcher::QueueLanes] = { 100, 80, 50 };
+
+    static const unsigned int weights[Dispatcher::QueueLanes] =
+    {
+        Servus::DefaultQueueCriticalWeight,
+        Servus::DefaultQueueNormalWeight,
+        Servus::DefaultQueueTelemetryWeight
+    };
+
+    this->ring.mask = Dispatcher::QueueCapacity - 1;
+
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        Lane& lane = this->ring.lanes[laneIndex];
+
+        lane.slots = new Slot[Dispatcher::QueueCapacity];
+
+        for (uint64_t position = 0;
+             position < Dispatcher::QueueCapacity;
+             position++)
+        {
+            lane.slots[position].sequence.store(position, std::memory_order_relaxed);
+            lane.slots[position].aviso = NULL;
+            lane.slots[position].footprint = 0;
+            lane.slots[position].acknowledged = false;
+            lane.slots[position].readers.store(0, std::memory_order_relaxed);
+            lane.slots[position].retired.store(0, std::memory_order_relaxed);
+        }
+
+        lane.memoryShare = memoryShares[laneIndex];
+        lane.weight = weights[laneIndex];
+        lane.credit = lane.weight;
+
+        lane.tail.store(0, std::memory_order_relaxed);
+        lane.head.store(0, std::memory_order_relaxed);
+        lane.cursor = 0;
+    }
+
+    this->ring.criticalSeverityLevel = Servus::DefaultQueueCriticalSeverity;
+    this->ring.memoryCeiling = Servus::DefaultQueueMemoryCeiling;
+    this->ring.selectedLane = Dispatcher::LaneCritical;
+
+    this->ring.lastAvisoId.store(0, std::memory_order_relaxed);
+    this->ring.residentBytes.store(0, std::memory_order_relaxed);
+    this->ring.consumerSleeping.store(false, std::memory_order_relaxed);
+
+    this->ring.eventDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->ring.eventDescriptor == -1)
+    {
+        ReportSoftAlert("[Dispatcher] Cannot create event descriptor: errno=%d",
+                errno);
+
+        for (unsigned int laneIndex = 0;
+             laneIndex < Dispatcher::QueueLanes;
+             laneIndex++)
+        {
+            delete[] this->ring.lanes[laneIndex].slots;
+        }
+
+        throw std::runtime_error("[Dispatcher] Cannot create event descriptor");
+    }
+
+    this->sinks.count = 0;
+
+    this->spool = NULL;
+
+    this->coalescing.enabled = false;
+
+    this->pressure.highCount = Servus::DefaultQueueHighWatermarkCount;
+    this->pressure.lowCount = Servus::DefaultQueueLowWatermarkCount;
+    this->pressure.highBytes = Servus::DefaultQueueHighWatermarkBytes;
+    this->pressure.lowBytes = Servus::DefaultQueueLowWatermarkBytes;
+    this->pressure.retryAfter = Servus::DefaultQueueRetryAfter;
+    this->pressure.congested.store(false, std::memory_order_relaxed);
 }
 
 Dispatcher::Queue::~Queue()
-{ }
+{
+    if (this->spool != NULL)
+        delete this->spool;
+
+    close(this->ring.eventDescriptor);
+
+    for (unsigned int sinkId = 0;
+         sinkId < this->sinks.count;
+         sinkId++)
+    {
+        close(this->sinks.list[sinkId].eventDescriptor);
+    }
+
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        delete[] this->ring.lanes[laneIndex].slots;
+    }
+}
+
+/**
+ * @brief   Open the spool and replay avisos left from the previous run.
+ *
+ * Must be called before any aviso is enqueued.
+ *
+ * @throw   SpoolError      If the spool directory cannot be used.
+ */
+void
+Dispatcher::Queue::openSpool(
+    const std::string&  directoryPath,
+    const unsigned int  segmentSize,
+    const unsigned int  maximalSegments,
+    const unsigned int  syncInterval)
+{
+    Dispatcher::Spool* spool =
+            new Dispatcher::Spool(directoryPath, segmentSize, maximalSegments, syncInterval);
+
+    try
+    {
+        this->ring.lastAvisoId.store(spool->replay(), std::memory_order_relaxed);
+
+        spool->start();
+    }
+    catch (Dispatcher::SpoolError& exception)
+    {
+        delete spool;
+
+        throw;
+    }
+
+    this->spool = spool;
+
+    if (this->spool->spilled() != 0)
+    {
+        ReportNotice("[Dispatcher] Replay %u avisos from spool",
+                this->spool->spilled());
+    }
+}
+
+/**
+ * @brief   Switch coalescing of sensor avisos on or off.
+ *
+ * Must be called before any aviso is enqueued.
+ */
+void
+Dispatcher::Queue::setCoalescing(const bool enabled)
+{
+    this->coalescing.enabled = enabled;
+}
+
+/**
+ * @brief   Define which fabulas are critical and how much memory avisos may take.
+ *
+ * Must be called before any aviso is enqueued.
+ *
+ * @param   criticalSeverityLevel   Fabulas of this or a lower severity level
+ *                                  go to the critical lane.
+ * @param   memoryCeiling           Bytes all avisos in the lanes may take together.
+ */
+void
+Dispatcher::Queue::setPriorities(
+    const unsigned short    criticalSeverityLevel,
+    const size_t            memoryCeiling)
+{
+    this->ring.criticalSeverityLevel = criticalSeverityLevel;
+    this->ring.memoryCeiling = memoryCeiling;
+}
+
+/**
+ * @brief   Define how many avisos are fetched from a lane per round.
+ *
+ * Must be called before any aviso is enqueued.
+ */
+void
+Dispatcher::Queue::setLaneWeight(
+    const Dispatcher::QueueLane lane,
+    const unsigned int          weight)
+{
+    this->ring.lanes[lane].weight = (weight == 0) ? 1 : weight;
+    this->ring.lanes[lane].credit = this->ring.lanes[lane].weight;
+}
+
+/**
+ * @brief   Define when producers are asked to hold back avisos.
+ *
+ * Low watermarks above the high ones are taken as the high ones.
+ * Must be called before any aviso is enqueued.
+ */
+void
+Dispatcher::Queue::setWatermarks(
+    const size_t        highCount,
+    const size_t        lowCount,
+    const size_t        highBytes,
+    const size_t        lowBytes,
+    const unsigned int  retryAfter)
+{
+    this->pressure.highCount = highCount;
+    this->pressure.lowCount = (lowCount > highCount) ? highCount : lowCount;
+    this->pressure.highBytes = highBytes;
+    this->pressure.lowBytes = (lowBytes > highBytes) ? highBytes : lowBytes;
+    this->pressure.retryAfter = (retryAfter == 0) ? 1 : retryAfter;
+}
+
+/**
+ * @brief   Let a further sink read all avisos of the queue.
+ *
+ * Must be called before any aviso is enqueued. A sink which is not lossy
+ * holds back the release of every aviso until it has read it.
+ *
+ * @return  Id of the sink, to be used by the thread of the sink.
+ */
+unsigned int
+Dispatcher::Queue::registerSink(
+    const std::string&  name,
+    const bool          lossy)
+{
+    if (this->sinks.count == Dispatcher::QueueSinks)
+        throw std::runtime_error("[Dispatcher] Too many sinks");
+
+    Sink& sink = this->sinks.list[this->sinks.count];
+
+    sink.eventDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sink.eventDescriptor == -1)
+    {
+        ReportSoftAlert("[Dispatcher] Cannot create event descriptor for sink: errno=%d",
+                errno);
+
+        throw std::runtime_error("[Dispatcher] Cannot create event descriptor");
+    }
+
+    sink.name = name;
+    sink.lossy = lossy;
+    sink.selectedLane = Dispatcher::LaneCritical;
+
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        sink.positions[laneIndex].store(0, std::memory_order_relaxed);
+    }
+
+    sink.sleeping.store(false, std::memory_order_relaxed);
+    sink.skipped.store(0, std::memory_order_relaxed);
 
+    ReportInfo("[Dispatcher] Registered %s sink '%s'",
+            (lossy == true) ? "lossy" : "lossless",
+            name.c_str());
+
+    return this->sinks.count++;
+}
+
+/**
+ * @brief   Tell producers that consumer is going to sleep on the event descriptor.
+ *
+ * Must be called only by the dispatcher thread, followed by awake() once it
+ * has returned from waiting.
+ *
+ * @return  Boolean false if there is an aviso waiting, so that consumer should not sleep.
+ */
+bool
+Dispatcher::Queue::prepareToSleep()
+{
+    this->refill();
+
+    if (this->waitingInRing() == true)
+        return false;
+
+    // Announce the sleep before the last check, so that a producer publishing
+    // in between either is seen by the check or sees the flag and wakes us up.
+    // The same holds for a sink passing an aviso which waits to be released.
+    //
+    this->ring.consumerSleeping.store(true, std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    this->releaseLanes();
+
+    if (this->waitingInRing() == true)
+    {
+        this->ring.consumerSleeping.store(false, std::memory_order_relaxed);
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Withdraw the announcement of sleep and consume a pending wake-up.
+ *
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Queue::awake()
+{
+    this->ring.consumerSleeping.store(false, std::memory_order_relaxed);
+
+    eventfd_t counter;
+
+    eventfd_read(this->ring.eventDescriptor, &counter);
+
+    this->releaseLanes();
+}
+
+/**
+ * @brief   Wait until there is an aviso in the queue or the time is over.
+ *
+ * Must be called only by the dispatcher thread.
+ */
 std::cv_status
 Dispatcher::Queue::wait(const std::chrono::milliseconds duration)
 {
-    std::unique_lock<std::mutex> queueLock { this->queue.lock, std::defer_lock };
+    if (this->prepareToSleep() == false)
+        return std::cv_status::no_timeout;
 
-    std::cv_status status;
+    struct pollfd pollDescriptor;
+    pollDescriptor.fd       = this->ring.eventDescriptor;
+    pollDescriptor.events   = POLLIN;
+    pollDescriptor.revents  = 0;
 
-    queueLock.lock();
+    poll(&pollDescriptor, 1, (int) duration.count());
+
+    this->awake();
+
+    return (this->waitingInRing() == true)
+            ? std::cv_status::no_timeout
+            : std::cv_status::timeout;
+}
+
+/**
+ * @brief   Check whether there is an aviso waiting to be transmitted.
+ *
+ * Must be called only by the dispatcher thread.
+ */
+bool
+Dispatcher::Queue::pendingAvisos()
+{
+    this->refill();
 
-    if (this->queue.avisos.empty() == true)
+    return this->waitingInRing();
+}
+
+/**
+ * @brief   Put an aviso to the end of the queue.
+ *
+ * The queue takes over the aviso. In coalescing mode the aviso may be merged
+ * into a waiting aviso of the same sensor. If its lane is full, has used up its
+ * share of memory or older avisos of the lane still wait on disk, the aviso is
+ * written to the spool only.
+ * May be called by any thread. Never blocks unless coalescing.
+ *
+ * @throw   QueueOverflow   If the aviso fits neither into its lane nor into the spool.
+ */
+void
+Dispatcher::Queue::enqueueAviso(Dispatcher::Aviso* aviso)
+{
+    if (this->coalescing.enabled == true)
     {
-        status = this->queue.condition.wait_for(queueLock, duration);
+        const std::string* coalescingToken = aviso->coalescingToken();
+
+        if (coalescingToken != NULL)
+        {
+            const CoalescingKey coalescingKey(&aviso->avisoType, coalescingToken);
+
+            // Lock is held until the aviso is in the table, so that consumer
+            // cannot look at the aviso before it is registered.
+            //
+            std::lock_guard<std::mutex> lock(this->coalescing.lock);
+
+            std::unordered_map<CoalescingKey, Dispatcher::Aviso*, CoalescingKeyHash>::iterator waiting =
+                    this->coalescing.waiting.find(coalescingKey);
+
+            if ((waiting != this->coalescing.waiting.end()) && (waiting->second != NULL))
+            {
+                this->supersedeAviso(waiting->second, aviso);
+            }
+            else if (this->appendAviso(aviso) == true)
+            {
+                this->coalescing.waiting[coalescingKey] = aviso;
+            }
+
+            return;
+        }
     }
-    else
+
+    this->appendAviso(aviso);
+}
+
+/**
+ * @brief   Check whether producers should hold back their avisos.
+ *
+ * May be called by any thread. Never blocks.
+ *
+ * @return  Boolean true from the moment the avisos in the lanes reach a high
+ *          watermark until they have fallen to both low watermarks.
+ */
+bool
+Dispatcher::Queue::congested()
+{
+    size_t waitingAvisos = 0;
+
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        const Lane& lane = this->ring.lanes[laneIndex];
+
+        waitingAvisos += lane.tail.load(std::memory_order_relaxed) -
+                lane.head.load(std::memory_order_relaxed);
+    }
+
+    const size_t residentBytes = this->ring.residentBytes.load(std::memory_order_relaxed);
+
+    if (this->pressure.congested.load(std::memory_order_relaxed) == false)
+    {
+        if ((waitingAvisos < this->pressure.highCount) &&
+            (residentBytes < this->pressure.highBytes))
+        {
+            return false;
+        }
+
+        if (this->pressure.congested.exchange(true, std::memory_order_relaxed) == false)
+        {
+            ReportNotice("[Dispatcher] Queue is congested: %zu avisos, %zu bytes",
+                    waitingAvisos,
+                    residentBytes);
+        }
+
+        return true;
+    }
+
+    if ((waitingAvisos > this->pressure.lowCount) ||
+        (residentBytes > this->pressure.lowBytes))
+    {
+        return true;
+    }
+
+    if (this->pressure.congested.exchange(false, std::memory_order_relaxed) == true)
     {
-        status = std::cv_status::no_timeout;
+        ReportNotice("[Dispatcher] Queue is no longer congested");
     }
 
-    queueLock.unlock();
+    return false;
+}
+
+/**
+ * @brief   Choose the lane of an aviso.
+ */
+Dispatcher::QueueLane
+Dispatcher::Queue::laneOf(Dispatcher::Aviso* aviso)
+{
+    Dispatcher::FabulaAviso* fabula = dynamic_cast<Dispatcher::FabulaAviso*>(aviso);
+
+    if (fabula == NULL)
+        return Dispatcher::LaneTelemetry;
+
+    if ((fabula->notificationFlag == true) ||
+        (fabula->severityLevel <= this->ring.criticalSeverityLevel))
+    {
+        return Dispatcher::LaneCritical;
+    }
 
-    return status;
+    return Dispatcher::LaneNormal;
 }
 
+/**
+ * @brief   Reserve memory for an aviso within the share of its lane.
+ *
+ * May be called by any thread.
+ *
+ * @return  Boolean false if the lane has used up its share of the memory ceiling.
+ */
 bool
-Dispatcher::Queue::pendingAvisos()
+Dispatcher::Queue::admitAviso(
+    const Dispatcher::QueueLane lane,
+    const size_t                footprint)
 {
-    std::unique_lock<std::mutex> queueLock { this->queue.lock, std::defer_lock };
+    const size_t limit = this->ring.memoryCeiling / 100 * this->ring.lanes[lane].memoryShare;
+
+    const size_t residentBytes =
+            this->ring.residentBytes.fetch_add(footprint, std::memory_order_relaxed) + footprint;
+
+    if (residentBytes > limit)
+    {
+        this->ring.residentBytes.fetch_sub(footprint, std::memory_order_relaxed);
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Put the aviso into its lane or into the spool, give it an id and encode it.
+ *
+ * The id is taken only once the aviso has a place, so that shed avisos leave no gaps
+ * in the ids Primus sees. If the aviso is written to the spool only, it is deleted from memory.
+ *
+ * @return  Boolean true if the aviso has been put into its lane.
+ *
+ * @throw   QueueOverflow   If the aviso fits neither into its lane nor into the spool.
+ */
+bool
+Dispatcher::Queue::appendAviso(Dispatcher::Aviso* aviso)
+{
+    const Dispatcher::QueueLane laneIndex = this->laneOf(aviso);
+
+    Lane& lane = this->ring.lanes[laneIndex];
+
+    // Aviso is admitted with the memory it takes before being encoded,
+    // the encoded fields are charged once they are known.
+    //
+    const size_t plainFootprint = aviso->footprint();
+
+    const bool admitted = this->admitAviso(laneIndex, plainFootprint);
+
+    uint64_t position;
+
+    bool resident;
+
+    if (this->spool == NULL)
+    {
+        if (admitted == false)
+        {
+            ReportDebug("[Dispatcher] Shed aviso of lane %u",
+                    laneIndex);
+
+            throw Dispatcher::QueueOverflow();
+        }
+
+        if (this->claimSlot(lane, position) == false)
+        {
+            this->ring.residentBytes.fetch_sub(plainFootprint, std::memory_order_relaxed);
+
+            throw Dispatcher::QueueOverflow();
+        }
+
+        resident = true;
+    }
+    else
+    {
+        // As long as there are avisos of the lane on disk, newer ones follow them there,
+        // so that avisos keep their order. Critical avisos never wait behind them.
+        //
+        resident = (admitted == true) &&
+                ((laneIndex == Dispatcher::LaneCritical) || (this->spool->spilled(laneIndex) == 0)) &&
+                (this->claimSlot(lane, position) == true);
+
+        if ((resident == false) && (admitted == true))
+            this->ring.residentBytes.fetch_sub(plainFootprint, std::memory_order_relaxed);
+    }
+
+    aviso->avisoId = this->ring.lastAvisoId.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    // Encode here on the producer thread, dispatcher thread only sends.
+    //
+    aviso->encode();
+
+    if (resident == false)
+    {
+        // Id is lost only if the spool has run out of room as well.
+        //
+        if (this->spool->append(aviso, Dispatcher::SpoolRecordSpilled, laneIndex) == false)
+            throw Dispatcher::QueueOverflow();
+
+        ReportDebug("[Dispatcher] Spilled aviso #%u to spool",
+                aviso->avisoId);
+
+        delete aviso;
+
+        this->wakeConsumer();
+
+        return false;
+    }
+
+    const size_t footprint = aviso->footprint();
+
+    this->ring.residentBytes.fetch_add(footprint - plainFootprint, std::memory_order_relaxed);
+
+    if ((this->spool != NULL) &&
+        (this->spool->append(aviso, Dispatcher::SpoolRecordResident, laneIndex) == false))
+    {
+        ReportWarning("[Dispatcher] Aviso #%u is kept in memory only",
+                aviso->avisoId);
+    }
 
-    queueLock.lock();
+    this->publishSlot(lane, position, aviso, footprint);
 
-    bool answer = (this->queue.avisos.empty() == false);
+    ReportDebug("[Dispatcher] Enqueued aviso #%u in lane %u",
+            aviso->avisoId,
+            laneIndex);
 
-    queueLock.unlock();
+    this->wakeConsumer();
+    this->wakeSinks();
 
-    return answer;
+    return true;
 }
 
+/**
+ * @brief   Let a waiting aviso take over the value of a newer one and delete the newer one.
+ *
+ * Caller must hold the coalescing lock.
+ */
 void
-Dispatcher::Queue::enqueueAviso(Dispatcher::Aviso* aviso)
+Dispatcher::Queue::supersedeAviso(
+    Dispatcher::Aviso*  waitingAviso,
+    Dispatcher::Aviso*  newerAviso)
 {
-    std::unique_lock<std::mutex> queueLock { this->queue.lock, std::defer_lock };
+    waitingAviso->supersede(*newerAviso);
+    waitingAviso->encode();
 
-    queueLock.lock();
+    delete newerAviso;
 
+    // Record the new value in the spool. The record of the previous value
+    // is acknowledged by consumer, which owns the bookkeeping of segments.
+    //
+    if (this->spool != NULL)
     {
-        this->lastAvisoId++;
+        Dispatcher::SpoolSegment* segment = waitingAviso->spoolRecord.segment;
+        const uint32_t offset = waitingAviso->spoolRecord.offset;
 
-        aviso->avisoId = this->lastAvisoId;
+        const Dispatcher::QueueLane laneIndex = this->laneOf(waitingAviso);
+
+        if (this->spool->append(waitingAviso, Dispatcher::SpoolRecordResident, laneIndex) == false)
+        {
+            ReportWarning("[Dispatcher] Newer value of aviso #%u is kept in memory only",
+                    waitingAviso->avisoId);
+        }
+        else if (segment != NULL)
+        {
+            this->coalescing.superseded.push_back(std::make_pair(segment, offset));
+        }
     }
 
-    this->queue.avisos.push(aviso);
+    ReportDebug("[Dispatcher] Aviso #%u superseded by a newer value",
+            waitingAviso->avisoId);
+}
+
+/**
+ * @brief   Remove aviso from the coalescing table before consumer or a sink uses it.
+ *
+ * May be called by the dispatcher thread and by the threads of sinks.
+ */
+void
+Dispatcher::Queue::detachAviso(Dispatcher::Aviso* aviso)
+{
+    const std::string* coalescingToken = aviso->coalescingToken();
+
+    if (coalescingToken == NULL)
+        return;
+
+    const CoalescingKey coalescingKey(&aviso->avisoType, coalescingToken);
 
-    ReportInfo("[Dispatcher] Enqueued aviso #%u",
-            aviso->avisoId);
+    std::lock_guard<std::mutex> lock(this->coalescing.lock);
 
-    this->queue.condition.notify_one();
+    std::unordered_map<CoalescingKey, Dispatcher::Aviso*, CoalescingKeyHash>::iterator waiting =
+            this->coalescing.waiting.find(coalescingKey);
 
-    queueLock.unlock();
+    if ((waiting != this->coalescing.waiting.end()) && (waiting->second == aviso))
+        waiting->second = NULL;
 }
 
+/**
+ * @brief   Acknowledge spool records of values taken over by waiting avisos.
+ *
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Queue::acknowledgeSuperseded()
+{
+    std::lock_guard<std::mutex> lock(this->coalescing.lock);
+
+    // Records are acknowledged under the lock, so that the list keeps its capacity.
+    //
+    for (std::vector<std::pair<Dispatcher::SpoolSegment*, uint32_t>>::iterator record =
+                this->coalescing.superseded.begin();
+         record != this->coalescing.superseded.end();
+         record++)
+    {
+        this->spool->acknowledge(record->first, record->second);
+    }
+
+    this->coalescing.superseded.clear();
+}
+
+/**
+ * @brief   Find the ring position of an aviso which has been transmitted.
+ *
+ * Aviso ids do not follow ring positions, as avisos replayed from the spool
+ * keep their original ids and lanes are served interleaved. The window in flight
+ * is small, so search it.
+ *
+ * @return  Boolean false if the aviso is not in the queue.
+ */
+bool
+Dispatcher::Queue::findInFlight(
+    const unsigned int  avisoId,
+    unsigned int&       laneIndex,
+    uint64_t&           position)
+{
+    for (laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        Lane& lane = this->ring.lanes[laneIndex];
+
+        const uint64_t tail = lane.tail.load(std::memory_order_acquire);
+
+        for (position = lane.head.load(std::memory_order_relaxed);
+             position < tail;
+             position++)
+        {
+            Dispatcher::Aviso* aviso = this->peekAviso(lane, position);
+
+            if (aviso == NULL)
+                break;
+
+            if (aviso->avisoId == avisoId)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Mark aviso as acknowledged and release all leading acknowledged slots of its lane.
+ *
+ * Avisos may be acknowledged in any order. Must be called only by the dispatcher thread.
+ */
 void
 Dispatcher::Queue::dequeueAviso(const unsigned int avisoId)
 {
-    std::unique_lock<std::mutex> queueLock { this->queue.lock };
+    unsigned int laneIndex;
+    uint64_t position;
+
+    if (this->findInFlight(avisoId, laneIndex, position) == false)
+    {
+        ReportWarning("[Dispatcher] Acknowledged aviso #%u which is not in flight",
+                avisoId);
+
+        return;
+    }
 
-    Dispatcher::Aviso* aviso = this->queue.avisos.front();
+    Lane* lane = &this->ring.lanes[laneIndex];
 
-    if (aviso->avisoId != avisoId)
+    Slot* slot = &lane->slots[position & this->ring.mask];
+
+    if (slot->acknowledged == true)
     {
-        ReportWarning("[Dispatcher] Unexpected aviso in front of the queue: " \
-                "expected #%u, found #%u",
-                avisoId,
-                aviso->avisoId);
+        ReportWarning("[Dispatcher] Aviso #%u acknowledged more than once",
+                avisoId);
+
+        return;
     }
 
-    this->queue.avisos.pop();
+    slot->acknowledged = true;
+
+    if (this->spool != NULL)
+        this->spool->acknowledge(slot->aviso);
+
+    this->releaseLane(laneIndex);
 }
 
-Dispatcher::Aviso*
-Dispatcher::Queue::fetchFirstAviso()
+/**
+ * @brief   Have an aviso which Primus has refused transmitted again.
+ *
+ * Only the aviso itself is transmitted again, ahead of the avisos at the cursor
+ * of its lane. Avisos in flight behind it stay as they are.
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Queue::retransmitAviso(const unsigned int avisoId)
 {
-    std::unique_lock<std::mutex> queueLock { this->queue.lock, std::defer_lock };
+    unsigned int laneIndex;
+    uint64_t position;
 
-    queueLock.lock();
+    if (this->findInFlight(avisoId, laneIndex, position) == false)
+    {
+        ReportWarning("[Dispatcher] Cannot retransmit aviso #%u which is not in flight",
+                avisoId);
+
+        return;
+    }
+
+    Lane& lane = this->ring.lanes[laneIndex];
+
+    // Aviso at or beyond the cursor is going to be transmitted anyway.
+    //
+    if (position >= lane.cursor)
+        return;
+
+    if (std::find(lane.retransmissions.begin(), lane.retransmissions.end(), position) !=
+            lane.retransmissions.end())
+        return;
+
+    lane.retransmissions.push_back(position);
+}
+
+/**
+ * @brief   Release all leading slots of a lane which every reader is done with.
+ *
+ * A slot is released once Primus has acknowledged its aviso, every lossless sink
+ * has passed it and no lossy sink is reading it.
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Queue::releaseLane(const unsigned int laneIndex)
+{
+    Lane& lane = this->ring.lanes[laneIndex];
 
-    if (this->queue.avisos.empty() == true)
+    uint64_t head = lane.head.load(std::memory_order_relaxed);
+
+    for (;;)
     {
-        queueLock.unlock();
+        Slot* slot = &lane.slots[head & this->ring.mask];
+
+        if ((head == lane.cursor) || (slot->acknowledged == false))
+            break;
+
+        if (this->sinks.count != 0)
+        {
+            if (this->sinksPassed(laneIndex, head) == false)
+                break;
 
-        throw Dispatcher::NothingInTheQueue();
+            // Announce the release before looking for readers, so that a lossy sink
+            // either is seen reading or sees the slot being released and skips it.
+            //
+            slot->retired.store(head + 1, std::memory_order_seq_cst);
+
+            if (slot->readers.load(std::memory_order_seq_cst) != 0)
+                break;
+        }
+
+        this->ring.residentBytes.fetch_sub(slot->footprint, std::memory_order_relaxed);
+
+        // Released aviso goes back to the pool.
+        //
+        delete slot->aviso;
+
+        slot->aviso = NULL;
+        slot->acknowledged = false;
+        slot->sequence.store(head + this->ring.mask + 1, std::memory_order_release);
+
+        head++;
+
+        lane.head.store(head, std::memory_order_release);
     }
+}
 
-    Dispatcher::Aviso* aviso = this->queue.avisos.front();
+/**
+ * @brief   Release slots held back by sinks which have moved on meanwhile.
+ *
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Queue::releaseLanes()
+{
+    if (this->sinks.count == 0)
+        return;
 
-    if (this->queue.avisos.empty() == true)
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
     {
-        ReportInfo("[Dispatcher] Fetched aviso #%u from the queue",
-                aviso->avisoId);
+        this->releaseLane(laneIndex);
+    }
+}
+
+/**
+ * @brief   Check whether every lossless sink has read the aviso at a position.
+ */
+bool
+Dispatcher::Queue::sinksPassed(
+    const unsigned int  laneIndex,
+    const uint64_t      position)
+{
+    for (unsigned int sinkId = 0;
+         sinkId < this->sinks.count;
+         sinkId++)
+    {
+        Sink& sink = this->sinks.list[sinkId];
+
+        if (sink.lossy == true)
+            continue;
+
+        if (sink.positions[laneIndex].load(std::memory_order_acquire) <= position)
+            return false;
     }
+
+    return true;
+}
+
+/**
+ * @brief   Get the next aviso to be transmitted without moving the cursor.
+ *
+ * Lanes are served from the highest to the lowest, each up to its weight per round.
+ * A new round begins once no lane with credit left has anything to transmit.
+ * Must be called only by the dispatcher thread.
+ *
+ * @throw   NothingInTheQueue   If there is nothing to transmit.
+ */
+Dispatcher::Aviso*
+Dispatcher::Queue::peekNextAviso()
+{
+    this->refill();
+
+    for (unsigned int round = 0; round < 2; round++)
+    {
+        for (unsigned int laneIndex = 0;
+             laneIndex < Dispatcher::QueueLanes;
+             laneIndex++)
+        {
+            Lane& lane = this->ring.lanes[laneIndex];
+
+            if (lane.credit == 0)
+                continue;
+
+            Dispatcher::Aviso* aviso = this->peekLane(lane);
+
+            if (aviso != NULL)
+            {
+                this->ring.selectedLane = laneIndex;
+
+                if (this->coalescing.enabled == true)
+                {
+                    this->detachAviso(aviso);
+                    this->acknowledgeSuperseded();
+                }
+
+                return aviso;
+            }
+        }
+
+        for (unsigned int laneIndex = 0;
+             laneIndex < Dispatcher::QueueLanes;
+             laneIndex++)
+        {
+            this->ring.lanes[laneIndex].credit = this->ring.lanes[laneIndex].weight;
+        }
+    }
+
+    throw Dispatcher::NothingInTheQueue();
+}
+
+/**
+ * @brief   Get the next aviso to be transmitted and move the cursor past it.
+ *
+ * The aviso stays in the queue until it is acknowledged. Must be called only
+ * by the dispatcher thread.
+ *
+ * @throw   NothingInTheQueue   If there is nothing to transmit.
+ */
+Dispatcher::Aviso*
+Dispatcher::Queue::fetchNextAviso()
+{
+    Dispatcher::Aviso* aviso = this->peekNextAviso();
+
+    Lane& lane = this->ring.lanes[this->ring.selectedLane];
+
+    // Aviso peeked is the first one to be transmitted again, if there is any.
+    //
+    if (lane.retransmissions.empty() == false)
+        lane.retransmissions.erase(lane.retransmissions.begin());
     else
+        lane.cursor++;
+
+    lane.credit--;
+
+    unsigned int inFlight = 0;
+    unsigned int left = 0;
+
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
     {
-        ReportInfo("[Dispatcher] Fetched aviso #%u from the queue, %u left",
-                aviso->avisoId,
-                (unsigned int) this->queue.avisos.size());
+        Lane& lane = this->ring.lanes[laneIndex];
+
+        inFlight += (unsigned int) (lane.cursor - lane.head.load(std::memory_order_relaxed));
+        left += (unsigned int) (lane.tail.load(std::memory_order_relaxed) - lane.cursor);
     }
 
-    queueLock.unlock();
+    if (left == 0)
+    {
+        ReportInfo("[Dispatcher] Fetched aviso #%u from lane %u, %u in flight",
+                aviso->avisoId,
+                this->ring.selectedLane,
+                inFlight);
+    }
+    else
+    {
+        ReportInfo("[Dispatcher] Fetched aviso #%u from lane %u, %u in flight, %u left",
+                aviso->avisoId,
+                this->ring.selectedLane,
+                inFlight,
+                left);
+    }
 
     return aviso;
 }
+
+/**
+ * @brief   Collect the ids of avisos transmitted and not yet acknowledged by Primus.
+ *
+ * Must be called only by the dispatcher thread, before rewind().
+ */
+void
+Dispatcher::Queue::collectInFlight(std::vector<unsigned int>& avisoIds)
+{
+    avisoIds.clear();
+
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        Lane& lane = this->ring.lanes[laneIndex];
+
+        for (uint64_t position = lane.head.load(std::memory_order_relaxed);
+             position < lane.cursor;
+             position++)
+        {
+            Slot* slot = &lane.slots[position & this->ring.mask];
+
+            if (slot->acknowledged == false)
+                avisoIds.push_back(slot->aviso->avisoId);
+        }
+    }
+}
+
+/**
+ * @brief   Move the cursors back to the first unacknowledged aviso of each lane.
+ *
+ * Called when a new session with Primus begins, so that all avisos which were
+ * in flight when the previous session broke are transmitted again.
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Queue::rewind()
+{
+    unsigned int inFlight = 0;
+
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        Lane& lane = this->ring.lanes[laneIndex];
+
+        const uint64_t head = lane.head.load(std::memory_order_relaxed);
+
+        inFlight += (unsigned int) (lane.cursor - head);
+
+        lane.cursor = head;
+        lane.credit = lane.weight;
+        lane.retransmissions.clear();
+    }
+
+    if (inFlight != 0)
+    {
+        ReportNotice("[Dispatcher] Retransmit %u unacknowledged avisos",
+                inFlight);
+    }
+}
+
+/**
+ * @brief   Wait until there is an aviso for a sink or the time is over.
+ *
+ * Must be called only by the thread of the sink.
+ */
+std::cv_status
+Dispatcher::Queue::waitSink(
+    const unsigned int                  sinkId,
+    const std::chrono::milliseconds     duration)
+{
+    Sink& sink = this->sinks.list[sinkId];
+
+    if (this->waitingForSink(sink) == true)
+        return std::cv_status::no_timeout;
+
+    sink.sleeping.store(true, std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (this->waitingForSink(sink) == false)
+    {
+        struct pollfd pollDescriptor;
+        pollDescriptor.fd       = sink.eventDescriptor;
+        pollDescriptor.events   = POLLIN;
+        pollDescriptor.revents  = 0;
+
+        poll(&pollDescriptor, 1, (int) duration.count());
+    }
+
+    sink.sleeping.store(false, std::memory_order_relaxed);
+
+    eventfd_t counter;
+
+    eventfd_read(sink.eventDescriptor, &counter);
+
+    return (this->waitingForSink(sink) == true)
+            ? std::cv_status::no_timeout
+            : std::cv_status::timeout;
+}
+
+/**
+ * @brief   Get the next aviso for a sink without moving its cursor.
+ *
+ * Lanes are read from the highest to the lowest. The aviso may be used
+ * until releaseAviso() is called and must not be kept beyond that.
+ * Must be called only by the thread of the sink.
+ *
+ * @return  NULL if there is nothing to read.
+ */
+Dispatcher::Aviso*
+Dispatcher::Queue::readAviso(const unsigned int sinkId)
+{
+    Sink& sink = this->sinks.list[sinkId];
+
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        Dispatcher::Aviso* aviso = this->readLane(sink, laneIndex);
+
+        if (aviso != NULL)
+        {
+            sink.selectedLane = laneIndex;
+
+            if (this->coalescing.enabled == true)
+                this->detachAviso(aviso);
+
+            return aviso;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief   Move the cursor of a sink past the aviso returned by the last read.
+ *
+ * Must be called only by the thread of the sink.
+ */
+void
+Dispatcher::Queue::releaseAviso(const unsigned int sinkId)
+{
+    Sink& sink = this->sinks.list[sinkId];
+
+    Lane& lane = this->ring.lanes[sink.selectedLane];
+
+    const uint64_t position = sink.positions[sink.selectedLane].load(std::memory_order_relaxed);
+
+    if (sink.lossy == true)
+    {
+        Slot* slot = &lane.slots[position & this->ring.mask];
+
+        slot->readers.fetch_sub(1, std::memory_order_seq_cst);
+
+        sink.positions[sink.selectedLane].store(position + 1, std::memory_order_relaxed);
+
+        // Consumer may have found the sink reading the slot it wanted to release.
+        //
+        if (slot->retired.load(std::memory_order_seq_cst) == position + 1)
+            this->wakeConsumer();
+    }
+    else
+    {
+        sink.positions[sink.selectedLane].store(position + 1, std::memory_order_release);
+
+        // Consumer may wait for this sink to release the slot.
+        //
+        if (lane.head.load(std::memory_order_acquire) == position)
+            this->wakeConsumer();
+    }
+}
+
+/**
+ * @brief   Claim the next free slot of a lane.
+ *
+ * May be called by any thread.
+ *
+ * @return  False if all slots are occupied.
+ */
+bool
+Dispatcher::Queue::claimSlot(Lane& lane, uint64_t& position)
+{
+    position = lane.tail.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        Slot* slot = &lane.slots[position & this->ring.mask];
+
+        const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const int64_t difference = (int64_t) sequence - (int64_t) position;
+
+        if (difference == 0)
+        {
+            if (lane.tail.compare_exchange_weak(
+                    position,
+                    position + 1,
+                    std::memory_order_relaxed) == true)
+            {
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = lane.tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief   Make aviso in a claimed slot visible to consumer, with the memory it has been admitted with.
+ */
+void
+Dispatcher::Queue::publishSlot(
+    Lane&                       lane,
+    const uint64_t              position,
+    Dispatcher::Aviso*          aviso,
+    const size_t                footprint)
+{
+    Slot* slot = &lane.slots[position & this->ring.mask];
+
+    slot->aviso = aviso;
+    slot->footprint = footprint;
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+/**
+ * @brief   Load avisos kept only on disk into free slots of their lanes.
+ *
+ * Each lane is refilled from a spool cursor of its own, so that a full lane
+ * does not hold back avisos of the others. An aviso is restored only once its
+ * lane has room for it, as this runs whenever consumer looks for avisos.
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Queue::refill()
+{
+    if (this->spool == NULL)
+        return;
+
+    for (unsigned int spoolLane = 0;
+         spoolLane < Dispatcher::QueueLanes;
+         spoolLane++)
+    {
+        while (this->spool->spilled(spoolLane) != 0)
+        {
+            if (this->laneHasRoom((Dispatcher::QueueLane) spoolLane) == false)
+                break;
+
+            Dispatcher::Aviso* aviso = this->spool->peekSpilled(spoolLane);
+            if (aviso == NULL)
+                break;
+
+            // Records of older spools are all in the first lane of the spool.
+            //
+            const Dispatcher::QueueLane laneIndex = this->laneOf(aviso);
+
+            Lane& lane = this->ring.lanes[laneIndex];
+
+            const size_t footprint = aviso->footprint();
+
+            if (this->admitAviso(laneIndex, footprint) == false)
+            {
+                delete aviso;
+                break;
+            }
+
+            uint64_t position;
+
+            if (this->claimSlot(lane, position) == false)
+            {
+                this->ring.residentBytes.fetch_sub(footprint, std::memory_order_relaxed);
+
+                delete aviso;
+                break;
+            }
+
+            this->spool->resident(aviso);
+
+            this->publishSlot(lane, position, aviso, footprint);
+
+            this->wakeSinks();
+        }
+    }
+}
+
+/**
+ * @brief   Check whether a lane has a free slot and memory left for an aviso of the smallest size.
+ *
+ * Producers may take the room meanwhile, so that the aviso may still not fit.
+ */
+bool
+Dispatcher::Queue::laneHasRoom(const Dispatcher::QueueLane laneIndex)
+{
+    Lane& lane = this->ring.lanes[laneIndex];
+
+    const uint64_t tail = lane.tail.load(std::memory_order_relaxed);
+    const uint64_t head = lane.head.load(std::memory_order_relaxed);
+
+    if (tail - head >= Dispatcher::QueueCapacity)
+        return false;
+
+    const size_t limit = this->ring.memoryCeiling / 100 * lane.memoryShare;
+
+    return (this->ring.residentBytes.load(std::memory_order_relaxed) +
+            Dispatcher::AvisoBlockSize <= limit);
+}
+
+/**
+ * @brief   Get the aviso at the cursor of a sink in a lane.
+ *
+ * A lossy sink marks the slot as being read, so that consumer does not release it
+ * meanwhile. If the sink fell behind, it skips avisos already released.
+ *
+ * @return  NULL if there is nothing to read in the lane.
+ */
+Dispatcher::Aviso*
+Dispatcher::Queue::readLane(
+    Sink&               sink,
+    const unsigned int  laneIndex)
+{
+    Lane& lane = this->ring.lanes[laneIndex];
+
+    uint64_t position = sink.positions[laneIndex].load(std::memory_order_relaxed);
+
+    if (sink.lossy == false)
+        return this->peekAviso(lane, position);
+
+    for (;;)
+    {
+        const uint64_t head = lane.head.load(std::memory_order_acquire);
+
+        if (position < head)
+        {
+            sink.skipped.fetch_add(head - position, std::memory_order_relaxed);
+
+            ReportDebug("[Dispatcher] Sink '%s' skipped %u avisos of lane %u",
+                    sink.name.c_str(),
+                    (unsigned int) (head - position),
+                    laneIndex);
+
+            position = head;
+
+            sink.positions[laneIndex].store(position, std::memory_order_relaxed);
+        }
+
+        Slot* slot = &lane.slots[position & this->ring.mask];
+
+        // Announce the read before looking at the slot, so that consumer either
+        // sees the reader or the sink sees the slot being released.
+        //
+        slot->readers.fetch_add(1, std::memory_order_seq_cst);
+
+        if (slot->retired.load(std::memory_order_seq_cst) != position + 1)
+        {
+            Dispatcher::Aviso* aviso = this->peekAviso(lane, position);
+
+            if (aviso != NULL)
+                return aviso;
+
+            slot->readers.fetch_sub(1, std::memory_order_seq_cst);
+
+            // Either nothing has been published yet or the slot
+            // has been released and taken again meanwhile.
+            //
+            if (lane.head.load(std::memory_order_acquire) <= position)
+                return NULL;
+        }
+        else
+        {
+            slot->readers.fetch_sub(1, std::memory_order_seq_cst);
+
+            this->wakeConsumer();
+
+            sink.skipped.fetch_add(1, std::memory_order_relaxed);
+
+            position++;
+
+            sink.positions[laneIndex].store(position, std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief   Check whether any lane has an aviso for a sink.
+ */
+bool
+Dispatcher::Queue::waitingForSink(Sink& sink)
+{
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        Lane& lane = this->ring.lanes[laneIndex];
+
+        uint64_t position = sink.positions[laneIndex].load(std::memory_order_relaxed);
+
+        if (sink.lossy == true)
+            position = std::max(position, lane.head.load(std::memory_order_acquire));
+
+        if (this->peekAviso(lane, position) != NULL)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Check whether any lane has an aviso at its cursor.
+ */
+bool
+Dispatcher::Queue::waitingInRing()
+{
+    for (unsigned int laneIndex = 0;
+         laneIndex < Dispatcher::QueueLanes;
+         laneIndex++)
+    {
+        Lane& lane = this->ring.lanes[laneIndex];
+
+        if (lane.retransmissions.empty() == false)
+            return true;
+
+        if (this->peekAviso(lane, lane.cursor) != NULL)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Get the next aviso of a lane to be transmitted.
+ *
+ * Avisos to be transmitted again come first, unless they have been acknowledged meanwhile.
+ * Skips avisos acknowledged out of order before a rewind.
+ *
+ * @return  NULL if there is nothing to transmit in the lane.
+ */
+Dispatcher::Aviso*
+Dispatcher::Queue::peekLane(Lane& lane)
+{
+    while (lane.retransmissions.empty() == false)
+    {
+        const uint64_t position = lane.retransmissions.front();
+
+        // Slot released meanwhile may hold another aviso by now.
+        //
+        if ((position >= lane.head.load(std::memory_order_relaxed)) &&
+            (lane.slots[position & this->ring.mask].acknowledged == false))
+            return lane.slots[position & this->ring.mask].aviso;
+
+        lane.retransmissions.erase(lane.retransmissions.begin());
+    }
+
+    for (;;)
+    {
+        Dispatcher::Aviso* aviso = this->peekAviso(lane, lane.cursor);
+
+        if (aviso == NULL)
+            return NULL;
+
+        if (lane.slots[lane.cursor & this->ring.mask].acknowledged == false)
+            return aviso;
+
+        lane.cursor++;
+    }
+}
+
+Dispatcher::Aviso*
+Dispatcher::Queue::peekAviso(Lane& lane, const uint64_t position)
+{
+    Slot* slot = &lane.slots[position & this->ring.mask];
+
+    const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+    return (sequence == position + 1) ? slot->aviso : NULL;
+}
+
+void
+Dispatcher::Queue::wakeConsumer()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (this->ring.consumerSleeping.load(std::memory_order_relaxed) == false)
+        return;
+
+    if (this->ring.consumerSleeping.exchange(false, std::memory_order_acq_rel) == true)
+    {
+        eventfd_write(this->ring.eventDescriptor, 1);
+    }
+}
+
+void
+Dispatcher::Queue::wakeSinks()
+{
+    if (this->sinks.count == 0)
+        return;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    for (unsigned int sinkId = 0;
+         sinkId < this->sinks.count;
+         sinkId++)
+    {
+        Sink& sink = this->sinks.list[sinkId];
+
+        if (sink.sleeping.load(std::memory_order_relaxed) == false)
+            continue;
+
+        if (sink.sleeping.exchange(false, std::memory_order_acq_rel) == true)
+        {
+            eventfd_write(sink.eventDescriptor, 1);
+        }
+    }
+}
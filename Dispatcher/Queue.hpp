@@ -2,31 +2,264 @@
 
 // System definition files.
 //
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <mutex>
-#include <queue>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // Local definition files.
 //
 #include "Servus/Dispatcher/Aviso.hpp"
+#include "Servus/Dispatcher/Spool.hpp"
 
 namespace Dispatcher
 {
+    /**
+     * Number of slots in the ring of each lane. Must be a power of two.
+     */
+    static const unsigned int QueueCapacity = 4 * 1024;
+
+    /**
+     * Used to keep fields written by producers and by consumer on separate cache lines.
+     */
+    static const unsigned int CacheLineSize = 64;
+
+    /**
+     * Priority lanes, from highest to lowest.
+     */
+    enum QueueLane
+    {
+        LaneCritical        = 0,    /**< Fabulas with notification or high severity. */
+        LaneNormal          = 1,    /**< All other fabulas. */
+        LaneTelemetry       = 2     /**< Sensor avisos. */
+    };
+
+    static const unsigned int QueueLanes = 3;
+
+    /**
+     * Maximal number of sinks reading the queue besides Primus.
+     */
+    static const unsigned int QueueSinks = 4;
+
+    /**
+     * Bounded lock-free multi-producer single-consumer queue of avisos.
+     *
+     * Any thread may enqueue avisos. Only the dispatcher thread may wait for,
+     * fetch and dequeue them. Avisos are fetched in order but may be acknowledged
+     * in any order; a slot is released once all avisos before it are acknowledged.
+     * Producers never block and never make a system call
+     * unless the dispatcher thread is sleeping in wait() or coalescing is enabled.
+     *
+     * Avisos are sorted into priority lanes, each of them a ring of its own.
+     * Lanes are served in weighted round robin, so that a critical aviso waits
+     * at most for the weights of the lower lanes. Each lane may fill only its share
+     * of the memory ceiling, so that the lowest lanes are shed first.
+     *
+     * If a spool is open, every aviso is also written to it. Avisos which do not
+     * fit into the ring are kept on disk only and loaded by the dispatcher thread
+     * as soon as there is room again.
+     *
+     * In coalescing mode a sensor aviso which is still waiting in the ring takes
+     * over the value of a newer aviso of the same sensor instead of the newer one
+     * being appended. Once the dispatcher thread or a sink has looked at an aviso,
+     * it is not changed any more. The table of waiting sensor avisos is shared
+     * under a mutex, which producers of sensor avisos, the dispatcher thread
+     * and sinks take, so coalescing is off unless configured.
+     *
+     * Besides Primus, which is served by the dispatcher thread, further sinks may
+     * read the same avisos, each with a cursor of its own and from a thread of its own.
+     * A slot is released only when Primus has acknowledged it and every sink which
+     * is not lossy has passed it. A lossy sink never holds back the queue;
+     * it skips avisos released before it could read them.
+     *
+     * Producers may ask whether the queue is congested, that is whether the avisos
+     * in the lanes have reached the high watermark of their number or of their memory.
+     * The queue stays congested until both have fallen to the low watermarks again.
+     */
     class Queue
     {
     private:
+        struct Slot
+        {
+            std::atomic<uint64_t>   sequence;
+            Dispatcher::Aviso*      aviso;
+
+            /**
+             * Memory charged when the aviso was admitted, given back on release
+             * as the footprint of the aviso changes when it is superseded.
+             */
+            size_t                  footprint;
+
+            /**
+             * Set by consumer once Primus has acknowledged the aviso.
+             */
+            bool                    acknowledged;
+
+            /**
+             * Number of lossy sinks reading the aviso and position plus one
+             * of the last aviso consumer began to release from this slot.
+             */
+            std::atomic<unsigned int> readers;
+            std::atomic<uint64_t>   retired;
+        };
+
+        struct Lane
+        {
+            Slot*                   slots;
+
+            /**
+             * Percentage of the memory ceiling up to which the lane accepts avisos.
+             */
+            unsigned int            memoryShare;
+
+            /**
+             * Avisos fetched from this lane per round and avisos left in the current round.
+             */
+            unsigned int            weight;
+            unsigned int            credit;
+
+            /**
+             * Next position to be claimed by producers.
+             */
+            char                    tailPadding[Dispatcher::CacheLineSize];
+            std::atomic<uint64_t>   tail;
+
+            /**
+             * Position of the first not yet released aviso in the lane
+             * and position of the next aviso to be transmitted, both written by consumer only.
+             */
+            char                    headPadding[Dispatcher::CacheLineSize];
+            std::atomic<uint64_t>   head;
+            uint64_t                cursor;
+
+            /**
+             * Positions behind the cursor of avisos Primus has refused, to be transmitted
+             * again before the aviso at the cursor, owned by consumer.
+             */
+            std::vector<uint64_t>   retransmissions;
+        };
+
+        struct Sink
+        {
+            std::string             name;
+            bool                    lossy;
+            int                     eventDescriptor;
+
+            /**
+             * Lane of the aviso returned by the last read, owned by the sink.
+             */
+            unsigned int            selectedLane;
+
+            /**
+             * Position of the next aviso to be read in each lane, written by the sink only.
+             */
+            char                    positionPadding[Dispatcher::CacheLineSize];
+            std::atomic<uint64_t>   positions[Dispatcher::QueueLanes];
+            std::atomic<bool>       sleeping;
+
+            /**
+             * Avisos a lossy sink has missed as they were released before it could read them.
+             */
+            std::atomic<unsigned long> skipped;
+        };
+
         struct
         {
-            std::queue<Dispatcher::Aviso*>  avisos;
-            std::mutex                      lock;
-            std::condition_variable         condition;
+            Lane                    lanes[Dispatcher::QueueLanes];
+            uint64_t                mask;
+            int                     eventDescriptor;
+
+            unsigned short          criticalSeverityLevel;
+            size_t                  memoryCeiling;
+
+            /**
+             * Lane of the aviso returned by the last peek, owned by consumer.
+             */
+            unsigned int            selectedLane;
+
+            /**
+             * Last aviso id given away and memory taken by avisos in the lanes.
+             */
+            char                    idPadding[Dispatcher::CacheLineSize];
+            std::atomic<unsigned int> lastAvisoId;
+            std::atomic<size_t>     residentBytes;
+
+            /**
+             * Set by consumer before it goes to sleep on the event descriptor.
+             */
+            char                    sleepPadding[Dispatcher::CacheLineSize];
+            std::atomic<bool>       consumerSleeping;
         }
-        queue;
+        ring;
+
+        struct
+        {
+            size_t                  highCount;
+            size_t                  lowCount;
+            size_t                  highBytes;
+            size_t                  lowBytes;
 
-        unsigned int lastAvisoId;
+            /**
+             * Seconds producers are told to wait while the queue is congested.
+             */
+            unsigned int            retryAfter;
+
+            char                    congestedPadding[Dispatcher::CacheLineSize];
+            std::atomic<bool>       congested;
+        }
+        pressure;
+
+        struct
+        {
+            Sink                    list[Dispatcher::QueueSinks];
+            unsigned int            count;
+        }
+        sinks;
+
+        Dispatcher::Spool*          spool;
+
+        /**
+         * Aviso type and interned token, both compared by address.
+         */
+        typedef std::pair<const std::string*, const std::string*> CoalescingKey;
+
+        struct CoalescingKeyHash
+        {
+            size_t
+            operator()(const CoalescingKey& key) const
+            {
+                return std::hash<const void*>()(key.first) ^
+                        (std::hash<const void*>()(key.second) << 1);
+            }
+        };
+
+        struct
+        {
+            bool                    enabled;
+            std::mutex              lock;
+
+            /**
+             * Avisos waiting in the ring which may still be superseded, by coalescing key.
+             * Entries are kept with NULL once their aviso is taken, so that the table
+             * does not allocate after it has seen every sensor.
+             */
+            std::unordered_map<CoalescingKey, Dispatcher::Aviso*, CoalescingKeyHash> waiting;
+
+            /**
+             * Spool records of superseded values, to be acknowledged by consumer.
+             */
+            std::vector<std::pair<Dispatcher::SpoolSegment*, uint32_t>> superseded;
+        }
+        coalescing;
 
     public:
         static Dispatcher::Queue&
@@ -39,6 +272,49 @@ namespace Dispatcher
 
         ~Queue();
 
+        void
+        openSpool(
+            const std::string&  directoryPath,
+            const unsigned int  segmentSize,
+            const unsigned int  maximalSegments,
+            const unsigned int  syncInterval);
+
+        void
+        setCoalescing(const bool enabled);
+
+        void
+        setPriorities(
+            const unsigned short    criticalSeverityLevel,
+            const size_t            memoryCeiling);
+
+        void
+        setLaneWeight(
+            const Dispatcher::QueueLane lane,
+            const unsigned int          weight);
+
+        void
+        setWatermarks(
+            const size_t        highCount,
+            const size_t        lowCount,
+            const size_t        highBytes,
+            const size_t        lowBytes,
+            const unsigned int  retryAfter);
+
+        unsigned int
+        registerSink(
+            const std::string&  name,
+            const bool          lossy);
+
+        int
+        eventDescriptor() const
+        { return this->ring.eventDescriptor; }
+
+        bool
+        prepareToSleep();
+
+        void
+        awake();
+
         std::cv_status
         wait(const std::chrono::milliseconds);
 
@@ -48,11 +324,128 @@ namespace Dispatcher
         void
         enqueueAviso(Dispatcher::Aviso*);
 
+        bool
+        congested();
+
+        unsigned int
+        retryAfter() const
+        { return this->pressure.retryAfter; }
+
         void
         dequeueAviso(const unsigned int avisoId);
 
+        void
+        retransmitAviso(const unsigned int avisoId);
+
+        Dispatcher::Aviso*
+        peekNextAviso();
+
+        Dispatcher::Aviso*
+        fetchNextAviso();
+
+        void
+        collectInFlight(std::vector<unsigned int>& avisoIds);
+
+        void
+        rewind();
+
+        int
+        sinkDescriptor(const unsigned int sinkId) const
+        { return this->sinks.list[sinkId].eventDescriptor; }
+
+        std::cv_status
+        waitSink(
+            const unsigned int                  sinkId,
+            const std::chrono::milliseconds     duration);
+
+        Dispatcher::Aviso*
+        readAviso(const unsigned int sinkId);
+
+        void
+        releaseAviso(const unsigned int sinkId);
+
+        unsigned long
+        skippedAvisos(const unsigned int sinkId) const
+        { return this->sinks.list[sinkId].skipped.load(std::memory_order_relaxed); }
+
+    private:
+        Dispatcher::QueueLane
+        laneOf(Dispatcher::Aviso*);
+
+        bool
+        admitAviso(
+            const Dispatcher::QueueLane lane,
+            const size_t                footprint);
+
+        bool
+        laneHasRoom(const Dispatcher::QueueLane lane);
+
+        bool
+        appendAviso(Dispatcher::Aviso*);
+
+        void
+        supersedeAviso(
+            Dispatcher::Aviso*  waitingAviso,
+            Dispatcher::Aviso*  newerAviso);
+
+        void
+        detachAviso(Dispatcher::Aviso*);
+
+        void
+        acknowledgeSuperseded();
+
+        bool
+        findInFlight(
+            const unsigned int  avisoId,
+            unsigned int&       laneIndex,
+            uint64_t&           position);
+
+        void
+        releaseLane(const unsigned int laneIndex);
+
+        void
+        releaseLanes();
+
+        bool
+        sinksPassed(
+            const unsigned int  laneIndex,
+            const uint64_t      position);
+
+        Dispatcher::Aviso*
+        readLane(
+            Sink&               sink,
+            const unsigned int  laneIndex);
+
+        bool
+        waitingForSink(Sink&);
+
+        bool
+        claimSlot(Lane&, uint64_t& position);
+
+        void
+        publishSlot(
+            Lane&,
+            const uint64_t              position,
+            Dispatcher::Aviso*,
+            const size_t                footprint);
+
+        void
+        refill();
+
+        bool
+        waitingInRing();
+
+        Dispatcher::Aviso*
+        peekLane(Lane&);
+
         Dispatcher::Aviso*
-        fetchFirstAviso();
+        peekAviso(Lane&, const uint64_t position);
+
+        void
+        wakeConsumer();
+
+        void
+        wakeSinks();
     };
 
     class NothingInTheQueue : public std::runtime_error
@@ -62,4 +455,12 @@ namespace Dispatcher
         std::runtime_error("[Queue] Nothing in the queue")
         { }
     };
+
+    class QueueOverflow : public std::runtime_error
+    {
+    public:
+        QueueOverflow() throw() :
+        std::runtime_error("[Queue] Queue overflow")
+        { }
+    };
 };
@@ -0,0 +1,481 @@
+// System definition files.
+//
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <strings.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdbool>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Common definition files.
+//
+#include "RTSP/RTSP.hpp"
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/BufferPool.hpp"
+#include "Servus/Dispatcher/ReceiveRing.hpp"
+
+static const char   Terminator[]        = "\r\n\r\n";
+static const size_t TerminatorLength    = sizeof(Terminator) - 1;
+
+static bool
+SpanEquals(
+    const Dispatcher::DatagramView&     view,
+    const Dispatcher::DatagramSpan&     span,
+    const char* const                   text)
+{
+    const size_t textLength = strlen(text);
+
+    return (span.length == textLength) &&
+            (strncasecmp(view.at(span), text, textLength) == 0);
+}
+
+Dispatcher::ReceiveRing::ReceiveRing(const uint32_t maximalDatagramLength) :
+buffer(NULL),
+capacity(0),
+maximalDatagramLength(maximalDatagramLength)
+{
+    if (maximalDatagramLength > Dispatcher::BufferTierSizes[Dispatcher::BufferTiers - 1])
+        throw Dispatcher::BufferTooLarge();
+
+    this->reset();
+}
+
+Dispatcher::ReceiveRing::~ReceiveRing()
+{
+    if (this->capacity != 0)
+        Dispatcher::BufferPool::SharedInstance().giveBack(this->buffer, this->capacity);
+}
+
+/**
+ * @brief   Drop everything received, as a new connection begins.
+ */
+void
+Dispatcher::ReceiveRing::reset()
+{
+    this->begin = 0;
+    this->end = 0;
+
+    this->parser.scanned = 0;
+    this->parser.headerComplete = false;
+    this->parser.datagramLength = 0;
+
+    this->release();
+}
+
+/**
+ * @brief   Give the buffer back to the buffer pool, unless something is pending.
+ *
+ * Views taken before become invalid.
+ */
+void
+Dispatcher::ReceiveRing::release()
+{
+    if ((this->capacity == 0) || (this->begin != this->end))
+        return;
+
+    Dispatcher::BufferPool::SharedInstance().giveBack(this->buffer, this->capacity);
+
+    this->buffer = NULL;
+    this->capacity = 0;
+    this->begin = 0;
+    this->end = 0;
+}
+
+/**
+ * @brief   Receive whatever the socket has available without blocking.
+ *
+ * Views taken before become invalid.
+ *
+ * @return  Number of bytes received, zero if the socket has nothing available.
+ *
+ * @throw   ReceiveError    If the connection is closed or broken.
+ * @throw   BrokenDatagram  If a datagram does not fit into the ring.
+ */
+size_t
+Dispatcher::ReceiveRing::receive(const int socket)
+{
+    if (this->end - this->begin >= this->maximalDatagramLength)
+    {
+        throw Dispatcher::BrokenDatagram("Datagram too long");
+    }
+
+    if (this->capacity == 0)
+    {
+        this->buffer = Dispatcher::BufferPool::SharedInstance().borrow(
+                Dispatcher::BufferTierSizes[0],
+                this->capacity);
+    }
+    else if (this->begin == this->end)
+    {
+        this->begin = 0;
+        this->end = 0;
+    }
+    else if ((this->end == this->capacity) ||
+            ((this->parser.headerComplete == true) &&
+                    (this->begin + this->parser.datagramLength > this->capacity)))
+    {
+        this->makeRoom();
+    }
+
+    for (;;)
+    {
+        ssize_t receivedBytes = recv(socket,
+                this->buffer + this->end,
+                this->capacity - this->end,
+                MSG_DONTWAIT);
+
+        if (receivedBytes > 0)
+        {
+            this->end += receivedBytes;
+
+            return receivedBytes;
+        }
+
+        if (receivedBytes == 0)
+            throw Dispatcher::ReceiveError("Connection closed", 0);
+
+        if (errno == EINTR)
+            continue;
+
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            return 0;
+
+        throw Dispatcher::ReceiveError("Connection is broken", errno);
+    }
+}
+
+/**
+ * @brief   Make room behind the incomplete datagram at the beginning.
+ *
+ * The datagram is moved to the beginning of the buffer if it fits there,
+ * otherwise to a buffer of a larger tier.
+ */
+void
+Dispatcher::ReceiveRing::makeRoom()
+{
+    const uint32_t available = this->end - this->begin;
+
+    const uint32_t needed = (this->parser.headerComplete == true)
+            ? this->parser.datagramLength
+            : available + 1;
+
+    if (needed <= this->capacity)
+    {
+        memmove(this->buffer,
+                this->buffer + this->begin,
+                available);
+    }
+    else
+    {
+        Dispatcher::BufferPool& pool = Dispatcher::BufferPool::SharedInstance();
+
+        uint32_t largerCapacity;
+
+        char* largerBuffer = pool.borrow(needed, largerCapacity);
+
+        memcpy(largerBuffer,
+                this->buffer + this->begin,
+                available);
+
+        pool.giveBack(this->buffer, this->capacity);
+
+        this->buffer = largerBuffer;
+        this->capacity = largerCapacity;
+    }
+
+    this->end = available;
+    this->begin = 0;
+}
+
+/**
+ * @brief   Take the first complete datagram out of the ring.
+ *
+ * @return  Boolean false if there is no complete datagram yet.
+ *
+ * @throw   BrokenDatagram  If the datagram cannot be parsed or is too long.
+ */
+bool
+Dispatcher::ReceiveRing::take(Dispatcher::DatagramView& view)
+{
+    const char* const datagram = this->buffer + this->begin;
+    const uint32_t available = this->end - this->begin;
+
+    if (this->parser.headerComplete == false)
+    {
+        // Continue the search where it stopped, a terminator may have been
+        // cut into pieces by the previous chunk.
+        //
+        const uint32_t from = (this->parser.scanned > TerminatorLength - 1)
+                ? this->parser.scanned - (TerminatorLength - 1)
+                : 0;
+
+        const char* terminator = std::search(
+                datagram + from, datagram + available,
+                Terminator, Terminator + TerminatorLength);
+
+        if (terminator == datagram + available)
+        {
+            this->parser.scanned = available;
+
+            if (available >= this->maximalDatagramLength)
+                throw Dispatcher::BrokenDatagram("Datagram header too long");
+
+            return false;
+        }
+
+        this->parser.view.parseHeader(
+                datagram,
+                (terminator - datagram) + TerminatorLength,
+                this->maximalDatagramLength);
+
+        this->parser.headerComplete = true;
+        this->parser.datagramLength = this->parser.view.length;
+    }
+
+    if (available < this->parser.datagramLength)
+        return false;
+
+    view = this->parser.view;
+    view.base = datagram;
+
+    this->begin += this->parser.datagramLength;
+
+    this->parser.scanned = 0;
+    this->parser.headerComplete = false;
+    this->parser.datagramLength = 0;
+
+    return true;
+}
+
+/**
+ * @brief   Split header of a datagram into start line and header lines.
+ *
+ * @param   datagram                Beginning of the datagram.
+ * @param   headerLength            Length of the header including the empty line.
+ * @param   maximalDatagramLength   Datagrams announcing a longer payload are rejected.
+ *
+ * @throw   BrokenDatagram  If the header cannot be parsed or the datagram is too long.
+ */
+void
+Dispatcher::DatagramView::parseHeader(
+    const char* const   datagram,
+    const uint32_t      headerLength,
+    const uint32_t      maximalDatagramLength)
+{
+    Dispatcher::DatagramView& view = *this;
+
+    view.base = datagram;
+    view.statusCode = 0;
+    view.method.offset = 0;
+    view.method.length = 0;
+    view.numberOfHeaders = 0;
+
+    // Start line, either "RTSP/1.0 200 OK" or "METHOD url RTSP/1.0".
+    //
+    const char* lineEnd = (const char*) memchr(datagram, '\r', headerLength);
+
+    const uint32_t startLineLength = lineEnd - datagram;
+
+    if ((startLineLength > 5) && (strncmp(datagram, "RTSP/", 5) == 0))
+    {
+        const char* space = (const char*) memchr(datagram, ' ', startLineLength);
+        if (space == NULL)
+            throw Dispatcher::BrokenDatagram("Missing status code");
+
+        view.statusCode = strtoul(space + 1, NULL, 10);
+    }
+    else
+    {
+        const char* space = (const char*) memchr(datagram, ' ', startLineLength);
+        if (space == NULL)
+            throw Dispatcher::BrokenDatagram("Missing method");
+
+        view.method.length = space - datagram;
+    }
+
+    unsigned long contentLength = 0;
+
+    // Header lines up to the empty line.
+    //
+    uint32_t lineOffset = startLineLength + 2;
+
+    while (lineOffset < headerLength - 2)
+    {
+        const char* line = datagram + lineOffset;
+
+        lineEnd = (const char*) memchr(line, '\r', headerLength - lineOffset);
+
+        const uint32_t lineLength = lineEnd - line;
+
+        const char* colon = (const char*) memchr(line, ':', lineLength);
+        if (colon == NULL)
+            throw Dispatcher::BrokenDatagram("Malformed header line");
+
+        if (view.numberOfHeaders == Dispatcher::MaximalDatagramHeaders)
+            throw Dispatcher::BrokenDatagram("Too many header lines");
+
+        const char* value = colon + 1;
+
+        while ((value < lineEnd) && ((*value == ' ') || (*value == '\t')))
+            value++;
+
+        Dispatcher::DatagramSpan& nameSpan = view.headers[view.numberOfHeaders].name;
+        Dispatcher::DatagramSpan& valueSpan = view.headers[view.numberOfHeaders].value;
+
+        nameSpan.offset     = lineOffset;
+        nameSpan.length     = colon - line;
+        valueSpan.offset    = value - datagram;
+        valueSpan.length    = lineEnd - value;
+
+        if (SpanEquals(view, nameSpan, "Content-Length") == true)
+        {
+            // Content length comes from the peer, so that neither a sign,
+            // nor a value beyond the range, nor anything but blanks after the digits
+            // may slip through strtoul.
+            //
+            if ((value == lineEnd) || (isdigit((unsigned char) *value) == 0))
+                throw Dispatcher::BrokenDatagram("Malformed content length");
+
+            char* digitsEnd;
+
+            errno = 0;
+
+            contentLength = strtoul(value, &digitsEnd, 10);
+
+            if (errno == ERANGE)
+                throw Dispatcher::BrokenDatagram("Malformed content length");
+
+            while ((digitsEnd < lineEnd) && ((*digitsEnd == ' ') || (*digitsEnd == '\t')))
+                digitsEnd++;
+
+            if (digitsEnd != lineEnd)
+                throw Dispatcher::BrokenDatagram("Malformed content length");
+        }
+
+        view.numberOfHeaders++;
+
+        lineOffset += lineLength + 2;
+    }
+
+    // Compared without a sum, which might wrap around.
+    //
+    if ((headerLength > maximalDatagramLength) ||
+            (contentLength > maximalDatagramLength - headerLength))
+        throw Dispatcher::BrokenDatagram("Datagram too long");
+
+    view.payload.offset = headerLength;
+    view.payload.length = contentLength;
+    view.length = headerLength + contentLength;
+}
+
+/**
+ * @brief   Parse a datagram received as a whole.
+ *
+ * @return  Boolean false if the datagram is not complete.
+ *
+ * @throw   BrokenDatagram  If the header cannot be parsed.
+ */
+bool
+Dispatcher::DatagramView::parse(
+    const char* const   datagram,
+    const uint32_t      length)
+{
+    const char* terminator = std::search(
+            datagram, datagram + length,
+            Terminator, Terminator + TerminatorLength);
+
+    if (terminator == datagram + length)
+        return false;
+
+    this->parseHeader(
+            datagram,
+            (terminator - datagram) + TerminatorLength,
+            length);
+
+    return true;
+}
+
+bool
+Dispatcher::DatagramView::methodIs(const char* const method) const
+{
+    return SpanEquals(*this, this->method, method);
+}
+
+/**
+ * @brief   Find the value of a header line, name compared case-insensitive.
+ *
+ * @return  Boolean false if there is no such header line.
+ */
+bool
+Dispatcher::DatagramView::find(
+    const char* const           name,
+    Dispatcher::DatagramSpan&   value) const
+{
+    for (unsigned int headerIndex = 0;
+         headerIndex < this->numberOfHeaders;
+         headerIndex++)
+    {
+        if (SpanEquals(*this, this->headers[headerIndex].name, name) == true)
+        {
+            value = this->headers[headerIndex].value;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @throw   RTSP::StatementNotFound     If there is no such header line.
+ */
+std::string
+Dispatcher::DatagramView::text(const char* const name) const
+{
+    Dispatcher::DatagramSpan value;
+
+    if (this->find(name, value) == false)
+        throw RTSP::StatementNotFound();
+
+    return std::string(this->at(value), value.length);
+}
+
+/**
+ * @throw   RTSP::StatementNotFound     If there is no such header line.
+ */
+unsigned long
+Dispatcher::DatagramView::number(const char* const name) const
+{
+    Dispatcher::DatagramSpan value;
+
+    if (this->find(name, value) == false)
+        throw RTSP::StatementNotFound();
+
+    // Header lines end with CR, so the conversion stops within the line.
+    //
+    return strtoul(this->at(value), NULL, 10);
+}
+
+/**
+ * @throw   RTSP::StatementNotFound     If there is no such header line.
+ */
+bool
+Dispatcher::DatagramView::flag(const char* const name) const
+{
+    Dispatcher::DatagramSpan value;
+
+    if (this->find(name, value) == false)
+        throw RTSP::StatementNotFound();
+
+    return (SpanEquals(*this, value, "true") == true) ||
+            (SpanEquals(*this, value, "yes") == true) ||
+            (SpanEquals(*this, value, "1") == true);
+}
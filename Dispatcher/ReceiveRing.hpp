@@ -0,0 +1,181 @@
+#pragma once
+
+// System definition files.
+//
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace Dispatcher
+{
+    /**
+     * Header lines of a datagram beyond this number are rejected.
+     */
+    static const unsigned int MaximalDatagramHeaders = 32;
+
+    /**
+     * Part of a datagram, relative to the beginning of the datagram.
+     */
+    struct DatagramSpan
+    {
+        uint32_t                    offset;
+        uint32_t                    length;
+    };
+
+    /**
+     * Datagram parsed in place, as spans into the receive ring.
+     *
+     * A view does not own any bytes. It stays valid until the next call
+     * of receive() or reset() of the ring it was taken from.
+     */
+    class DatagramView
+    {
+    public:
+        const char*                 base;
+        uint32_t                    length;
+
+        /**
+         * Status code of a response, zero for a request.
+         */
+        unsigned int                statusCode;
+
+        /**
+         * Method of a request, empty for a response.
+         */
+        Dispatcher::DatagramSpan    method;
+
+        struct
+        {
+            Dispatcher::DatagramSpan    name;
+            Dispatcher::DatagramSpan    value;
+        }
+        headers[Dispatcher::MaximalDatagramHeaders];
+
+        unsigned int                numberOfHeaders;
+
+        Dispatcher::DatagramSpan    payload;
+
+    public:
+        void
+        parseHeader(
+            const char* const   datagram,
+            const uint32_t      headerLength,
+            const uint32_t      maximalDatagramLength);
+
+        bool
+        parse(
+            const char* const   datagram,
+            const uint32_t      length);
+
+        const char*
+        at(const Dispatcher::DatagramSpan& span) const
+        { return this->base + span.offset; }
+
+        bool
+        methodIs(const char* const method) const;
+
+        bool
+        find(
+            const char* const           name,
+            Dispatcher::DatagramSpan&   value) const;
+
+        std::string
+        text(const char* const name) const;
+
+        unsigned long
+        number(const char* const name) const;
+
+        bool
+        flag(const char* const name) const;
+    };
+
+    /**
+     * Receive buffer of a connection with an incremental parser of datagram headers.
+     *
+     * Bytes are received directly behind those already in the ring and complete
+     * datagrams are handed out as views into it, so that nothing is copied between
+     * the socket and the consumer of a datagram. Only the incomplete tail of the
+     * received bytes is moved to the beginning once the room behind it runs short.
+     * The parser remembers how far it has searched, so that a header arriving in
+     * many chunks is scanned only once.
+     *
+     * The buffer is borrowed from the buffer pool as data arrives, starting
+     * with the smallest tier and moved to a larger one only when a datagram
+     * does not fit. Connections may give it back once nothing is pending.
+     */
+    class ReceiveRing
+    {
+    private:
+        /**
+         * Buffer borrowed from the buffer pool, none while capacity is zero.
+         */
+        char*                       buffer;
+        uint32_t                    capacity;
+        uint32_t                    maximalDatagramLength;
+
+        /**
+         * First byte not yet taken and end of received bytes.
+         */
+        uint32_t                    begin;
+        uint32_t                    end;
+
+        /**
+         * State of the parser for the datagram at the beginning.
+         */
+        struct
+        {
+            uint32_t                scanned;
+            bool                    headerComplete;
+            uint32_t                datagramLength;
+            Dispatcher::DatagramView    view;
+        }
+        parser;
+
+    public:
+        ReceiveRing(const uint32_t maximalDatagramLength);
+
+        ~ReceiveRing();
+
+        void
+        reset();
+
+        void
+        release();
+
+        uint32_t
+        pending() const
+        { return this->end - this->begin; }
+
+        size_t
+        receive(const int socket);
+
+        bool
+        take(Dispatcher::DatagramView&);
+
+    private:
+        void
+        makeRoom();
+    };
+
+    class ReceiveError : public std::runtime_error
+    {
+    public:
+        int errorNumber;
+
+    public:
+        ReceiveError(const char* const reason, int errorNumber) throw() :
+        std::runtime_error(reason),
+        errorNumber(errorNumber)
+        { }
+    };
+
+    class BrokenDatagram : public std::runtime_error
+    {
+    public:
+        BrokenDatagram(const char* const reason) throw() :
+        std::runtime_error(reason)
+        { }
+    };
+};
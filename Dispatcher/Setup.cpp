@@ -1,6 +1,13 @@
 // System definition files.
 //
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cerrno>
 #include <cstdbool>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <rapidjson/document.h>
 
@@ -8,10 +15,12 @@
 //
 #include "Raspberry/DS1820.hpp"
 #include "Raspberry/Relay.hpp"
+#include "Toolkit/MD5.hpp"
 #include "Toolkit/Report.h"
 
 // Local definition files.
 //
+#include "Servus/Configuration.hpp"
 #include "Servus/Dispatcher/Setup.hpp"
 #include "Servus/Peripherique/HumiditySensor.hpp"
 #include "Servus/Peripherique/HumidityStation.hpp"
@@ -23,6 +32,11 @@
 
 using namespace rapidjson;
 
+/**
+ * First line of the configuration cache, followed by the hash of the JSON which comes after it.
+ */
+static const std::string CacheHashPrefix = "MD5 ";
+
 void
 Dispatcher::ProcessConfigurationJSON(const std::string& json)
 {
@@ -251,3 +265,166 @@ Dispatcher::ProcessConfigurationJSON(const std::string& json)
         }
     }
 }
+
+/**
+ * @brief   Hash identifying a configuration, as sent to Primus in SETUP.
+ */
+std::string
+Dispatcher::ConfigurationHash(const std::string& json)
+{
+    return Cryptography::MD5(json);
+}
+
+/**
+ * @brief   Path of the configuration cache, next to the configuration file.
+ */
+std::string
+Dispatcher::ConfigurationCachePath()
+{
+    Servus::Configuration& configuration = Servus::Configuration::SharedInstance();
+
+    std::string cachePath = configuration.configurationFilePath;
+
+    const std::string suffix = ".conf";
+
+    if ((cachePath.length() > suffix.length()) &&
+        (cachePath.compare(cachePath.length() - suffix.length(), suffix.length(), suffix) == 0))
+    {
+        cachePath.erase(cachePath.length() - suffix.length());
+    }
+
+    cachePath += ".setup.json";
+
+    return cachePath;
+}
+
+/**
+ * @brief   Read last configuration received from Primus.
+ *
+ * The cache is taken only if its content matches the hash stored with it
+ * and it is valid JSON, so that a torn or damaged file is never applied.
+ *
+ * @param   json            Cached configuration.
+ * @param   hash            Hash of cached configuration.
+ *
+ * @return  True if a valid configuration has been found.
+ */
+bool
+Dispatcher::LoadConfigurationCache(
+    std::string&    json,
+    std::string&    hash)
+{
+    const std::string cachePath = Dispatcher::ConfigurationCachePath();
+
+    FILE* cacheFile = fopen(cachePath.c_str(), "re");
+    if (cacheFile == NULL)
+    {
+        if (errno != ENOENT)
+        {
+            ReportWarning("[Dispatcher] Cannot open configuration cache %s (errno=%d)",
+                    cachePath.c_str(),
+                    errno);
+        }
+
+        return false;
+    }
+
+    std::string content;
+
+    char chunk[4096];
+    size_t chunkLength;
+
+    while ((chunkLength = fread(chunk, 1, sizeof(chunk), cacheFile)) > 0)
+    {
+        content.append(chunk, chunkLength);
+    }
+
+    fclose(cacheFile);
+
+    const size_t endOfHash = content.find('\n');
+
+    if ((endOfHash == std::string::npos) ||
+        (content.compare(0, CacheHashPrefix.length(), CacheHashPrefix) != 0))
+    {
+        ReportWarning("[Dispatcher] Configuration cache %s is damaged - ignore it",
+                cachePath.c_str());
+
+        return false;
+    }
+
+    hash = content.substr(CacheHashPrefix.length(), endOfHash - CacheHashPrefix.length());
+    json = content.substr(endOfHash + 1);
+
+    if (Dispatcher::ConfigurationHash(json) != hash)
+    {
+        ReportWarning("[Dispatcher] Configuration cache %s does not match its hash - ignore it",
+                cachePath.c_str());
+
+        return false;
+    }
+
+    Document document;
+    document.Parse(json.c_str());
+
+    if ((document.HasParseError() == true) || (document.IsObject() == false))
+    {
+        ReportWarning("[Dispatcher] Configuration cache %s is not valid JSON - ignore it",
+                cachePath.c_str());
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Keep configuration received from Primus for next start.
+ *
+ * The cache is written to a temporary file first and renamed over the previous one,
+ * so that a power cut leaves either the old or the new configuration.
+ *
+ * @param   json            Configuration received from Primus.
+ * @param   hash            Hash of configuration.
+ */
+void
+Dispatcher::StoreConfigurationCache(
+    const std::string&  json,
+    const std::string&  hash)
+{
+    const std::string cachePath = Dispatcher::ConfigurationCachePath();
+    const std::string temporaryPath = cachePath + ".tmp";
+
+    const std::string header = CacheHashPrefix + hash + "\n";
+
+    int fileDescriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fileDescriptor == -1)
+    {
+        ReportWarning("[Dispatcher] Cannot create configuration cache %s (errno=%d)",
+                temporaryPath.c_str(),
+                errno);
+
+        return;
+    }
+
+    bool written =
+            (write(fileDescriptor, header.c_str(), header.length()) == (ssize_t) header.length()) &&
+            (write(fileDescriptor, json.c_str(), json.length()) == (ssize_t) json.length()) &&
+            (fsync(fileDescriptor) == 0);
+
+    close(fileDescriptor);
+
+    if ((written == false) || (rename(temporaryPath.c_str(), cachePath.c_str()) != 0))
+    {
+        ReportWarning("[Dispatcher] Cannot write configuration cache %s (errno=%d)",
+                cachePath.c_str(),
+                errno);
+
+        unlink(temporaryPath.c_str());
+
+        return;
+    }
+
+    ReportInfo("[Dispatcher] Configuration %s stored in %s",
+            hash.c_str(),
+            cachePath.c_str());
+}
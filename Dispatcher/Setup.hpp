@@ -2,10 +2,27 @@
 
 // System definition files.
 //
+#include <cstdbool>
 #include <string>
 
 namespace Dispatcher
 {
     void
     ProcessConfigurationJSON(const std::string&);
+
+    std::string
+    ConfigurationHash(const std::string& json);
+
+    std::string
+    ConfigurationCachePath();
+
+    bool
+    LoadConfigurationCache(
+        std::string&    json,
+        std::string&    hash);
+
+    void
+    StoreConfigurationCache(
+        const std::string&  json,
+        const std::string&  hash);
 };
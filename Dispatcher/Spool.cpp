@@ -0,0 +1,949 @@
+// System definition files.
+//
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdbool>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Common definition files.
+//
+#include "RTSP/RTSP.hpp"
+#include "Toolkit/Report.h"
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/Aviso.hpp"
+#include "Servus/Dispatcher/Spool.hpp"
+
+/**
+ * Request line in front of the fields of a spooled aviso, which Restore() does not look at.
+ */
+static const std::string RestoreRequestLine = "AVISO rtsp://primus RTSP/1.0\r\n";
+
+/**
+ * @brief   Lane of a record, the first one for records of unknown lanes.
+ */
+static inline unsigned int
+RecordLane(const Dispatcher::SpoolRecordHeader* record)
+{
+    return (record->lane < Dispatcher::SpoolLanes) ? record->lane : 0;
+}
+
+static inline uint32_t
+RecordSize(const uint32_t length)
+{
+    const uint32_t size = sizeof(Dispatcher::SpoolRecordHeader) + length;
+
+    return (size + Dispatcher::SpoolAlignment - 1) & ~(Dispatcher::SpoolAlignment - 1);
+}
+
+Dispatcher::SpoolSegment::SpoolSegment(
+    const unsigned int  sequence,
+    const std::string&  filePath,
+    const int           fileDescriptor,
+    char*               base,
+    const uint32_t      size) :
+sequence(sequence),
+filePath(filePath),
+fileDescriptor(fileDescriptor),
+base(base),
+size(size)
+{
+    this->tail.store(sizeof(Dispatcher::SpoolSegmentHeader), std::memory_order_relaxed);
+    this->end.store(Dispatcher::SpoolEndUnknown, std::memory_order_relaxed);
+    this->records.store(0, std::memory_order_relaxed);
+    this->acknowledged = 0;
+    this->sealed.store(false, std::memory_order_relaxed);
+    this->dirty.store(false, std::memory_order_relaxed);
+}
+
+Dispatcher::SpoolSegment::~SpoolSegment()
+{
+    munmap(this->base, this->size);
+
+    close(this->fileDescriptor);
+}
+
+Dispatcher::Spool::Spool(
+    const std::string&  directoryPath,
+    const uint32_t      segmentSize,
+    const unsigned int  maximalSegments,
+    const unsigned int  syncInterval) :
+directoryPath(directoryPath),
+segmentSize(segmentSize),
+maximalSegments(maximalSegments),
+syncInterval(syncInterval)
+{
+    this->segments.current.store(NULL, std::memory_order_relaxed);
+    this->segments.lastSequence = 0;
+
+    this->appenders.store(0, std::memory_order_relaxed);
+    this->synchronising.store(false, std::memory_order_relaxed);
+    this->rotations.store(0, std::memory_order_relaxed);
+    this->reclamation.pending = false;
+    this->reclamation.rotations = 0;
+    for (unsigned int lane = 0; lane < Dispatcher::SpoolLanes; lane++)
+    {
+        this->spilledRecords[lane].store(0, std::memory_order_relaxed);
+
+        this->scan[lane].sequence = 0;
+        this->scan[lane].offset = sizeof(Dispatcher::SpoolSegmentHeader);
+    }
+
+    if ((mkdir(this->directoryPath.c_str(), 0750) == -1) && (errno != EEXIST))
+    {
+        ReportError("[Spool] Cannot create directory %s: errno=%d",
+                this->directoryPath.c_str(),
+                errno);
+
+        throw Dispatcher::SpoolError("[Spool] Cannot create directory", errno);
+    }
+}
+
+Dispatcher::Spool::~Spool()
+{
+    for (Dispatcher::SpoolSegment* segment : this->segments.list)
+    {
+        msync(segment->base, segment->size, MS_SYNC);
+
+        delete segment;
+    }
+}
+
+/**
+ * @brief   Load all segments left from previous run.
+ *
+ * Every record which has not been acknowledged is marked as spilled, so that
+ * it will be loaded into the queue again. Must be called before any aviso is appended.
+ *
+ * @return  Highest aviso id found in the spool.
+ */
+unsigned int
+Dispatcher::Spool::replay()
+{
+    std::vector<unsigned int> sequences;
+
+    DIR* directory = opendir(this->directoryPath.c_str());
+    if (directory == NULL)
+    {
+        throw Dispatcher::SpoolError("[Spool] Cannot open directory", errno);
+    }
+
+    for (;;)
+    {
+        struct dirent* directoryEntry = readdir(directory);
+        if (directoryEntry == NULL)
+            break;
+
+        // Segment files are named like 00000001.spool.
+        //
+        if ((strlen(directoryEntry->d_name) != 14) ||
+            (strcmp(directoryEntry->d_name + 8, ".spool") != 0))
+        {
+            continue;
+        }
+
+        sequences.push_back(strtoul(directoryEntry->d_name, NULL, 10));
+    }
+
+    closedir(directory);
+
+    std::sort(sequences.begin(), sequences.end());
+
+    unsigned int lastAvisoId = 0;
+    unsigned int unacknowledged = 0;
+    unsigned int unacknowledgedInLane[Dispatcher::SpoolLanes] = { 0 };
+
+    for (unsigned int sequence : sequences)
+    {
+        this->segments.lastSequence = std::max(this->segments.lastSequence, sequence);
+
+        Dispatcher::SpoolSegment* segment = this->openSegment(sequence);
+        if (segment == NULL)
+            continue;
+
+        lastAvisoId = std::max(lastAvisoId, segment->header()->baseAvisoId);
+
+        uint32_t offset = segment->header()->cursor;
+
+        if (offset < sizeof(Dispatcher::SpoolSegmentHeader))
+            offset = sizeof(Dispatcher::SpoolSegmentHeader);
+
+        while (offset + sizeof(Dispatcher::SpoolRecordHeader) <= segment->size)
+        {
+            Dispatcher::SpoolRecordHeader* record = segment->record(offset);
+
+            const uint32_t state = record->state.load(std::memory_order_relaxed);
+
+            // Records end where nothing has been reserved. A producer writes
+            // the length of its record first, so that a record which had been
+            // reserved but not completely written before the crash is skipped
+            // and records written behind it are kept.
+            //
+            if ((record->length == 0) ||
+                (offset + RecordSize(record->length) > segment->size))
+            {
+                break;
+            }
+
+            segment->records.fetch_add(1, std::memory_order_relaxed);
+
+            if (state == Dispatcher::SpoolRecordFree)
+            {
+                ReportWarning("[Spool] Skip incomplete record in segment %s",
+                        segment->filePath.c_str());
+
+                record->state.store(Dispatcher::SpoolRecordAcknowledged, std::memory_order_relaxed);
+
+                segment->acknowledged++;
+            }
+            else if (state == Dispatcher::SpoolRecordAcknowledged)
+            {
+                segment->acknowledged++;
+            }
+            else
+            {
+                record->state.store(Dispatcher::SpoolRecordSpilled, std::memory_order_relaxed);
+
+                unacknowledged++;
+                unacknowledgedInLane[RecordLane(record)]++;
+            }
+
+            lastAvisoId = std::max(lastAvisoId, record->avisoId);
+
+            offset += RecordSize(record->length);
+        }
+
+        segment->tail.store(offset, std::memory_order_relaxed);
+        segment->end.store(offset, std::memory_order_relaxed);
+        segment->sealed.store(true, std::memory_order_relaxed);
+        segment->dirty.store(true, std::memory_order_relaxed);
+
+        if (segment->acknowledged == segment->records.load(std::memory_order_relaxed))
+        {
+            unlink(segment->filePath.c_str());
+
+            delete segment;
+
+            continue;
+        }
+
+        if (this->segments.list.empty() == true)
+        {
+            for (unsigned int lane = 0; lane < Dispatcher::SpoolLanes; lane++)
+            {
+                this->scan[lane].sequence = segment->sequence;
+                this->scan[lane].offset = segment->header()->cursor;
+            }
+        }
+
+        this->segments.list.push_back(segment);
+    }
+
+    for (unsigned int lane = 0; lane < Dispatcher::SpoolLanes; lane++)
+    {
+        this->spilledRecords[lane].store(unacknowledgedInLane[lane], std::memory_order_release);
+    }
+
+    Dispatcher::SpoolSegment* segment = this->createSegment(lastAvisoId);
+    if (segment == NULL)
+    {
+        throw Dispatcher::SpoolError("[Spool] Cannot create segment", errno);
+    }
+
+    if (this->segments.list.empty() == true)
+    {
+        for (unsigned int lane = 0; lane < Dispatcher::SpoolLanes; lane++)
+        {
+            this->scan[lane].sequence = segment->sequence;
+            this->scan[lane].offset = sizeof(Dispatcher::SpoolSegmentHeader);
+        }
+    }
+
+    this->segments.list.push_back(segment);
+    this->segments.current.store(segment, std::memory_order_release);
+
+    ReportNotice("[Spool] Replayed %u unacknowledged avisos from %u segments, last aviso #%u",
+            unacknowledged,
+            (unsigned int) this->segments.list.size() - 1,
+            lastAvisoId);
+
+    return lastAvisoId;
+}
+
+void
+Dispatcher::Spool::start()
+{
+    this->thread = std::thread(&Dispatcher::Spool::ThreadHandler, this);
+}
+
+/**
+ * @brief   Append an aviso to the spool.
+ *
+ * May be called by any thread. Does not take a lock unless the current
+ * segment is full and has to be rotated.
+ *
+ * @return  Boolean true if the aviso has been stored.
+ * @return  Boolean false if there is no room left in the spool.
+ */
+bool
+Dispatcher::Spool::append(
+    Dispatcher::Aviso*                  aviso,
+    const Dispatcher::SpoolRecordState  state,
+    const unsigned int                  lane)
+{
+    // Fields of the aviso are stored exactly as they are going to be sent to Primus.
+    //
+    const uint32_t length = aviso->wire.length;
+    const uint32_t recordSize = RecordSize(length);
+
+    if (recordSize > this->segmentSize - sizeof(Dispatcher::SpoolSegmentHeader))
+    {
+        ReportWarning("[Spool] Aviso #%u is too long to be spooled",
+                aviso->avisoId);
+
+        return false;
+    }
+
+    // Segments are not released while any producer is appending,
+    // so the segment pointer stays valid until the counter is decremented.
+    //
+    this->appenders.fetch_add(1, std::memory_order_seq_cst);
+
+    Dispatcher::SpoolSegment* segment;
+    uint32_t offset;
+
+    for (;;)
+    {
+        segment = this->segments.current.load(std::memory_order_seq_cst);
+
+        // Tail never moves past the end of the segment, however often producers
+        // find it full while the spool has no room for another segment.
+        //
+        offset = segment->tail.load(std::memory_order_relaxed);
+
+        bool reserved = false;
+
+        while (offset < segment->size)
+        {
+            if (offset + recordSize <= segment->size)
+            {
+                if (segment->tail.compare_exchange_weak(
+                        offset,
+                        offset + recordSize,
+                        std::memory_order_relaxed) == true)
+                {
+                    // Record filling the segment exactly closes it as well.
+                    //
+                    if (offset + recordSize == segment->size)
+                        segment->end.store(segment->size, std::memory_order_release);
+
+                    reserved = true;
+                    break;
+                }
+            }
+            else
+            {
+                // Exactly one producer closes the segment by moving the tail to its end,
+                // so that no smaller record follows. It knows where the records end.
+                //
+                if (segment->tail.compare_exchange_weak(
+                        offset,
+                        segment->size,
+                        std::memory_order_relaxed) == true)
+                {
+                    segment->end.store(offset, std::memory_order_release);
+                    break;
+                }
+            }
+        }
+
+        if (reserved == true)
+            break;
+
+        if (this->rotate(segment, aviso->avisoId) == false)
+        {
+            this->appenders.fetch_sub(1, std::memory_order_release);
+
+            return false;
+        }
+    }
+
+    segment->records.fetch_add(1, std::memory_order_relaxed);
+
+    Dispatcher::SpoolRecordHeader* record = segment->record(offset);
+
+    // Length goes first, so that replay may skip the record should it not be completed.
+    //
+    record->length = length;
+    record->avisoId = aviso->avisoId;
+    record->lane = lane;
+    memcpy((char*) record + sizeof(Dispatcher::SpoolRecordHeader), aviso->wire.buffer, length);
+
+    if (state == Dispatcher::SpoolRecordResident)
+    {
+        aviso->spoolRecord.segment = segment;
+        aviso->spoolRecord.offset = offset;
+    }
+
+    record->state.store(state, std::memory_order_release);
+
+    if (state == Dispatcher::SpoolRecordSpilled)
+    {
+        this->spilledRecords[RecordLane(record)].fetch_add(1, std::memory_order_release);
+    }
+
+    segment->dirty.store(true, std::memory_order_relaxed);
+
+    this->appenders.fetch_sub(1, std::memory_order_release);
+
+    return true;
+}
+
+/**
+ * @brief   Mark the record of an aviso as acknowledged.
+ *
+ * Moves the durable cursor of the segment past all leading acknowledged records
+ * and removes the segment once all its records are acknowledged.
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Spool::acknowledge(Dispatcher::Aviso* aviso)
+{
+    Dispatcher::SpoolSegment* segment = aviso->spoolRecord.segment;
+
+    if (segment == NULL)
+        return;
+
+    aviso->spoolRecord.segment = NULL;
+
+    this->acknowledge(segment, aviso->spoolRecord.offset);
+}
+
+/**
+ * @brief   Mark a record which no aviso refers to any more as acknowledged.
+ *
+ * Used for records of avisos that have been superseded by a newer value.
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Spool::acknowledge(
+    Dispatcher::SpoolSegment*   segment,
+    const uint32_t              offset)
+{
+    Dispatcher::SpoolRecordHeader* record = segment->record(offset);
+
+    record->state.store(Dispatcher::SpoolRecordAcknowledged, std::memory_order_relaxed);
+
+    segment->acknowledged++;
+    segment->dirty.store(true, std::memory_order_relaxed);
+
+    Dispatcher::SpoolSegmentHeader* header = segment->header();
+
+    while (header->cursor + sizeof(Dispatcher::SpoolRecordHeader) <= segment->size)
+    {
+        record = segment->record(header->cursor);
+
+        if (record->state.load(std::memory_order_acquire) != Dispatcher::SpoolRecordAcknowledged)
+            break;
+
+        header->cursor += RecordSize(record->length);
+    }
+
+    if ((segment->sealed.load(std::memory_order_acquire) == true) &&
+        (segment->acknowledged == segment->records.load(std::memory_order_acquire)))
+    {
+        this->reclamation.pending = true;
+    }
+
+    if ((this->reclamation.pending == true) ||
+        (this->reclamation.rotations != this->rotations.load(std::memory_order_acquire)))
+    {
+        this->reclaim();
+    }
+}
+
+/**
+ * @brief   Number of records which are only on disk, in all lanes.
+ */
+unsigned int
+Dispatcher::Spool::spilled()
+{
+    unsigned int spilledRecords = 0;
+
+    for (unsigned int lane = 0; lane < Dispatcher::SpoolLanes; lane++)
+        spilledRecords += this->spilled(lane);
+
+    return spilledRecords;
+}
+
+/**
+ * @brief   Find the next record of a lane which is only on disk and recreate its aviso.
+ *
+ * The record stays spilled until resident() is called for the aviso.
+ * Must be called only by the dispatcher thread.
+ *
+ * @return  Aviso restored from the spool.
+ * @return  NULL if there is no spilled record ready.
+ */
+Dispatcher::Aviso*
+Dispatcher::Spool::peekSpilled(const unsigned int lane)
+{
+    if (this->spilled(lane) == 0)
+        return NULL;
+
+    for (;;)
+    {
+        Dispatcher::SpoolSegment* segment = this->segmentBySequence(this->scan[lane].sequence, lane);
+        if (segment == NULL)
+            return NULL;
+
+        while (this->scan[lane].offset + sizeof(Dispatcher::SpoolRecordHeader) <= segment->size)
+        {
+            Dispatcher::SpoolRecordHeader* record = segment->record(this->scan[lane].offset);
+
+            const uint32_t state = record->state.load(std::memory_order_acquire);
+
+            if (state == Dispatcher::SpoolRecordFree)
+                break;
+
+            if ((state == Dispatcher::SpoolRecordSpilled) && (RecordLane(record) == lane))
+            {
+                RTSP::Datagram datagram;
+
+                Dispatcher::Aviso* aviso = NULL;
+
+                try
+                {
+                    // Fields of an aviso are parsed behind a request line of their own.
+                    //
+                    if (segment->header()->magic == Dispatcher::SpoolMagic)
+                        datagram.push(RestoreRequestLine.data(), RestoreRequestLine.length());
+
+                    datagram.push((const char*) record + sizeof(Dispatcher::SpoolRecordHeader), record->length);
+
+                    aviso = Dispatcher::Aviso::Restore(datagram);
+                }
+                catch (std::exception& exception)
+                {
+                    ReportWarning("[Spool] Cannot restore aviso #%u: %s",
+                            record->avisoId,
+                            exception.what());
+                }
+
+                if (aviso != NULL)
+                {
+                    aviso->spoolRecord.segment = segment;
+                    aviso->spoolRecord.offset = this->scan[lane].offset;
+
+                    return aviso;
+                }
+
+                // Drop the record which cannot be restored.
+                //
+                record->state.store(Dispatcher::SpoolRecordAcknowledged, std::memory_order_relaxed);
+                segment->acknowledged++;
+
+                this->spilledRecords[lane].fetch_sub(1, std::memory_order_release);
+
+                // Released with the next acknowledgement, not while being scanned.
+                //
+                this->reclamation.pending = true;
+            }
+
+            this->scan[lane].offset += RecordSize(record->length);
+        }
+
+        // Continue with the next segment only if this one is completely read.
+        //
+        const uint32_t end = segment->end.load(std::memory_order_acquire);
+
+        if ((end == Dispatcher::SpoolEndUnknown) || (this->scan[lane].offset < end))
+            return NULL;
+
+        this->scan[lane].sequence++;
+        this->scan[lane].offset = sizeof(Dispatcher::SpoolSegmentHeader);
+    }
+}
+
+/**
+ * @brief   Mark the record of an aviso restored by peekSpilled() as being in the queue.
+ *
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Spool::resident(Dispatcher::Aviso* aviso)
+{
+    Dispatcher::SpoolRecordHeader* record =
+            aviso->spoolRecord.segment->record(aviso->spoolRecord.offset);
+
+    record->state.store(Dispatcher::SpoolRecordResident, std::memory_order_relaxed);
+
+    const unsigned int lane = RecordLane(record);
+
+    this->spilledRecords[lane].fetch_sub(1, std::memory_order_release);
+
+    this->scan[lane].offset += RecordSize(record->length);
+}
+
+/**
+ * @brief   Create a new empty segment file and map it into memory.
+ *
+ * Caller must hold the lock of segment list.
+ *
+ * @param   baseAvisoId     Aviso id to continue with should all records be
+ *                          acknowledged and removed before the next start.
+ */
+Dispatcher::SpoolSegment*
+Dispatcher::Spool::createSegment(const unsigned int baseAvisoId)
+{
+    const unsigned int sequence = this->segments.lastSequence + 1;
+
+    const std::string filePath = this->segmentFilePath(sequence);
+
+    int fileDescriptor = open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fileDescriptor == -1)
+    {
+        ReportError("[Spool] Cannot create segment %s: errno=%d",
+                filePath.c_str(),
+                errno);
+
+        return NULL;
+    }
+
+    if (ftruncate(fileDescriptor, this->segmentSize) == -1)
+    {
+        ReportError("[Spool] Cannot allocate segment %s: errno=%d",
+                filePath.c_str(),
+                errno);
+
+        close(fileDescriptor);
+        unlink(filePath.c_str());
+
+        return NULL;
+    }
+
+    void* base = mmap(NULL, this->segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    if (base == MAP_FAILED)
+    {
+        ReportError("[Spool] Cannot map segment %s: errno=%d",
+                filePath.c_str(),
+                errno);
+
+        close(fileDescriptor);
+        unlink(filePath.c_str());
+
+        return NULL;
+    }
+
+    Dispatcher::SpoolSegment* segment = new Dispatcher::SpoolSegment(
+            sequence,
+            filePath,
+            fileDescriptor,
+            (char*) base,
+            this->segmentSize);
+
+    segment->header()->magic = Dispatcher::SpoolMagic;
+    segment->header()->sequence = sequence;
+    segment->header()->cursor = sizeof(Dispatcher::SpoolSegmentHeader);
+    segment->header()->baseAvisoId = baseAvisoId;
+    segment->dirty.store(true, std::memory_order_relaxed);
+
+    this->segments.lastSequence = sequence;
+
+    ReportDebug("[Spool] Created segment %s",
+            filePath.c_str());
+
+    return segment;
+}
+
+/**
+ * @brief   Map an existing segment file into memory.
+ *
+ * @return  NULL if the file is not a valid segment.
+ */
+Dispatcher::SpoolSegment*
+Dispatcher::Spool::openSegment(const unsigned int sequence)
+{
+    const std::string filePath = this->segmentFilePath(sequence);
+
+    int fileDescriptor = open(filePath.c_str(), O_RDWR | O_CLOEXEC);
+    if (fileDescriptor == -1)
+    {
+        ReportError("[Spool] Cannot open segment %s: errno=%d",
+                filePath.c_str(),
+                errno);
+
+        return NULL;
+    }
+
+    struct stat fileStatus;
+
+    if ((fstat(fileDescriptor, &fileStatus) == -1) ||
+        (fileStatus.st_size < (off_t) sizeof(Dispatcher::SpoolSegmentHeader)))
+    {
+        ReportWarning("[Spool] Ignore broken segment %s",
+                filePath.c_str());
+
+        close(fileDescriptor);
+
+        return NULL;
+    }
+
+    void* base = mmap(NULL, fileStatus.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    if (base == MAP_FAILED)
+    {
+        ReportError("[Spool] Cannot map segment %s: errno=%d",
+                filePath.c_str(),
+                errno);
+
+        close(fileDescriptor);
+
+        return NULL;
+    }
+
+    Dispatcher::SpoolSegment* segment = new Dispatcher::SpoolSegment(
+            sequence,
+            filePath,
+            fileDescriptor,
+            (char*) base,
+            (uint32_t) fileStatus.st_size);
+
+    // Segments of complete requests are still replayed, as they are never appended to.
+    //
+    if (((segment->header()->magic != Dispatcher::SpoolMagic) &&
+         (segment->header()->magic != Dispatcher::SpoolMagicRequests)) ||
+        (segment->header()->sequence != sequence))
+    {
+        ReportWarning("[Spool] Ignore segment %s with wrong signature",
+                filePath.c_str());
+
+        delete segment;
+
+        return NULL;
+    }
+
+    return segment;
+}
+
+/**
+ * @brief   Replace a full segment by a new one.
+ *
+ * @return  Boolean false if the spool has reached its maximal size.
+ */
+bool
+Dispatcher::Spool::rotate(
+    Dispatcher::SpoolSegment*   full,
+    const unsigned int          avisoId)
+{
+    std::unique_lock<std::mutex> segmentsLock { this->segments.lock };
+
+    // Some other producer did already rotate.
+    //
+    if (this->segments.current.load(std::memory_order_relaxed) != full)
+        return true;
+
+    if (this->segments.list.size() >= this->maximalSegments)
+    {
+        ReportWarning("[Spool] Spool is full (%u segments)",
+                (unsigned int) this->segments.list.size());
+
+        return false;
+    }
+
+    Dispatcher::SpoolSegment* segment = this->createSegment(avisoId);
+    if (segment == NULL)
+        return false;
+
+    full->sealed.store(true, std::memory_order_release);
+
+    this->segments.list.push_back(segment);
+    this->segments.current.store(segment, std::memory_order_seq_cst);
+
+    this->rotations.fetch_add(1, std::memory_order_release);
+
+    return true;
+}
+
+/**
+ * @brief   Remove all segments all records of which have been acknowledged.
+ *
+ * The whole list is looked through, so that a segment which could not be released
+ * earlier, wherever it is, is released with the next acknowledgement.
+ * Must be called only by the dispatcher thread.
+ */
+void
+Dispatcher::Spool::reclaim()
+{
+    // Some producer which has loaded a segment before it was sealed
+    // may still be touching it. Try again with the next acknowledgement.
+    //
+    if (this->appenders.load(std::memory_order_seq_cst) != 0)
+        return;
+
+    std::vector<Dispatcher::SpoolSegment*> released;
+
+    {
+        std::unique_lock<std::mutex> segmentsLock { this->segments.lock };
+
+        // Synchronisation thread may be writing any of the segments.
+        // Try again with the next acknowledgement.
+        //
+        if (this->synchronising.load(std::memory_order_acquire) == true)
+            return;
+
+        this->reclamation.rotations = this->rotations.load(std::memory_order_acquire);
+
+        Dispatcher::SpoolSegment* current = this->segments.current.load(std::memory_order_relaxed);
+
+        for (std::deque<Dispatcher::SpoolSegment*>::iterator iterator = this->segments.list.begin();
+             iterator != this->segments.list.end(); )
+        {
+            Dispatcher::SpoolSegment* segment = *iterator;
+
+            if ((segment != current) &&
+                (segment->sealed.load(std::memory_order_acquire) == true) &&
+                (segment->acknowledged == segment->records.load(std::memory_order_acquire)))
+            {
+                released.push_back(segment);
+
+                iterator = this->segments.list.erase(iterator);
+            }
+            else
+            {
+                iterator++;
+            }
+        }
+    }
+
+    this->reclamation.pending = false;
+
+    for (Dispatcher::SpoolSegment* segment : released)
+    {
+        ReportDebug("[Spool] Release segment %s",
+                segment->filePath.c_str());
+
+        unlink(segment->filePath.c_str());
+
+        delete segment;
+    }
+}
+
+/**
+ * @brief   Find a segment by its sequence number.
+ *
+ * If the segment does not exist any more, the next existing one is returned
+ * and scan position of the lane is moved to its beginning.
+ */
+Dispatcher::SpoolSegment*
+Dispatcher::Spool::segmentBySequence(
+    const unsigned int  sequence,
+    const unsigned int  lane)
+{
+    std::unique_lock<std::mutex> segmentsLock { this->segments.lock };
+
+    for (Dispatcher::SpoolSegment* segment : this->segments.list)
+    {
+        if (segment->sequence == sequence)
+            return segment;
+
+        if (segment->sequence > sequence)
+        {
+            this->scan[lane].sequence = segment->sequence;
+            this->scan[lane].offset = sizeof(Dispatcher::SpoolSegmentHeader);
+
+            return segment;
+        }
+    }
+
+    return NULL;
+}
+
+std::string
+Dispatcher::Spool::segmentFilePath(const unsigned int sequence)
+{
+    char fileName[32];
+
+    snprintf(fileName, sizeof(fileName), "%08u.spool", sequence);
+
+    return this->directoryPath + "/" + fileName;
+}
+
+/**
+ * @brief   Thread handler for synchronisation of dirty segments to disk.
+ *
+ * Dirty segments are taken from the list under the lock and written without it,
+ * so that producers rotating segments do not wait for the disk.
+ * Dispatcher does not release segments meanwhile.
+ */
+void
+Dispatcher::Spool::ThreadHandler(Dispatcher::Spool* spool)
+{
+    ReportDebug("[Spool] Synchronisation thread has been started");
+
+    std::vector<Dispatcher::SpoolSegment*> dirty;
+
+    for (;;)
+    {
+        std::this_thread::sleep_for(
+                std::chrono::milliseconds { spool->syncInterval } );
+
+        dirty.clear();
+
+        {
+            std::unique_lock<std::mutex> segmentsLock { spool->segments.lock };
+
+            for (Dispatcher::SpoolSegment* segment : spool->segments.list)
+            {
+                if (segment->dirty.exchange(false, std::memory_order_acq_rel) == true)
+                    dirty.push_back(segment);
+            }
+
+            if (dirty.empty() == true)
+                continue;
+
+            spool->synchronising.store(true, std::memory_order_release);
+        }
+
+        for (Dispatcher::SpoolSegment* segment : dirty)
+        {
+            if (msync(segment->base, segment->size, MS_SYNC) == -1)
+            {
+                ReportWarning("[Spool] Cannot synchronise segment %s: errno=%d",
+                        segment->filePath.c_str(),
+                        errno);
+
+                continue;
+            }
+
+            // Pages of a full segment are only needed again for replay
+            // and acknowledgement, let kernel take them back.
+            //
+            if (segment->sealed.load(std::memory_order_acquire) == true)
+            {
+                madvise(segment->base, segment->size, MADV_DONTNEED);
+            }
+        }
+
+        spool->synchronising.store(false, std::memory_order_release);
+    }
+
+    ReportWarning("[Spool] Synchronisation thread is going to quit");
+}
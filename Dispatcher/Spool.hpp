@@ -0,0 +1,282 @@
+#pragma once
+
+// System definition files.
+//
+#include <atomic>
+#include <cstdbool>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/Aviso.hpp"
+
+namespace Dispatcher
+{
+    static const uint32_t SpoolMagic                = 0x53505532;   /**< "SPU2", fields of avisos. */
+    static const uint32_t SpoolMagicRequests        = 0x53505531;   /**< "SPU1", complete requests. */
+    static const uint32_t SpoolAlignment            = 8;
+    static const uint32_t SpoolEndUnknown           = UINT32_MAX;
+
+    /**
+     * Number of lanes spilled records are sorted into, one per lane of the queue.
+     */
+    static const unsigned int SpoolLanes            = 3;
+
+    enum SpoolRecordState
+    {
+        SpoolRecordFree             = 0,    /**< Reserved, not yet written. */
+        SpoolRecordResident         = 1,    /**< Aviso is in the queue in memory. */
+        SpoolRecordSpilled          = 2,    /**< Aviso is only on disk. */
+        SpoolRecordAcknowledged     = 3     /**< Aviso has been acknowledged by Primus. */
+    };
+
+    struct SpoolSegmentHeader
+    {
+        uint32_t                    magic;
+        uint32_t                    sequence;
+
+        /**
+         * Offset of the first record not yet acknowledged (durable cursor).
+         */
+        uint32_t                    cursor;
+
+        /**
+         * Aviso id known to be used when the segment was created.
+         */
+        uint32_t                    baseAvisoId;
+    };
+
+    struct SpoolRecordHeader
+    {
+        std::atomic<uint32_t>       state;
+        uint32_t                    length;
+        uint32_t                    avisoId;
+
+        /**
+         * Lane of the queue the aviso is refilled into, zero in segments of complete requests.
+         */
+        uint32_t                    lane;
+    };
+
+    /**
+     * One memory-mapped file of the spool.
+     */
+    class SpoolSegment
+    {
+    public:
+        unsigned int                sequence;
+        std::string                 filePath;
+        int                         fileDescriptor;
+        char*                       base;
+        uint32_t                    size;
+
+        /**
+         * Offset where the next record will be reserved by producers,
+         * size of the segment once it is closed.
+         */
+        std::atomic<uint32_t>       tail;
+
+        /**
+         * Offset where records end once the segment became full,
+         * SpoolEndUnknown before that.
+         */
+        std::atomic<uint32_t>       end;
+
+        /**
+         * Number of records reserved in this segment.
+         */
+        std::atomic<uint32_t>       records;
+
+        /**
+         * Number of records acknowledged, owned by consumer.
+         */
+        uint32_t                    acknowledged;
+
+        /**
+         * No more records will be reserved in this segment.
+         */
+        std::atomic<bool>           sealed;
+
+        std::atomic<bool>           dirty;
+
+    public:
+        SpoolSegment(
+            const unsigned int  sequence,
+            const std::string&  filePath,
+            const int           fileDescriptor,
+            char*               base,
+            const uint32_t      size);
+
+        ~SpoolSegment();
+
+        Dispatcher::SpoolSegmentHeader*
+        header()
+        { return (Dispatcher::SpoolSegmentHeader*) this->base; }
+
+        Dispatcher::SpoolRecordHeader*
+        record(const uint32_t offset)
+        { return (Dispatcher::SpoolRecordHeader*) (this->base + offset); }
+    };
+
+    /**
+     * Append-only log of memory-mapped segments keeping avisos across restarts
+     * and Primus outages.
+     *
+     * Producers append records without taking a lock; the lock is taken only
+     * to rotate segments. A separate thread flushes dirty segments in intervals,
+     * so that an SD card sees few large writes instead of many small ones.
+     * Records are acknowledged in place and a segment is removed as soon as all
+     * its records are acknowledged.
+     */
+    class Spool
+    {
+    private:
+        /**
+         * Thread handler of synchronisation thread.
+         */
+        std::thread                 thread;
+
+        std::string                 directoryPath;
+        uint32_t                    segmentSize;
+        unsigned int                maximalSegments;
+        unsigned int                syncInterval;
+
+        struct
+        {
+            std::deque<Dispatcher::SpoolSegment*>   list;
+            std::mutex                              lock;
+            std::atomic<Dispatcher::SpoolSegment*>  current;
+            unsigned int                            lastSequence;
+        }
+        segments;
+
+        /**
+         * Number of producers currently appending a record.
+         */
+        std::atomic<unsigned int>   appenders;
+
+        /**
+         * Synchronisation thread is writing segments taken from the list,
+         * set and tested under the segments lock.
+         */
+        std::atomic<bool>           synchronising;
+
+        /**
+         * Number of segments sealed by producers, so that consumer notices
+         * a segment sealed after all its records had been acknowledged.
+         */
+        std::atomic<unsigned int>   rotations;
+
+        /**
+         * Whether some segment may be released and the number of rotations
+         * seen when segments were last released, both owned by consumer.
+         */
+        struct
+        {
+            bool                    pending;
+            unsigned int            rotations;
+        }
+        reclamation;
+
+        /**
+         * Number of records which are only on disk, by lane.
+         */
+        std::atomic<unsigned int>   spilledRecords[Dispatcher::SpoolLanes];
+
+        /**
+         * Where consumer continues to look for spilled records of each lane,
+         * so that a lane which is full does not hold back the others.
+         */
+        struct
+        {
+            unsigned int            sequence;
+            uint32_t                offset;
+        }
+        scan[Dispatcher::SpoolLanes];
+
+    public:
+        Spool(
+            const std::string&  directoryPath,
+            const uint32_t      segmentSize,
+            const unsigned int  maximalSegments,
+            const unsigned int  syncInterval);
+
+        ~Spool();
+
+        unsigned int
+        replay();
+
+        void
+        start();
+
+        bool
+        append(
+            Dispatcher::Aviso*,
+            const Dispatcher::SpoolRecordState,
+            const unsigned int                  lane);
+
+        void
+        acknowledge(Dispatcher::Aviso*);
+
+        void
+        acknowledge(
+            Dispatcher::SpoolSegment*   segment,
+            const uint32_t              offset);
+
+        unsigned int
+        spilled(const unsigned int lane)
+        { return this->spilledRecords[lane].load(std::memory_order_acquire); }
+
+        unsigned int
+        spilled();
+
+        Dispatcher::Aviso*
+        peekSpilled(const unsigned int lane);
+
+        void
+        resident(Dispatcher::Aviso*);
+
+    private:
+        Dispatcher::SpoolSegment*
+        createSegment(const unsigned int baseAvisoId);
+
+        Dispatcher::SpoolSegment*
+        openSegment(const unsigned int sequence);
+
+        bool
+        rotate(
+            Dispatcher::SpoolSegment*   full,
+            const unsigned int          avisoId);
+
+        void
+        reclaim();
+
+        Dispatcher::SpoolSegment*
+        segmentBySequence(
+            const unsigned int  sequence,
+            const unsigned int  lane);
+
+        std::string
+        segmentFilePath(const unsigned int sequence);
+
+        static void
+        ThreadHandler(Dispatcher::Spool*);
+    };
+
+    class SpoolError : public std::runtime_error
+    {
+    public:
+        int errorNumber;
+
+    public:
+        SpoolError(const char* const reason, int errorNumber) throw() :
+        std::runtime_error(reason),
+        errorNumber(errorNumber)
+        { }
+    };
+};
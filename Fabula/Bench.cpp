@@ -0,0 +1,706 @@
+// System definition files.
+//
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdbool>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Common definition files.
+//
+#include "Toolkit/Times.hpp"
+
+// Local definition files.
+//
+#include "Servus/Fabula/Client.hpp"
+#include "Servus/Fabula/Connection.hpp"
+
+/**
+ * Connections not woken up by an event are looked after at least that often. Milliseconds.
+ */
+static const int SweepInterval = 10;
+
+static const unsigned int MaximalEvents = 256;
+
+/**
+ * Pause of a thread driving clients once all of them are full. Microseconds.
+ */
+static const unsigned int ClientPause = 100;
+
+struct Options
+{
+    std::string     address;
+    unsigned short  portNumber;
+    unsigned int    numberOfFabulators;
+    unsigned int    numberOfThreads;
+    unsigned int    duration;
+    unsigned int    warmUp;
+    unsigned int    payloadLength;
+    unsigned int    pipelineDepth;
+    unsigned short  severityLevel;
+
+    /**
+     * Whether fabulators go through Fabula::Client, each with a thread of its own,
+     * instead of connections driven by the threads of the bench.
+     */
+    bool            throughClient;
+    unsigned int    bufferCapacity;
+};
+
+/**
+ * Simulated fabulators served by one thread, each keeping its pipeline full.
+ */
+class Worker
+{
+private:
+    const Options&                      options;
+    unsigned int                        workerIndex;
+    unsigned int                        firstFabulator;
+    unsigned int                        numberOfFabulators;
+
+    struct Fabulator
+    {
+        Fabula::Connection*             connection;
+
+        /**
+         * Socket as registered with epoll and disconnections counted when it was.
+         */
+        int                             registeredSocket;
+        uint32_t                        registeredEvents;
+        unsigned long                   registeredGeneration;
+    };
+
+    std::vector<Fabulator>              fabulators;
+    int                                 epollDescriptor;
+
+    /**
+     * Fabulator going through a client, counted by the thread of the client.
+     */
+    struct ClientFabulator
+    {
+        Fabula::Client*                 client;
+
+        std::vector<uint32_t>           latencies;
+        unsigned long                   delivered;
+        unsigned long                   rejected;
+    };
+
+    std::vector<ClientFabulator>        clientFabulators;
+
+    std::string                         timestamp;
+    unsigned long                       sequence;
+
+    uint64_t                            measureFrom;
+    uint64_t                            measureUntil;
+
+public:
+    std::thread                         thread;
+
+    std::vector<uint32_t>               latencies;
+    unsigned long                       delivered;
+    unsigned long                       rejected;
+    unsigned long                       deferred;
+    unsigned long                       disconnections;
+    unsigned long                       dropped;
+
+public:
+    Worker(
+        const Options&      options,
+        const unsigned int  workerIndex,
+        const unsigned int  firstFabulator,
+        const unsigned int  numberOfFabulators) :
+    options(options),
+    workerIndex(workerIndex),
+    firstFabulator(firstFabulator),
+    numberOfFabulators(numberOfFabulators),
+    epollDescriptor(-1),
+    sequence(0),
+    measureFrom(0),
+    measureUntil(0),
+    delivered(0),
+    rejected(0),
+    deferred(0),
+    disconnections(0),
+    dropped(0)
+    { }
+
+    void
+    start(
+        const uint64_t  measureFrom,
+        const uint64_t  measureUntil)
+    {
+        this->measureFrom = measureFrom;
+        this->measureUntil = measureUntil;
+
+        this->thread = std::thread(
+                (this->options.throughClient == true) ? &Worker::runClients : &Worker::run,
+                this);
+    }
+
+private:
+    void
+    run();
+
+    void
+    runClients();
+
+    void
+    compose(std::string& message);
+
+    void
+    refill(Fabulator&);
+
+    void
+    watch(
+        Fabulator&          fabulator,
+        const unsigned int  fabulatorIndex);
+
+    void
+    complete(
+        const Fabula::Record&   record,
+        const unsigned int      statusCode);
+};
+
+void
+Worker::run()
+{
+    this->epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epollDescriptor == -1)
+    {
+        fprintf(stderr, "Cannot create epoll descriptor\n");
+        return;
+    }
+
+    this->timestamp = Toolkit::Timestamp().floatString();
+
+    char fabulatorName[32];
+
+    this->fabulators.resize(this->numberOfFabulators);
+
+    for (unsigned int fabulatorIndex = 0;
+         fabulatorIndex < this->numberOfFabulators;
+         fabulatorIndex++)
+    {
+        snprintf(fabulatorName, sizeof(fabulatorName), "bench-%u",
+                this->firstFabulator + fabulatorIndex);
+
+        Fabulator& fabulator = this->fabulators[fabulatorIndex];
+
+        fabulator.connection = new Fabula::Connection(
+                fabulatorName,
+                this->options.address,
+                this->options.portNumber,
+                this->options.pipelineDepth,
+                [this] (const Fabula::Record& record, const unsigned int statusCode)
+                { this->complete(record, statusCode); });
+
+        fabulator.registeredSocket = -1;
+        fabulator.registeredEvents = 0;
+        fabulator.registeredGeneration = 0;
+    }
+
+    struct epoll_event events[MaximalEvents];
+
+    uint64_t lastSweep = 0;
+
+    for (;;)
+    {
+        const uint64_t now = Fabula::NowMilliseconds();
+
+        if (now >= this->measureUntil)
+            break;
+
+        // Every fabulator is looked after now and then, so that those waiting
+        // for a reconnect or held back by the listener are not forgotten.
+        //
+        if (now - lastSweep >= (uint64_t) SweepInterval)
+        {
+            lastSweep = now;
+
+            this->timestamp = Toolkit::Timestamp().floatString();
+
+            for (unsigned int fabulatorIndex = 0;
+                 fabulatorIndex < this->numberOfFabulators;
+                 fabulatorIndex++)
+            {
+                Fabulator& fabulator = this->fabulators[fabulatorIndex];
+
+                this->refill(fabulator);
+
+                fabulator.connection->process(0);
+
+                this->watch(fabulator, fabulatorIndex);
+            }
+        }
+
+        const int numberOfEvents = epoll_wait(this->epollDescriptor,
+                events, MaximalEvents, SweepInterval);
+
+        for (int eventIndex = 0; eventIndex < numberOfEvents; eventIndex++)
+        {
+            const unsigned int fabulatorIndex = events[eventIndex].data.u32;
+
+            Fabulator& fabulator = this->fabulators[fabulatorIndex];
+
+            // Poll and epoll share the values of the events.
+            //
+            fabulator.connection->process((short) events[eventIndex].events);
+
+            // Refill the pipeline as soon as answers have made room in it.
+            //
+            this->refill(fabulator);
+
+            fabulator.connection->process(0);
+
+            this->watch(fabulator, fabulatorIndex);
+        }
+    }
+
+    for (unsigned int fabulatorIndex = 0;
+         fabulatorIndex < this->numberOfFabulators;
+         fabulatorIndex++)
+    {
+        Fabula::Connection* connection = this->fabulators[fabulatorIndex].connection;
+
+        this->deferred += connection->statistics.deferred;
+        this->disconnections += connection->statistics.disconnections;
+
+        delete connection;
+    }
+
+    close(this->epollDescriptor);
+}
+
+/**
+ * @brief   Message of the next fabula.
+ *
+ * Every fabula tells a message of its own, so that the listener does not fold them.
+ */
+void
+Worker::compose(std::string& message)
+{
+    char prefix[64];
+
+    const int prefixLength = snprintf(prefix, sizeof(prefix), "Bench %u-%lu ",
+            this->workerIndex, this->sequence++);
+
+    message.assign(prefix, prefixLength);
+
+    if (message.length() < this->options.payloadLength)
+        message.resize(this->options.payloadLength, '.');
+}
+
+/**
+ * @brief   Keep the clients of the thread full, each of which sends from a thread of its own.
+ */
+void
+Worker::runClients()
+{
+    char fabulatorName[32];
+
+    this->clientFabulators.resize(this->numberOfFabulators);
+
+    for (unsigned int fabulatorIndex = 0;
+         fabulatorIndex < this->numberOfFabulators;
+         fabulatorIndex++)
+    {
+        snprintf(fabulatorName, sizeof(fabulatorName), "bench-%u",
+                this->firstFabulator + fabulatorIndex);
+
+        ClientFabulator* fabulator = &this->clientFabulators[fabulatorIndex];
+
+        fabulator->delivered = 0;
+        fabulator->rejected = 0;
+
+        const uint64_t measureFrom = this->measureFrom;
+        const uint64_t measureUntil = this->measureUntil;
+
+        fabulator->client = new Fabula::Client(
+                fabulatorName,
+                this->options.address,
+                this->options.portNumber,
+                this->options.bufferCapacity,
+                this->options.pipelineDepth,
+                [fabulator, measureFrom, measureUntil]
+                (const Fabula::Record& record, const unsigned int statusCode)
+                {
+                    const uint64_t now = Fabula::NowNanoseconds();
+
+                    if ((now / 1000000 < measureFrom) || (now / 1000000 >= measureUntil))
+                        return;
+
+                    if (statusCode != 201)
+                    {
+                        fabulator->rejected++;
+                        return;
+                    }
+
+                    fabulator->delivered++;
+
+                    const uint64_t microseconds = (now - record.submitted) / 1000;
+
+                    fabulator->latencies.push_back((microseconds > UINT32_MAX)
+                            ? UINT32_MAX
+                            : (uint32_t) microseconds);
+                });
+    }
+
+    std::string message;
+
+    while (Fabula::NowMilliseconds() < this->measureUntil)
+    {
+        bool sent = false;
+
+        for (ClientFabulator& fabulator : this->clientFabulators)
+        {
+            while (fabulator.client->backlog() < this->options.bufferCapacity)
+            {
+                this->compose(message);
+
+                if (fabulator.client->send(this->options.severityLevel, false, message) == false)
+                    break;
+
+                sent = true;
+            }
+        }
+
+        if (sent == false)
+            std::this_thread::sleep_for(std::chrono::microseconds { ClientPause });
+    }
+
+    // Clients are stopped before their counters are read.
+    //
+    for (ClientFabulator& fabulator : this->clientFabulators)
+    {
+        this->dropped += fabulator.client->statistics.dropped.load(std::memory_order_relaxed);
+
+        delete fabulator.client;
+
+        this->latencies.insert(this->latencies.end(),
+                fabulator.latencies.begin(),
+                fabulator.latencies.end());
+        this->delivered += fabulator.delivered;
+        this->rejected += fabulator.rejected;
+    }
+}
+
+/**
+ * @brief   Submit new fabulas until the pipeline of the fabulator is full.
+ */
+void
+Worker::refill(Fabulator& fabulator)
+{
+    while (fabulator.connection->backlog() < this->options.pipelineDepth)
+    {
+        Fabula::Record record;
+        record.timestamp = this->timestamp;
+        record.severityLevel = this->options.severityLevel;
+        record.notificationFlag = false;
+
+        this->compose(record.message);
+
+        record.submitted = Fabula::NowNanoseconds();
+
+        fabulator.connection->submit(std::move(record));
+    }
+}
+
+/**
+ * @brief   Bring the registration of the socket of a fabulator with epoll up to date.
+ *
+ * A closed socket leaves epoll by itself, and a new one may get the same number,
+ * so that a socket is registered anew whenever the connection was broken meanwhile.
+ */
+void
+Worker::watch(
+    Fabulator&          fabulator,
+    const unsigned int  fabulatorIndex)
+{
+    const int socket = fabulator.connection->socket();
+    const uint32_t events = (uint32_t) fabulator.connection->events();
+    const unsigned long generation = fabulator.connection->statistics.disconnections;
+
+    if (socket == -1)
+    {
+        fabulator.registeredSocket = -1;
+        return;
+    }
+
+    struct epoll_event event;
+    event.events = events;
+    event.data.u32 = fabulatorIndex;
+
+    if ((socket != fabulator.registeredSocket) ||
+            (generation != fabulator.registeredGeneration))
+    {
+        if (epoll_ctl(this->epollDescriptor, EPOLL_CTL_ADD, socket, &event) != 0)
+            epoll_ctl(this->epollDescriptor, EPOLL_CTL_MOD, socket, &event);
+    }
+    else if (events != fabulator.registeredEvents)
+    {
+        epoll_ctl(this->epollDescriptor, EPOLL_CTL_MOD, socket, &event);
+    }
+
+    fabulator.registeredSocket = socket;
+    fabulator.registeredEvents = events;
+    fabulator.registeredGeneration = generation;
+}
+
+/**
+ * @brief   Count an answered fabula and its latency if it was answered within the measurement.
+ */
+void
+Worker::complete(
+    const Fabula::Record&   record,
+    const unsigned int      statusCode)
+{
+    const uint64_t now = Fabula::NowNanoseconds();
+
+    if ((now / 1000000 < this->measureFrom) || (now / 1000000 >= this->measureUntil))
+        return;
+
+    if (statusCode != 201)
+    {
+        this->rejected++;
+        return;
+    }
+
+    this->delivered++;
+
+    const uint64_t microseconds = (now - record.submitted) / 1000;
+
+    this->latencies.push_back((microseconds > UINT32_MAX)
+            ? UINT32_MAX
+            : (uint32_t) microseconds);
+}
+
+static void
+Usage(const char* const programName)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -a address   IPv4 address of the listener (127.0.0.1)\n"
+            "  -p port      Port of the listener (15101)\n"
+            "  -u path      Path of the socket of a UNIX domain listener instead\n"
+            "  -f number    Simulated fabulators (1000)\n"
+            "  -t number    Threads (4)\n"
+            "  -d seconds   Duration of the measurement (10)\n"
+            "  -w seconds   Warm up before the measurement (1)\n"
+            "  -s bytes     Length of the message of each fabula (128)\n"
+            "  -q number    Pipeline depth of each fabulator (%u)\n"
+            "  -l level     Severity level (1)\n"
+            "  -m mode      \"connection\" to drive connections from the threads of the bench,\n"
+            "               \"client\" to go through a client with a thread of its own\n"
+            "               per fabulator (connection)\n"
+            "  -b number    Capacity of each client (twice the pipeline depth)\n",
+            programName,
+            Fabula::DefaultPipelineDepth);
+}
+
+/**
+ * @brief   Latency below which the given fraction of the sorted latencies lies.
+ */
+static uint32_t
+Percentile(
+    const std::vector<uint32_t>&    latencies,
+    const double                    fraction)
+{
+    if (latencies.empty() == true)
+        return 0;
+
+    size_t index = (size_t) (fraction * latencies.size());
+
+    if (index >= latencies.size())
+        index = latencies.size() - 1;
+
+    return latencies[index];
+}
+
+int
+main(int argc, char* argv[])
+{
+    Options options;
+    options.address = "127.0.0.1";
+    options.portNumber = 15101;
+    options.numberOfFabulators = 1000;
+    options.numberOfThreads = 4;
+    options.duration = 10;
+    options.warmUp = 1;
+    options.payloadLength = 128;
+    options.pipelineDepth = Fabula::DefaultPipelineDepth;
+    options.severityLevel = 1;
+    options.throughClient = false;
+    options.bufferCapacity = 0;
+
+    int option;
+
+    while ((option = getopt(argc, argv, "a:p:u:f:t:d:w:s:q:l:m:b:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'a':
+                options.address = optarg;
+                break;
+
+            case 'p':
+                options.portNumber = atoi(optarg);
+                break;
+
+            case 'u':
+                options.address = optarg;
+                options.portNumber = 0;
+                break;
+
+            case 'f':
+                options.numberOfFabulators = atoi(optarg);
+                break;
+
+            case 't':
+                options.numberOfThreads = atoi(optarg);
+                break;
+
+            case 'd':
+                options.duration = atoi(optarg);
+                break;
+
+            case 'w':
+                options.warmUp = atoi(optarg);
+                break;
+
+            case 's':
+                options.payloadLength = atoi(optarg);
+                break;
+
+            case 'q':
+                options.pipelineDepth = atoi(optarg);
+                break;
+
+            case 'l':
+                options.severityLevel = atoi(optarg);
+                break;
+
+            case 'm':
+                if (strcmp(optarg, "client") == 0)
+                {
+                    options.throughClient = true;
+                }
+                else if (strcmp(optarg, "connection") == 0)
+                {
+                    options.throughClient = false;
+                }
+                else
+                {
+                    Usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'b':
+                options.bufferCapacity = atoi(optarg);
+                break;
+
+            default:
+                Usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if ((options.numberOfFabulators == 0) ||
+            (options.numberOfThreads == 0) ||
+            (options.duration == 0) ||
+            (options.pipelineDepth == 0))
+    {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    options.numberOfThreads = std::min(options.numberOfThreads, options.numberOfFabulators);
+
+    if (options.bufferCapacity == 0)
+        options.bufferCapacity = 2 * options.pipelineDepth;
+
+    const uint64_t measureFrom = Fabula::NowMilliseconds() + options.warmUp * 1000;
+    const uint64_t measureUntil = measureFrom + options.duration * 1000;
+
+    std::vector<Worker*> workers;
+
+    unsigned int firstFabulator = 0;
+
+    for (unsigned int workerIndex = 0;
+         workerIndex < options.numberOfThreads;
+         workerIndex++)
+    {
+        const unsigned int numberOfFabulators =
+                (options.numberOfFabulators - firstFabulator) /
+                (options.numberOfThreads - workerIndex);
+
+        Worker* worker = new Worker(options, workerIndex, firstFabulator, numberOfFabulators);
+
+        worker->start(measureFrom, measureUntil);
+
+        workers.push_back(worker);
+
+        firstFabulator += numberOfFabulators;
+    }
+
+    std::vector<uint32_t> latencies;
+    unsigned long delivered = 0;
+    unsigned long rejected = 0;
+    unsigned long deferred = 0;
+    unsigned long disconnections = 0;
+    unsigned long dropped = 0;
+
+    for (Worker* worker : workers)
+    {
+        worker->thread.join();
+
+        latencies.insert(latencies.end(), worker->latencies.begin(), worker->latencies.end());
+        delivered += worker->delivered;
+        rejected += worker->rejected;
+        deferred += worker->deferred;
+        disconnections += worker->disconnections;
+        dropped += worker->dropped;
+
+        delete worker;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("Fabulators      %u %s on %u threads, pipeline depth %u, %u bytes per fabula\n",
+            options.numberOfFabulators,
+            (options.throughClient == true) ? "clients" : "connections",
+            options.numberOfThreads,
+            options.pipelineDepth,
+            options.payloadLength);
+    printf("Delivered       %lu in %u s, %.0f fabulas/s\n",
+            delivered,
+            options.duration,
+            (double) delivered / options.duration);
+    printf("Rejected        %lu\n", rejected);
+    if (options.throughClient == true)
+    {
+        printf("Dropped         %lu\n", dropped);
+    }
+    else
+    {
+        printf("Deferred        %lu\n", deferred);
+        printf("Disconnections  %lu\n", disconnections);
+    }
+    printf("Latency         p50 %u us, p90 %u us, p99 %u us, p99.9 %u us, max %u us\n",
+            Percentile(latencies, 0.50),
+            Percentile(latencies, 0.90),
+            Percentile(latencies, 0.99),
+            Percentile(latencies, 0.999),
+            (latencies.empty() == true) ? 0 : latencies.back());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+// System definition files.
+//
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdbool>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Common definition files.
+//
+#include "Toolkit/Times.hpp"
+
+// Local definition files.
+//
+#include "Servus/Fabula/Client.hpp"
+#include "Servus/Fabula/Connection.hpp"
+
+/**
+ * @brief   Start the thread of the client, which connects to the listener with the first fabula.
+ *
+ * @param   portNumber      Port of the listener, zero if the address is the path
+ *                          of a UNIX domain socket.
+ * @param   completion      Optional, called by the thread of the client
+ *                          with each fabula answered by the listener.
+ *
+ * @throw   ClientError     If the thread cannot be woken up.
+ */
+Fabula::Client::Client(
+    const std::string&      fabulatorName,
+    const std::string&      address,
+    const unsigned short    portNumber,
+    const size_t            bufferCapacity,
+    const unsigned int      pipelineDepth,
+    const Fabula::Connection::Completion& completion) :
+running(true),
+bufferCapacity(bufferCapacity),
+outstanding(0),
+connection(fabulatorName, address, portNumber, pipelineDepth,
+        std::bind(&Fabula::Client::complete, this,
+                std::placeholders::_1, std::placeholders::_2)),
+completion(completion)
+{
+    this->statistics.delivered.store(0, std::memory_order_relaxed);
+    this->statistics.rejected.store(0, std::memory_order_relaxed);
+    this->statistics.dropped.store(0, std::memory_order_relaxed);
+
+    this->eventDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->eventDescriptor == -1)
+        throw Fabula::ClientError("[Fabula] Cannot create event descriptor");
+
+    this->thread = std::thread(&Fabula::Client::run, this);
+}
+
+/**
+ * @brief   Stop the thread of the client. Fabulas not yet answered are lost.
+ */
+Fabula::Client::~Client()
+{
+    this->running.store(false, std::memory_order_relaxed);
+
+    const uint64_t one = 1;
+    (void) write(this->eventDescriptor, &one, sizeof(one));
+
+    this->thread.join();
+
+    close(this->eventDescriptor);
+}
+
+/**
+ * @brief   Buffer a fabula to be sent by the thread of the client.
+ *
+ * @return  Boolean false if the capacity is used up and the fabula has been dropped.
+ */
+bool
+Fabula::Client::send(
+    const unsigned short    severityLevel,
+    const bool              notificationFlag,
+    const std::string&      message)
+{
+    Fabula::Record record;
+    record.timestamp = Toolkit::Timestamp().floatString();
+    record.severityLevel = severityLevel;
+    record.notificationFlag = notificationFlag;
+    record.message = message;
+    record.submitted = Fabula::NowNanoseconds();
+
+    bool wakeUp;
+
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+
+        if (this->buffer.size() + this->outstanding >= this->bufferCapacity)
+        {
+            this->statistics.dropped.fetch_add(1, std::memory_order_relaxed);
+
+            return false;
+        }
+
+        // The thread is woken up only for the first fabula of a batch.
+        //
+        wakeUp = this->buffer.empty();
+
+        this->buffer.push_back(std::move(record));
+    }
+
+    if (wakeUp == true)
+    {
+        const uint64_t one = 1;
+        (void) write(this->eventDescriptor, &one, sizeof(one));
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Fabulas sent and not yet answered by the listener.
+ */
+size_t
+Fabula::Client::backlog()
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    return this->buffer.size() + this->outstanding;
+}
+
+/**
+ * @brief   Wait until every fabula sent so far has been answered by the listener.
+ *
+ * @return  Boolean false if the time has passed first.
+ */
+bool
+Fabula::Client::drain(const std::chrono::milliseconds duration)
+{
+    std::unique_lock<std::mutex> lock(this->lock);
+
+    return this->drained.wait_for(lock, duration,
+            [this] { return (this->buffer.empty() == true) && (this->outstanding == 0); });
+}
+
+void
+Fabula::Client::run()
+{
+    std::deque<Fabula::Record> batch;
+
+    this->connection.process(0);
+
+    while (this->running.load(std::memory_order_relaxed) == true)
+    {
+        struct pollfd descriptors[2];
+
+        descriptors[0].fd = this->eventDescriptor;
+        descriptors[0].events = POLLIN;
+        descriptors[0].revents = 0;
+
+        descriptors[1].fd = this->connection.socket();
+        descriptors[1].events = this->connection.events();
+        descriptors[1].revents = 0;
+
+        const int numberOfEvents = poll(descriptors, 2, this->connection.timeout());
+
+        if ((numberOfEvents == -1) && (errno != EINTR))
+            break;
+
+        if ((descriptors[0].revents & POLLIN) != 0)
+        {
+            uint64_t counter;
+            (void) read(this->eventDescriptor, &counter, sizeof(counter));
+
+            {
+                std::lock_guard<std::mutex> lock(this->lock);
+
+                this->outstanding += this->buffer.size();
+
+                batch.swap(this->buffer);
+            }
+
+            while (batch.empty() == false)
+            {
+                this->connection.submit(std::move(batch.front()));
+                batch.pop_front();
+            }
+        }
+
+        this->connection.process(descriptors[1].revents);
+    }
+}
+
+/**
+ * @brief   Count a fabula answered by the listener and wake up those draining.
+ */
+void
+Fabula::Client::complete(
+    const Fabula::Record&   record,
+    const unsigned int      statusCode)
+{
+    if (statusCode == 201)
+        this->statistics.delivered.fetch_add(1, std::memory_order_relaxed);
+    else
+        this->statistics.rejected.fetch_add(1, std::memory_order_relaxed);
+
+    if (this->completion)
+        this->completion(record, statusCode);
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    this->outstanding--;
+
+    if ((this->buffer.empty() == true) && (this->outstanding == 0))
+        this->drained.notify_all();
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+// System definition files.
+//
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdbool>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Local definition files.
+//
+#include "Servus/Fabula/Connection.hpp"
+
+namespace Fabula
+{
+    /**
+     * Fabulas buffered by a client before new ones are dropped.
+     */
+    static const unsigned int DefaultBufferCapacity = 4 * 1024;
+
+    /**
+     * Fabulator sending fabulas to a Fabulatorium listener from any thread.
+     *
+     * send() never blocks. Fabulas are taken from the buffer by a thread of the client,
+     * which keeps a connection to the listener open and sends them in batches.
+     * The capacity bounds the fabulas buffered and those not yet answered together.
+     * A fabula beyond it is dropped and counted.
+     */
+    class Client
+    {
+    private:
+        std::thread             thread;
+        std::atomic<bool>       running;
+        int                     eventDescriptor;
+
+        std::mutex              lock;
+        std::condition_variable drained;
+        std::deque<Fabula::Record> buffer;
+        size_t                  bufferCapacity;
+
+        /**
+         * Fabulas taken from the buffer and not yet answered, guarded by the lock.
+         */
+        size_t                  outstanding;
+
+        Fabula::Connection      connection;
+
+        /**
+         * Called by the thread of the client with each fabula answered by the listener.
+         */
+        Fabula::Connection::Completion  completion;
+
+    public:
+        struct
+        {
+            std::atomic<unsigned long>  delivered;
+            std::atomic<unsigned long>  rejected;
+            std::atomic<unsigned long>  dropped;
+        }
+        statistics;
+
+    public:
+        Client(
+            const std::string&      fabulatorName,
+            const std::string&      address,
+            const unsigned short    portNumber,
+            const size_t            bufferCapacity = Fabula::DefaultBufferCapacity,
+            const unsigned int      pipelineDepth = Fabula::DefaultPipelineDepth,
+            const Fabula::Connection::Completion& completion = Fabula::Connection::Completion());
+
+        ~Client();
+
+        bool
+        send(
+            const unsigned short    severityLevel,
+            const bool              notificationFlag,
+            const std::string&      message);
+
+        size_t
+        backlog();
+
+        bool
+        drain(const std::chrono::milliseconds);
+
+    private:
+        void
+        run();
+
+        void
+        complete(
+            const Fabula::Record&   record,
+            const unsigned int      statusCode);
+    };
+
+    class ClientError : public std::runtime_error
+    {
+    public:
+        ClientError(const char* const reason) throw() :
+        std::runtime_error(reason)
+        { }
+    };
+};
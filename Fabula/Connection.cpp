@@ -0,0 +1,562 @@
+// System definition files.
+//
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdbool>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/ReceiveRing.hpp"
+#include "Servus/Fabula/Connection.hpp"
+
+Fabula::Connection::Connection(
+    const std::string&              fabulatorName,
+    const std::string&              address,
+    const unsigned short            portNumber,
+    const unsigned int              pipelineDepth,
+    const Fabula::Connection::Completion& completion) :
+fabulatorName(fabulatorName),
+address(address),
+portNumber(portNumber),
+descriptor(-1),
+state(Closed),
+configuredPipelineDepth((pipelineDepth == 0) ? 1 : pipelineDepth),
+pipelineDepth((pipelineDepth == 0) ? 1 : pipelineDepth),
+nextCSeq(1),
+requeued(0),
+holdUntil(0),
+reconnectAt(0),
+backoff(Fabula::ReconnectBackoffInitial),
+completion(completion)
+{
+    this->transmission.sentBytes = 0;
+
+    this->reception.length = 0;
+
+    this->statistics.delivered = 0;
+    this->statistics.rejected = 0;
+    this->statistics.deferred = 0;
+    this->statistics.disconnections = 0;
+}
+
+Fabula::Connection::~Connection()
+{
+    if (this->descriptor != -1)
+        close(this->descriptor);
+}
+
+/**
+ * @brief   Append a fabula to those waiting to be sent.
+ *
+ * The fabula is sent by the next call of process().
+ */
+void
+Fabula::Connection::submit(Fabula::Record&& record)
+{
+    this->waiting.push_back(std::move(record));
+}
+
+/**
+ * @brief   Events the owner has to poll the socket for.
+ */
+short
+Fabula::Connection::events() const
+{
+    switch (this->state)
+    {
+        case Closed:
+            return 0;
+
+        case Connecting:
+            return POLLOUT;
+
+        default:
+            return (this->transmission.sentBytes < this->transmission.output.length())
+                    ? POLLIN | POLLOUT
+                    : POLLIN;
+    }
+}
+
+/**
+ * @brief   Time until process() has to be called even if no event has come.
+ *
+ * @return  Milliseconds, -1 if there is nothing to wait for.
+ */
+int
+Fabula::Connection::timeout() const
+{
+    uint64_t until;
+
+    if ((this->state == Closed) && (this->waiting.empty() == false))
+    {
+        until = this->reconnectAt;
+    }
+    else if ((this->state == Established) &&
+            (this->waiting.empty() == false) &&
+            (this->holdUntil != 0))
+    {
+        until = this->holdUntil;
+    }
+    else
+    {
+        return -1;
+    }
+
+    const uint64_t now = Fabula::NowMilliseconds();
+
+    return (until > now) ? (int) (until - now) : 0;
+}
+
+/**
+ * @brief   Handle the events polled for the socket and send what may be sent.
+ *
+ * @param   events      Events returned by poll, zero if only the timeout has passed
+ *                      or fabulas have been submitted.
+ */
+void
+Fabula::Connection::process(const short events)
+{
+    if (this->state == Closed)
+    {
+        // The connection is opened only once there is something to send.
+        //
+        if ((this->waiting.empty() == false) &&
+                (Fabula::NowMilliseconds() >= this->reconnectAt))
+        {
+            this->open();
+        }
+
+        if (this->state == Closed)
+            return;
+    }
+
+    if (this->state == Connecting)
+    {
+        if ((events & (POLLOUT | POLLERR | POLLHUP)) == 0)
+            return;
+
+        int errorNumber;
+        socklen_t errorLength = sizeof(errorNumber);
+
+        if ((getsockopt(this->descriptor, SOL_SOCKET, SO_ERROR, &errorNumber, &errorLength) != 0) ||
+                (errorNumber != 0))
+        {
+            this->disconnect();
+            return;
+        }
+
+        this->state = Established;
+    }
+
+    if ((events & (POLLIN | POLLERR | POLLHUP)) != 0)
+    {
+        if (this->receiveResponses() == false)
+        {
+            this->disconnect();
+            return;
+        }
+    }
+
+    if (this->sendRequests() == false)
+        this->disconnect();
+}
+
+/**
+ * @brief   Begin to connect to the listener without waiting for the connection to be made.
+ */
+void
+Fabula::Connection::open()
+{
+    int result;
+
+    if (this->portNumber == 0)
+    {
+        this->descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (this->descriptor == -1)
+        {
+            this->disconnect();
+            return;
+        }
+
+        struct sockaddr_un socketAddress;
+        memset(&socketAddress, 0, sizeof(socketAddress));
+        socketAddress.sun_family = AF_UNIX;
+        strncpy(socketAddress.sun_path, this->address.c_str(), sizeof(socketAddress.sun_path) - 1);
+
+        result = connect(this->descriptor,
+                (struct sockaddr*) &socketAddress,
+                sizeof(socketAddress));
+    }
+    else
+    {
+        this->descriptor = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (this->descriptor == -1)
+        {
+            this->disconnect();
+            return;
+        }
+
+        // Requests are batched already, so that they should not wait for one another.
+        //
+        const int noDelay = 1;
+        setsockopt(this->descriptor, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        struct sockaddr_in socketAddress;
+        memset(&socketAddress, 0, sizeof(socketAddress));
+        socketAddress.sin_family = AF_INET;
+        socketAddress.sin_port = htons(this->portNumber);
+
+        if (inet_pton(AF_INET, this->address.c_str(), &socketAddress.sin_addr) != 1)
+        {
+            this->disconnect();
+            return;
+        }
+
+        result = connect(this->descriptor,
+                (struct sockaddr*) &socketAddress,
+                sizeof(socketAddress));
+    }
+
+    if (result == 0)
+    {
+        this->state = Established;
+    }
+    else if (errno == EINPROGRESS)
+    {
+        this->state = Connecting;
+    }
+    else
+    {
+        this->disconnect();
+    }
+}
+
+/**
+ * @brief   Close the connection and give the fabulas not yet answered back to those waiting.
+ *
+ * The next connect is tried after the backoff, which doubles with every
+ * disconnect until the listener has answered a fabula again. A connection
+ * closed while it was idle is opened again without delay.
+ */
+void
+Fabula::Connection::disconnect()
+{
+    const bool idle = (this->waiting.empty() == true) && (this->inFlight.empty() == true);
+
+    if (this->descriptor != -1)
+    {
+        close(this->descriptor);
+
+        this->descriptor = -1;
+    }
+
+    if (this->state != Closed)
+        this->statistics.disconnections++;
+
+    this->state = Closed;
+
+    this->waiting.insert(this->waiting.begin() + this->requeued,
+            std::make_move_iterator(this->inFlight.begin()),
+            std::make_move_iterator(this->inFlight.end()));
+    this->inFlight.clear();
+    this->requeued = 0;
+
+    this->transmission.output.clear();
+    this->transmission.sentBytes = 0;
+
+    this->reception.length = 0;
+
+    // A new session begins with CSeq one and tells its pipeline depth again.
+    //
+    this->nextCSeq = 1;
+    this->pipelineDepth = this->configuredPipelineDepth;
+    this->holdUntil = 0;
+
+    if (idle == true)
+    {
+        this->reconnectAt = 0;
+        this->backoff = Fabula::ReconnectBackoffInitial;
+    }
+    else
+    {
+        this->reconnectAt = Fabula::NowMilliseconds() + this->backoff;
+        this->backoff = std::min(this->backoff * 2, Fabula::ReconnectBackoffMaximal);
+    }
+}
+
+/**
+ * @brief   Receive whatever the socket has and handle all complete responses.
+ *
+ * @return  Boolean false if the connection is to be closed.
+ */
+bool
+Fabula::Connection::receiveResponses()
+{
+    static const char   Terminator[]        = "\r\n\r\n";
+    static const size_t TerminatorLength    = sizeof(Terminator) - 1;
+
+    for (;;)
+    {
+        // A response which does not fit into the buffer is never going to be complete.
+        //
+        if (this->reception.length == Fabula::MaximalResponseLength)
+            return false;
+
+        const ssize_t receivedBytes = recv(this->descriptor,
+                this->reception.buffer + this->reception.length,
+                Fabula::MaximalResponseLength - this->reception.length,
+                MSG_DONTWAIT);
+
+        if (receivedBytes == 0)
+            return false;
+
+        if (receivedBytes == -1)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                return true;
+
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        this->reception.length += receivedBytes;
+
+        uint32_t offset = 0;
+
+        try
+        {
+            for (;;)
+            {
+                const char* const begin = this->reception.buffer + offset;
+                const char* const end = this->reception.buffer + this->reception.length;
+
+                const char* terminator = std::search(begin, end,
+                        Terminator, Terminator + TerminatorLength);
+
+                if (terminator == end)
+                    break;
+
+                Dispatcher::DatagramView response;
+
+                response.parseHeader(begin,
+                        (terminator - begin) + TerminatorLength,
+                        Fabula::MaximalResponseLength - offset);
+
+                // Payload of the response has not arrived completely yet.
+                //
+                if (response.length > this->reception.length - offset)
+                    break;
+
+                if (this->handleResponse(response) == false)
+                    return false;
+
+                offset += response.length;
+            }
+        }
+        catch (Dispatcher::BrokenDatagram&)
+        {
+            return false;
+        }
+
+        this->reception.length -= offset;
+
+        memmove(this->reception.buffer,
+                this->reception.buffer + offset,
+                this->reception.length);
+    }
+}
+
+/**
+ * @brief   Complete the oldest fabula in flight with the response to it.
+ *
+ * A fabula the listener has held back is put in front of those waiting
+ * and sent again once the listener lets it.
+ *
+ * @return  Boolean false if the response does not match the fabula.
+ */
+bool
+Fabula::Connection::handleResponse(Dispatcher::DatagramView& response)
+{
+    if ((response.statusCode == 0) || (this->inFlight.empty() == true))
+        return false;
+
+    Dispatcher::DatagramSpan value;
+
+    if ((response.find("CSeq", value) == false) ||
+            (response.number("CSeq") != this->nextCSeq - this->inFlight.size()))
+    {
+        return false;
+    }
+
+    Fabula::Record record = std::move(this->inFlight.front());
+    this->inFlight.pop_front();
+
+    if (response.statusCode == 503)
+    {
+        this->statistics.deferred++;
+
+        const uint64_t retryAfter = (response.find("Retry-After", value) == true)
+                ? response.number("Retry-After") * 1000
+                : Fabula::DefaultRetryAfter;
+
+        this->holdUntil = std::max(this->holdUntil, Fabula::NowMilliseconds() + retryAfter);
+
+        // Fabulas behind it are still in flight, so that it goes in front of those waiting.
+        //
+        this->waiting.insert(this->waiting.begin() + this->requeued, std::move(record));
+        this->requeued++;
+
+        return true;
+    }
+
+    this->backoff = Fabula::ReconnectBackoffInitial;
+
+    if (response.statusCode == 201)
+    {
+        this->statistics.delivered++;
+
+        if (response.find("Pipeline-Depth", value) == true)
+        {
+            const unsigned long pipelineDepth = response.number("Pipeline-Depth");
+
+            if (pipelineDepth != 0)
+            {
+                this->pipelineDepth = std::min(this->configuredPipelineDepth,
+                        (unsigned int) pipelineDepth);
+            }
+        }
+    }
+    else
+    {
+        this->statistics.rejected++;
+    }
+
+    if (this->completion)
+        this->completion(record, response.statusCode);
+
+    return true;
+}
+
+/**
+ * @brief   Encode as many waiting fabulas as the pipeline allows and send them at once.
+ *
+ * @return  Boolean false if the connection is to be closed.
+ */
+bool
+Fabula::Connection::sendRequests()
+{
+    if (this->state != Established)
+        return true;
+
+    if (this->transmission.sentBytes == this->transmission.output.length())
+    {
+        this->transmission.output.clear();
+        this->transmission.sentBytes = 0;
+
+        if (this->holdUntil != 0)
+        {
+            if (Fabula::NowMilliseconds() < this->holdUntil)
+                return true;
+
+            this->holdUntil = 0;
+        }
+
+        this->requeued = 0;
+
+        while ((this->waiting.empty() == false) &&
+                (this->inFlight.size() < this->pipelineDepth) &&
+                (this->transmission.output.length() < Fabula::MaximalBatchLength))
+        {
+            this->encode(this->waiting.front(), this->nextCSeq);
+
+            this->nextCSeq++;
+
+            this->inFlight.push_back(std::move(this->waiting.front()));
+            this->waiting.pop_front();
+        }
+    }
+
+    while (this->transmission.sentBytes < this->transmission.output.length())
+    {
+        const ssize_t sentBytes = send(this->descriptor,
+                this->transmission.output.data() + this->transmission.sentBytes,
+                this->transmission.output.length() - this->transmission.sentBytes,
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (sentBytes == -1)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                return true;
+
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        this->transmission.sentBytes += sentBytes;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Append a FABULA request to the transmission.
+ */
+void
+Fabula::Connection::encode(
+    const Fabula::Record&   record,
+    const unsigned int      cseq)
+{
+    char field[64];
+
+    std::string& output = this->transmission.output;
+
+    snprintf(field, sizeof(field), "%u", cseq);
+
+    output += "FABULA rtsp://servus RTSP/1.0\r\nCSeq: ";
+    output += field;
+    output += "\r\nTimestamp: ";
+    output += record.timestamp;
+    output += "\r\nOriginator: ";
+    output += this->fabulatorName;
+
+    snprintf(field, sizeof(field),
+            "\r\nSeverity: %u\r\nNotification: %s\r\nContent-Length: %zu\r\n\r\n",
+            record.severityLevel,
+            (record.notificationFlag == true) ? "true" : "false",
+            record.message.length());
+
+    output += field;
+    output += record.message;
+}
+
+uint64_t
+Fabula::NowMilliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t
+Fabula::NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
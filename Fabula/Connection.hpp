@@ -0,0 +1,216 @@
+#pragma once
+
+// System definition files.
+//
+#include <cstdbool>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/ReceiveRing.hpp"
+
+namespace Fabula
+{
+    /**
+     * Requests kept outstanding on a connection unless the listener allows fewer.
+     */
+    static const unsigned int DefaultPipelineDepth = 16;
+
+    /**
+     * Requests encoded for one send are cut off beyond this length.
+     */
+    static const unsigned int MaximalBatchLength = 64 * 1024;
+
+    /**
+     * Responses are received into a buffer of this size owned by the connection.
+     */
+    static const unsigned int MaximalResponseLength = 4 * 1024;
+
+    /**
+     * Wait before the first reconnect, doubled with each failure in a row
+     * up to the maximum. Milliseconds.
+     */
+    static const unsigned int ReconnectBackoffInitial = 10;
+    static const unsigned int ReconnectBackoffMaximal = 5000;
+
+    /**
+     * Wait before a fabula held back by the listener is sent again,
+     * if the listener does not tell. Milliseconds.
+     */
+    static const unsigned int DefaultRetryAfter = 100;
+
+    struct Record
+    {
+        std::string         timestamp;
+        unsigned short      severityLevel;
+        bool                notificationFlag;
+        std::string         message;
+
+        /**
+         * Steady time in nanoseconds the record was submitted at.
+         */
+        uint64_t            submitted;
+    };
+
+    /**
+     * Connection of a fabulator to a Fabulatorium listener, over TCP or a UNIX domain socket.
+     *
+     * The connection is opened once there is a fabula to send. It never blocks and is
+     * driven by its owner, who polls its socket for events() and calls process()
+     * whenever they have come, fabulas have been submitted or timeout() has passed.
+     * Submitted fabulas are sent in batches, as many at once as the pipeline allows,
+     * and handed to the completion once the listener has answered them. Fabulas
+     * the listener held back, or which were not answered before the connection
+     * broke, are sent again; the connection is opened again as long as it takes.
+     */
+    class Connection
+    {
+    public:
+        /**
+         * Called with each fabula answered by the listener and the status code of the answer.
+         */
+        typedef std::function<void (const Fabula::Record&, const unsigned int statusCode)> Completion;
+
+    private:
+        std::string         fabulatorName;
+
+        /**
+         * IPv4 address and port of the listener, or path of its socket if the port is zero.
+         */
+        std::string         address;
+        unsigned short      portNumber;
+
+        int                 descriptor;
+
+        enum
+        {
+            Closed,
+            Connecting,
+            Established
+        }
+        state;
+
+        unsigned int        configuredPipelineDepth;
+        unsigned int        pipelineDepth;
+
+        unsigned int        nextCSeq;
+
+        std::deque<Fabula::Record>  waiting;
+        std::deque<Fabula::Record>  inFlight;
+
+        /**
+         * Fabulas put back in front of those waiting since the last batch,
+         * so that those held back keep their order.
+         */
+        size_t              requeued;
+
+        /**
+         * Requests encoded but not yet taken completely by the socket.
+         */
+        struct
+        {
+            std::string     output;
+            size_t          sentBytes;
+        }
+        transmission;
+
+        /**
+         * Responses received and not yet handled. The buffer belongs to the connection,
+         * so that the library does not depend on the buffer pool of Servus.
+         */
+        struct
+        {
+            char            buffer[Fabula::MaximalResponseLength];
+            uint32_t        length;
+        }
+        reception;
+
+        /**
+         * Steady times in milliseconds before which nothing is sent or no connect is tried.
+         */
+        uint64_t            holdUntil;
+        uint64_t            reconnectAt;
+        unsigned int        backoff;
+
+        Fabula::Connection::Completion  completion;
+
+    public:
+        struct
+        {
+            unsigned long   delivered;
+            unsigned long   rejected;
+            unsigned long   deferred;
+            unsigned long   disconnections;
+        }
+        statistics;
+
+    public:
+        Connection(
+            const std::string&              fabulatorName,
+            const std::string&              address,
+            const unsigned short            portNumber,
+            const unsigned int              pipelineDepth,
+            const Fabula::Connection::Completion& completion);
+
+        ~Connection();
+
+        int
+        socket() const
+        { return this->descriptor; }
+
+        void
+        submit(Fabula::Record&&);
+
+        /**
+         * Fabulas submitted and not yet answered.
+         */
+        size_t
+        backlog() const
+        { return this->waiting.size() + this->inFlight.size(); }
+
+        short
+        events() const;
+
+        int
+        timeout() const;
+
+        void
+        process(const short events);
+
+    private:
+        void
+        open();
+
+        void
+        disconnect();
+
+        bool
+        receiveResponses();
+
+        bool
+        handleResponse(Dispatcher::DatagramView&);
+
+        bool
+        sendRequests();
+
+        void
+        encode(
+            const Fabula::Record&   record,
+            const unsigned int      cseq);
+    };
+
+    /**
+     * @return  Steady time in milliseconds.
+     */
+    uint64_t
+    NowMilliseconds();
+
+    /**
+     * @return  Steady time in nanoseconds.
+     */
+    uint64_t
+    NowNanoseconds();
+};
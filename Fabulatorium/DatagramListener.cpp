@@ -0,0 +1,400 @@
+// System definition files.
+//
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Common definition files.
+//
+#include "RTSP/RTSP.hpp"
+#include "Toolkit/Report.h"
+
+// Local definition files.
+//
+#include "Servus/Configuration.hpp"
+#include "Servus/Dispatcher/Aviso.hpp"
+#include "Servus/Dispatcher/Queue.hpp"
+#include "Servus/Dispatcher/ReceiveRing.hpp"
+#include "Servus/Fabulatorium/DatagramListener.hpp"
+#include "Servus/Fabulatorium/Fabulator.hpp"
+#include "Servus/Fabulatorium/Statistics.hpp"
+#include "Servus/Fabulatorium/Suppressor.hpp"
+
+Fabulatorium::DatagramListener::DatagramListener(
+    const std::string&      listenerName,
+    const std::string&      listenerAddress,
+    const unsigned short    listenerPortNumber) :
+listenerName(listenerName),
+listenerAddress(listenerAddress),
+listenerPortNumber(listenerPortNumber),
+socket(-1)
+{
+    this->batch.buffer = (char*) malloc(
+            Fabulatorium::DatagramListenerBatch * Fabulatorium::MaximalDatagramFabulaLength);
+    if (this->batch.buffer == NULL)
+    {
+        ReportSoftAlert("[Listener] Out of memory");
+
+        throw std::runtime_error("[Listener] Out of memory");
+    }
+
+    for (unsigned int messageIndex = 0;
+         messageIndex < Fabulatorium::DatagramListenerBatch;
+         messageIndex++)
+    {
+        struct iovec& vector = this->batch.vectors[messageIndex];
+        struct mmsghdr& message = this->batch.messages[messageIndex];
+
+        vector.iov_base = this->batch.buffer +
+                messageIndex * Fabulatorium::MaximalDatagramFabulaLength;
+        vector.iov_len = Fabulatorium::MaximalDatagramFabulaLength;
+
+        memset(&message, 0, sizeof(message));
+        message.msg_hdr.msg_iov = &vector;
+        message.msg_hdr.msg_iovlen = 1;
+    }
+
+    Fabulatorium::Statistics::SharedInstance().registerListener(
+            listenerName,
+            &this->statistics);
+
+    ReportInfo("[Listener] Defined UDP listener \"%s\" on %s:%u ",
+            listenerName.c_str(),
+            (listenerAddress.length() == 0) ? "*" : listenerAddress.c_str(),
+            listenerPortNumber);
+}
+
+Fabulatorium::DatagramListener::~DatagramListener()
+{
+    this->close();
+
+    free(this->batch.buffer);
+}
+
+/**
+ * @brief   Start the service thread, once the listener has been defined.
+ */
+void
+Fabulatorium::DatagramListener::start()
+{
+    this->thread = std::thread(&Fabulatorium::DatagramListener::ThreadHandler, this);
+}
+
+/**
+ * @brief   Thread handler for service.
+ */
+void
+Fabulatorium::DatagramListener::ThreadHandler(Fabulatorium::DatagramListener* listener)
+{
+    ReportDebug("[Listener] UDP service thread has been started");
+
+    for (;;)
+    {
+        try
+        {
+            listener->close();
+            listener->open();
+
+            for (;;)
+            {
+                listener->receiveBatch();
+            }
+        }
+        catch (std::runtime_error& exception)
+        {
+            ReportError("[Listener] Exception: %s: errno=%d",
+                    exception.what(),
+                    errno);
+
+            std::this_thread::sleep_for(
+                    std::chrono::seconds { Servus::WaitBeforeNetworkRetry } );
+
+            continue;
+        }
+    }
+
+    // Make sure the socket is closed.
+    //
+    listener->close();
+
+    ReportWarning("[Listener] UDP service thread is going to quit");
+}
+
+void
+Fabulatorium::DatagramListener::open()
+{
+    this->socket = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (this->socket == -1)
+        throw std::runtime_error("Cannot create UDP socket");
+
+    // A larger receive buffer absorbs bursts while a batch is being processed.
+    //
+    setsockopt(this->socket, SOL_SOCKET, SO_RCVBUF,
+            &Fabulatorium::DatagramListenerReceiveBuffer,
+            sizeof(Fabulatorium::DatagramListenerReceiveBuffer));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(this->listenerPortNumber);
+
+    if (this->listenerAddress.length() == 0)
+    {
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    else if (inet_pton(AF_INET, this->listenerAddress.c_str(), &address.sin_addr) != 1)
+    {
+        throw std::runtime_error("Invalid interface address");
+    }
+
+    if (bind(this->socket, (struct sockaddr*) &address, sizeof(address)) == -1)
+        throw std::runtime_error("Cannot bind UDP socket");
+}
+
+void
+Fabulatorium::DatagramListener::close()
+{
+    if (this->socket != -1)
+    {
+        ::close(this->socket);
+
+        this->socket = -1;
+    }
+}
+
+/**
+ * @brief   Wait for datagrams and take all of them available, up to one batch, at once.
+ */
+void
+Fabulatorium::DatagramListener::receiveBatch()
+{
+    for (unsigned int messageIndex = 0;
+         messageIndex < Fabulatorium::DatagramListenerBatch;
+         messageIndex++)
+    {
+        this->batch.messages[messageIndex].msg_hdr.msg_flags = 0;
+    }
+
+    const int numberOfMessages = recvmmsg(this->socket,
+            this->batch.messages,
+            Fabulatorium::DatagramListenerBatch,
+            MSG_WAITFORONE,
+            NULL);
+
+    if (numberOfMessages == -1)
+    {
+        if (errno == EINTR)
+            return;
+
+        throw std::runtime_error("Cannot receive UDP datagrams");
+    }
+
+    for (int messageIndex = 0; messageIndex < numberOfMessages; messageIndex++)
+    {
+        const struct mmsghdr& message = this->batch.messages[messageIndex];
+
+        this->statistics.countBytes(message.msg_len);
+
+        if ((message.msg_hdr.msg_flags & MSG_TRUNC) != 0)
+        {
+            ReportWarning("[Fabulatorium] Rejected UDP fabula: datagram too long");
+
+            this->statistics.countReject(Fabulatorium::RejectMalformed);
+
+            continue;
+        }
+
+        const std::chrono::steady_clock::time_point processingBegan =
+                std::chrono::steady_clock::now();
+
+        this->handleDatagram(
+                (const char*) this->batch.vectors[messageIndex].iov_base,
+                message.msg_len);
+
+        this->statistics.countFabula(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - processingBegan).count());
+    }
+}
+
+/**
+ * @brief   Process datagram and enqueue aviso based on received fabula.
+ */
+void
+Fabulatorium::DatagramListener::handleDatagram(
+    const char* const   datagram,
+    const uint32_t      length)
+{
+    Dispatcher::DatagramView request;
+
+    try
+    {
+        if (request.parse(datagram, length) == false)
+            throw Dispatcher::BrokenDatagram("Incomplete header");
+    }
+    catch (Dispatcher::BrokenDatagram& exception)
+    {
+        ReportWarning("[Fabulatorium] Rejected UDP fabula: %s", exception.what());
+
+        this->statistics.countReject(Fabulatorium::RejectMalformed);
+
+        return;
+    }
+
+    if (request.methodIs("FABULA") == false)
+    {
+        ReportWarning("[Fabulatorium] Rejected UDP fabula: Unknown method");
+
+        this->statistics.countReject(Fabulatorium::RejectMethod);
+
+        return;
+    }
+
+    if (request.payload.length == 0)
+    {
+        ReportWarning("[Fabulatorium] Rejected UDP fabula: Missing payload");
+
+        this->statistics.countReject(Fabulatorium::RejectPayload);
+
+        return;
+    }
+
+    try
+    {
+        const std::string     timestamp         = request.text("Timestamp");
+        const std::string     fabulatorName     = request.text("Originator");
+
+        if (fabulatorName.length() == 0)
+            throw Dispatcher::BrokenDatagram("Missing fabulator");
+
+        Fabulatorium::Registry& registry = Fabulatorium::Registry::SharedInstance();
+
+        Fabulatorium::Fabulator* fabulator = registry.lookup(fabulatorName);
+
+        if ((fabulator == NULL) && (registry.acceptsUnknown() == false))
+        {
+            ReportWarning("[Fabulatorium] Rejected UDP fabula: Unknown fabulator \"%s\"",
+                    fabulatorName.c_str());
+
+            this->statistics.countReject(Fabulatorium::RejectUnknown);
+
+            return;
+        }
+
+        // Fabulators from the configuration may leave out what their defaults tell.
+        //
+        Dispatcher::DatagramSpan value;
+
+        const unsigned short  severityLevel     =
+                ((fabulator == NULL) || (request.find("Severity", value) == true))
+                ? request.number("Severity")
+                : fabulator->defaultSeverityLevel;
+        const bool            notificationFlag  =
+                ((fabulator == NULL) || (request.find("Notification", value) == true))
+                ? request.flag("Notification")
+                : fabulator->defaultNotificationFlag;
+
+        try
+        {
+            this->trackSequence(fabulatorName, request.number("Sequence"));
+        }
+        catch (RTSP::StatementNotFound&)
+        { }
+
+        // The sequence is tracked first, so that throttled fabulas do not count as lost.
+        //
+        if ((fabulator != NULL) && (fabulator->admit() == false))
+        {
+            this->statistics.countReject(Fabulatorium::RejectThrottled);
+
+            return;
+        }
+
+        // Without a response to tell the fabulator to wait, fabulas are dropped
+        // while the queue is congested.
+        //
+        if (Dispatcher::Queue::SharedInstance().congested() == true)
+        {
+            this->statistics.countReject(Fabulatorium::RejectCongested);
+
+            return;
+        }
+
+        Dispatcher::FabulaAviso* aviso = new Dispatcher::FabulaAviso(
+                timestamp,
+                fabulatorName,
+                severityLevel,
+                notificationFlag,
+                request.at(request.payload),
+                request.payload.length);
+
+        try
+        {
+            if (Fabulatorium::Suppressor::SharedInstance().absorb(aviso) == true)
+                this->statistics.countSuppressed();
+            else
+                Dispatcher::Queue::SharedInstance().enqueueAviso(aviso);
+        }
+        catch (Dispatcher::QueueOverflow&)
+        {
+            ReportWarning("[Fabulatorium] Dropped UDP fabula from \"%s\": queue overflow",
+                    fabulatorName.c_str());
+
+            delete aviso;
+
+            this->statistics.countOverflow();
+        }
+    }
+    catch (std::exception& exception)
+    {
+        ReportWarning("[Fabulatorium] Rejected UDP fabula: Error by parsing");
+
+        this->statistics.countReject(Fabulatorium::RejectMalformed);
+    }
+}
+
+/**
+ * @brief   Count the fabulas missing between the previous and the given sequence number.
+ *
+ * A sequence number not greater than the previous one means that the fabulator
+ * has started over or the datagrams were reordered, and is taken as new beginning.
+ */
+void
+Fabulatorium::DatagramListener::trackSequence(
+    const std::string&  fabulatorName,
+    const unsigned long sequence)
+{
+    std::unordered_map<std::string, unsigned long>::iterator last =
+            this->sequences.find(fabulatorName);
+
+    if (last == this->sequences.end())
+    {
+        if (this->sequences.size() >= Fabulatorium::MaximalSequenceSources)
+            this->sequences.clear();
+
+        this->sequences[fabulatorName] = sequence;
+
+        return;
+    }
+
+    if (sequence > last->second + 1)
+    {
+        ReportNotice("[Fabulatorium] Lost %lu UDP fabulas from \"%s\"",
+                sequence - last->second - 1,
+                fabulatorName.c_str());
+
+        this->statistics.countLost(sequence - last->second - 1);
+    }
+
+    last->second = sequence;
+}
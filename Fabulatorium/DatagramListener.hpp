@@ -0,0 +1,113 @@
+#pragma once
+
+// System definition files.
+//
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Local definition files.
+//
+#include "Servus/Fabulatorium/Statistics.hpp"
+
+namespace Fabulatorium
+{
+    /**
+     * Maximal length of a fabula received as UDP datagram.
+     */
+    static const unsigned int MaximalDatagramFabulaLength = 16 * 1024;
+
+    /**
+     * Number of UDP datagrams received with one system call at most.
+     */
+    static const unsigned int DatagramListenerBatch = 32;
+
+    /**
+     * Size of the socket receive buffer requested for UDP listeners.
+     */
+    static const int DatagramListenerReceiveBuffer = 4 * 1024 * 1024;
+
+    /**
+     * Sources beyond this number make the sequence tracking start over.
+     */
+    static const unsigned int MaximalSequenceSources = 4096;
+
+    /**
+     * Listener taking fabulas as UDP datagrams, one fabula per datagram.
+     *
+     * Delivery is fire-and-forget: there is no CSeq and no response.
+     * Datagrams are drained from the socket in batches and their fabulas
+     * enqueued directly. A fabulator may number its fabulas in a Sequence
+     * header, so that gaps are counted as lost fabulas.
+     */
+    class DatagramListener
+    {
+    private:
+        /**
+         * Thread handler of service thread.
+         */
+        std::thread         thread;
+
+        std::string         listenerName;
+        std::string         listenerAddress;
+        unsigned short      listenerPortNumber;
+
+        int                 socket;
+
+        /**
+         * Buffers of one batch, one per datagram.
+         */
+        struct
+        {
+            char*           buffer;
+            struct mmsghdr  messages[Fabulatorium::DatagramListenerBatch];
+            struct iovec    vectors[Fabulatorium::DatagramListenerBatch];
+        }
+        batch;
+
+        /**
+         * Last sequence number of each fabulator, used by the service thread only.
+         */
+        std::unordered_map<std::string, unsigned long> sequences;
+
+    public:
+        Fabulatorium::Traffic   statistics;
+
+    public:
+        DatagramListener(
+            const std::string&      listenerName,
+            const std::string&      listenerAddress,
+            const unsigned short    listenerPortNumber);
+
+        ~DatagramListener();
+
+        void
+        start();
+
+    private:
+        static void
+        ThreadHandler(DatagramListener*);
+
+        void
+        open();
+
+        void
+        close();
+
+        void
+        receiveBatch();
+
+        void
+        handleDatagram(
+            const char* const   datagram,
+            const uint32_t      length);
+
+        void
+        trackSequence(
+            const std::string&  fabulatorName,
+            const unsigned long sequence);
+    };
+};
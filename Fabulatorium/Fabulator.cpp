@@ -1,12 +1,17 @@
 // System definition files.
 //
 #include <unistd.h>
+#include <atomic>
+#include <chrono>
 #include <cstdbool>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <unordered_map>
 
 // Common definition files.
 //
@@ -16,16 +21,128 @@
 //
 #include "Servus/Fabulatorium/Fabulator.hpp"
 
+static const uint64_t NanosecondsPerSecond = 1000000000;
+
+static Fabulatorium::Registry* instance = NULL;
+
 Fabulatorium::Fabulator::Fabulator(
     const std::string&      fabulatorName,
     const unsigned short    defaultSeverityLevel,
-    const bool              defaultNotificationFlag) :
+    const bool              defaultNotificationFlag,
+    const unsigned int      rate,
+    const unsigned int      burst) :
 fabulatorName(fabulatorName),
 defaultSeverityLevel(defaultSeverityLevel),
 defaultNotificationFlag(defaultNotificationFlag)
 {
+    this->bucket.interval = (rate == 0) ? 0 : NanosecondsPerSecond / rate;
+    this->bucket.tolerance = this->bucket.interval * ((burst == 0) ? 0 : burst - 1);
+    this->bucket.theoreticalArrival.store(0, std::memory_order_relaxed);
+
     ReportInfo("[Fabulator] Defined fabulator \"%s\" with defaults: severity %u %s notification",
             fabulatorName.c_str(),
             defaultSeverityLevel,
             (defaultNotificationFlag == true) ? "with" : "without");
+
+    if (rate != 0)
+    {
+        ReportInfo("[Fabulator] Fabulator \"%s\" is limited to %u fabulas per second, %u at once",
+                fabulatorName.c_str(),
+                rate,
+                (burst == 0) ? 1 : burst);
+    }
+}
+
+/**
+ * @brief   Take one fabula from the bucket of the fabulator.
+ *
+ * @return  False if the fabulator has exceeded its rate and burst.
+ */
+bool
+Fabulatorium::Fabulator::admit()
+{
+    if (this->bucket.interval == 0)
+        return true;
+
+    const uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    uint64_t theoreticalArrival = this->bucket.theoreticalArrival.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        const uint64_t earliestArrival = (theoreticalArrival > now) ? theoreticalArrival : now;
+
+        if (earliestArrival - now > this->bucket.tolerance)
+            return false;
+
+        if (this->bucket.theoreticalArrival.compare_exchange_weak(
+                theoreticalArrival,
+                earliestArrival + this->bucket.interval,
+                std::memory_order_relaxed) == true)
+        {
+            return true;
+        }
+    }
+}
+
+Fabulatorium::Registry&
+Fabulatorium::Registry::InitInstance()
+{
+    if (instance != NULL)
+        throw std::runtime_error("[Fabulator] Registry already initialized");
+
+    instance = new Fabulatorium::Registry();
+
+    return *instance;
+}
+
+Fabulatorium::Registry&
+Fabulatorium::Registry::SharedInstance()
+{
+    if (instance == NULL)
+        throw std::runtime_error("[Fabulator] Registry not initialized");
+
+    return *instance;
+}
+
+Fabulatorium::Registry::Registry() :
+acceptUnknown(true)
+{ }
+
+void
+Fabulatorium::Registry::define(Fabulatorium::Fabulator* fabulator)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    std::unordered_map<std::string, Fabulatorium::Fabulator*>::iterator existing =
+            this->fabulators.find(fabulator->name());
+
+    // Sessions may already hold the first definition, so that one is kept.
+    //
+    if (existing != this->fabulators.end())
+    {
+        ReportWarning("[Fabulator] Fabulator \"%s\" defined again, ignored",
+                fabulator->name().c_str());
+
+        delete fabulator;
+
+        return;
+    }
+
+    this->fabulators[fabulator->name()] = fabulator;
+}
+
+/**
+ * @return  Fabulator of the given name, or NULL if it is not in the configuration.
+ */
+Fabulatorium::Fabulator*
+Fabulatorium::Registry::lookup(const std::string& fabulatorName)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    std::unordered_map<std::string, Fabulatorium::Fabulator*>::iterator existing =
+            this->fabulators.find(fabulatorName);
+
+    return (existing == this->fabulators.end()) ? NULL : existing->second;
 }
@@ -2,24 +2,104 @@
 
 // System definition files.
 //
+#include <atomic>
 #include <cstdbool>
+#include <cstdint>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <unordered_map>
 
 namespace Fabulatorium
 {
+    /**
+     * Fabulator known from the configuration.
+     *
+     * Its fabulas are admitted at its rate on average and up to its burst
+     * at once. The bucket is kept as the theoretical arrival time of the next
+     * fabula, so that admission is one compare-and-swap without any lock.
+     */
     class Fabulator
     {
     private:
         std::string     fabulatorName;
+
+    public:
         unsigned short  defaultSeverityLevel;
         bool            defaultNotificationFlag;
 
+    private:
+        struct
+        {
+            /**
+             * Nanoseconds each fabula takes from the bucket, zero if unlimited.
+             */
+            uint64_t                interval;
+
+            /**
+             * Nanoseconds the theoretical arrival time may run ahead of now.
+             */
+            uint64_t                tolerance;
+
+            std::atomic<uint64_t>   theoreticalArrival;
+        }
+        bucket;
+
     public:
         Fabulator(
             const std::string&      fabulatorName,
             const unsigned short    defaultSeverityLevel,
-            const bool              defaultNotificationFlag);
+            const bool              defaultNotificationFlag,
+            const unsigned int      rate,
+            const unsigned int      burst);
+
+        const std::string&
+        name() const
+        { return this->fabulatorName; }
+
+        bool
+        admit();
+    };
+
+    /**
+     * Fabulators known from the configuration, looked up by name for every fabula.
+     */
+    class Registry
+    {
+    private:
+        std::mutex      lock;
+
+        std::unordered_map<std::string, Fabulatorium::Fabulator*> fabulators;
+
+        /**
+         * Whether fabulas of fabulators not in the configuration are taken.
+         */
+        bool            acceptUnknown;
+
+    public:
+        static Fabulatorium::Registry&
+        InitInstance();
+
+        static Fabulatorium::Registry&
+        SharedInstance();
+
+    private:
+        Registry();
+
+    public:
+        void
+        define(Fabulatorium::Fabulator*);
+
+        Fabulatorium::Fabulator*
+        lookup(const std::string& fabulatorName);
+
+        void
+        setAcceptUnknown(const bool acceptUnknown)
+        { this->acceptUnknown = acceptUnknown; }
+
+        bool
+        acceptsUnknown() const
+        { return this->acceptUnknown; }
     };
 };
@@ -1,6 +1,13 @@
 // System definition files.
 //
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
@@ -9,39 +16,46 @@
 
 // Common definition files.
 //
-#include "Communicator/IP.hpp"
-#include "Communicator/TCP.hpp"
 #include "Toolkit/Report.h"
 
 // Local definition files.
 //
 #include "Servus/Configuration.hpp"
 #include "Servus/Fabulatorium/Listener.hpp"
+#include "Servus/Fabulatorium/Reactor.hpp"
 #include "Servus/Fabulatorium/Session.hpp"
+#include "Servus/Fabulatorium/Statistics.hpp"
 
 Fabulatorium::Listener::Listener(
     const std::string&      listenerName,
     const std::string&      listenerAddress,
-    const unsigned short    listenerPortNumber) :
-Inherited(IP::IPv4, listenerAddress, listenerPortNumber),
+    const unsigned short    listenerPortNumber,
+    const unsigned int      numberOfAcceptors) :
 listenerName(listenerName),
 listenerAddress(listenerAddress),
-listenerPortNumber(listenerPortNumber)
+listenerPortNumber(listenerPortNumber),
+numberOfAcceptors((numberOfAcceptors == 0) ? 1 : numberOfAcceptors)
 {
     this->waitForFirstTransmission =
             Servus::DefaultListenerWaitForFirstTransmission;
     this->waitForTransmissionCompletion =
             Servus::DefaultListenerWaitForTransmissionCompletion;
+    this->pipelineDepth =
+            Servus::DefaultListenerPipelineDepth;
+    this->pauseWhenCongested = false;
+    this->maximalSessions =
+            Servus::DefaultListenerMaximalSessions;
+    this->shedPolicy = Fabulatorium::ShedClose;
 
-    this->statistics.receivedFabulas = 0;
-    this->statistics.receivedBytes = 0;
+    Fabulatorium::Statistics::SharedInstance().registerListener(
+            listenerName,
+            &this->statistics);
 
-    ReportInfo("[Listener] Defined listener \"%s\" on %s:%u ",
+    ReportInfo("[Listener] Defined listener \"%s\" on %s:%u with %u acceptors",
             listenerName.c_str(),
             (listenerAddress.length() == 0) ? "*" : listenerAddress.c_str(),
-            listenerPortNumber);
-
-    this->thread = std::thread(&Fabulatorium::Listener::ThreadHandler, this);
+            listenerPortNumber,
+            this->numberOfAcceptors);
 }
 
 void
@@ -54,54 +68,223 @@ Fabulatorium::Listener::setConnectionIntervals(
 }
 
 /**
- * @brief   Thread handler for service.
+ * @brief   Set number of requests a fabulator may keep outstanding on a connection.
+ */
+void
+Fabulatorium::Listener::setPipelineDepth(const unsigned int pipelineDepth)
+{
+    this->pipelineDepth = (pipelineDepth == 0) ? 1 : pipelineDepth;
+}
+
+/**
+ * @brief   Let sessions stop reading from their sockets while the queue is congested.
+ */
+void
+Fabulatorium::Listener::setPauseWhenCongested(const bool pauseWhenCongested)
+{
+    this->pauseWhenCongested = pauseWhenCongested;
+}
+
+/**
+ * @brief   Limit the number of open sessions and choose what happens to connections beyond.
+ */
+void
+Fabulatorium::Listener::setAdmission(
+    const unsigned int          maximalSessions,
+    const Fabulatorium::ShedPolicy shedPolicy)
+{
+    this->maximalSessions = maximalSessions;
+    this->shedPolicy = shedPolicy;
+}
+
+/**
+ * @brief   Start the acceptors, once all settings of the listener have been applied.
+ */
+void
+Fabulatorium::Listener::start()
+{
+    for (unsigned int acceptorIndex = 0;
+         acceptorIndex < this->numberOfAcceptors;
+         acceptorIndex++)
+    {
+        this->acceptors.push_back(
+                std::thread(&Fabulatorium::Listener::ThreadHandler, this));
+    }
+}
+
+/**
+ * @brief   Thread handler of an acceptor.
+ *
+ * Failures are retried after a wait which starts at milliseconds and doubles
+ * with each failure in a row, so that a listener is back as soon as the network is.
  */
 void
 Fabulatorium::Listener::ThreadHandler(Fabulatorium::Listener* listener)
 {
-    ReportDebug("[Listener] Service thread has been started");
+    ReportDebug("[Listener] Acceptor thread has been started");
+
+    unsigned int backoff = Fabulatorium::AcceptBackoffInitial;
+
+    int socket = -1;
 
     for (;;)
     {
         try
         {
-            listener->disconnect();
-            listener->connect();
+            if (socket == -1)
+                socket = listener->open();
 
-            for (;;)
+            if (listener->acceptSession(socket) == true)
             {
-                Fabulatorium::Session* session = new Fabulatorium::Session
-                {
-                    *listener,
-                    listener->waitForFirstTransmission,
-                    listener->waitForTransmissionCompletion
-                };
-
-                std::thread connectionThread
-                {
-                    &Fabulatorium::Session::ThreadHandler,
-                    session
-                };
-
-                connectionThread.detach();
+                backoff = Fabulatorium::AcceptBackoffInitial;
+
+                continue;
             }
         }
-        catch (Communicator::SocketError& exception)
+        catch (std::runtime_error& exception)
         {
             ReportError("[Listener] Exception: %s: errno=%d",
                     exception.what(),
-                    exception.errorNumber);
+                    errno);
 
-            std::this_thread::sleep_for(
-                    std::chrono::seconds { Servus::WaitBeforeNetworkRetry } );
+            if (socket != -1)
+            {
+                ::close(socket);
 
-            continue;
+                socket = -1;
+            }
         }
+
+        std::this_thread::sleep_for(
+                std::chrono::milliseconds { backoff } );
+
+        backoff = std::min(backoff * 2, Fabulatorium::AcceptBackoffMaximal);
     }
 
     // Make sure the socket is closed.
     //
-    listener->disconnect();
+    if (socket != -1)
+        ::close(socket);
+
+    ReportWarning("[Listener] Acceptor thread is going to quit");
+}
+
+/**
+ * @brief   Open a socket of an acceptor, sharing the port with the other acceptors.
+ *
+ * @return  Listening socket.
+ */
+int
+Fabulatorium::Listener::open()
+{
+    const int socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (socket == -1)
+        throw std::runtime_error("Cannot create TCP socket");
+
+    const int enabled = 1;
+
+    setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+    setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(this->listenerPortNumber);
+
+    if (this->listenerAddress.length() == 0)
+    {
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    else if (inet_pton(AF_INET, this->listenerAddress.c_str(), &address.sin_addr) != 1)
+    {
+        ::close(socket);
+
+        throw std::runtime_error("Invalid interface address");
+    }
+
+    if (bind(socket, (struct sockaddr*) &address, sizeof(address)) == -1)
+    {
+        ::close(socket);
+
+        throw std::runtime_error("Cannot bind TCP socket");
+    }
+
+    if (listen(socket, Fabulatorium::ListenerBacklog) == -1)
+    {
+        ::close(socket);
+
+        throw std::runtime_error("Cannot listen on TCP socket");
+    }
+
+    return socket;
+}
+
+/**
+ * @brief   Accept a connection and hand its session over to the reactor.
+ *
+ * @return  Boolean false if the acceptor should wait before it tries again.
+ *
+ * @throw   std::runtime_error      If the socket has to be opened again.
+ */
+bool
+Fabulatorium::Listener::acceptSession(const int socket)
+{
+    // Connections beyond the limit wait in the backlog, and beyond the backlog
+    // in the SYN queue of the fabulator, until a session has closed.
+    //
+    if (this->shedPolicy == Fabulatorium::ShedDefer)
+        this->statistics.waitForRoom(this->maximalSessions);
+
+    const int connection = accept4(socket, NULL, NULL, SOCK_CLOEXEC);
+    if (connection == -1)
+    {
+        switch (errno)
+        {
+            case EINTR:
+            case EAGAIN:
+            case ECONNABORTED:
+                return true;
+
+            // Out of descriptors or memory, which sessions closing will give back.
+            //
+            case EMFILE:
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
+                ReportWarning("[Listener] Cannot accept connection: errno=%d",
+                        errno);
+
+                return false;
+
+            default:
+                throw std::runtime_error("Cannot accept connection");
+        }
+    }
+
+    if (this->statistics.admitSession(this->maximalSessions) == false)
+    {
+        ReportDebug("[Listener] Shed connection of listener \"%s\": %u sessions open",
+                this->listenerName.c_str(),
+                this->statistics.sessions());
+
+        ::close(connection);
+
+        this->statistics.countShed();
+
+        return true;
+    }
+
+    Fabulatorium::Session* session = new Fabulatorium::Session
+    {
+        this->statistics,
+        connection,
+        this->waitForFirstTransmission,
+        this->waitForTransmissionCompletion,
+        this->pipelineDepth,
+        this->pauseWhenCongested
+    };
+
+    Fabulatorium::Reactor::SharedInstance().adopt(session);
 
-    ReportWarning("[Listener] Service thread is going to quit");
+    return true;
 }
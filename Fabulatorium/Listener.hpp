@@ -4,46 +4,78 @@
 //
 #include <string>
 #include <thread>
+#include <vector>
 
-// Common definition files.
+// Local definition files.
 //
-#include "Communicator/TCP.hpp"
+#include "Servus/Fabulatorium/Statistics.hpp"
 
 namespace Fabulatorium
 {
     static const unsigned int MaximalFabulaLength = 64 * 1024;
 
-    class Listener : public TCP::Service
+    /**
+     * Connections waiting to be accepted by each acceptor at most.
+     */
+    static const int ListenerBacklog = 256;
+
+    /**
+     * Wait after the first failure to accept or to open the socket,
+     * doubled with each further failure up to the maximum. Milliseconds.
+     */
+    static const unsigned int AcceptBackoffInitial = 10;
+    static const unsigned int AcceptBackoffMaximal = 5000;
+
+    /**
+     * What an acceptor does with a connection while the listener has
+     * as many sessions open as it may.
+     */
+    enum ShedPolicy
     {
-        typedef TCP::Service Inherited;
+        ShedClose           = 0,    /**< Accept the connection and close it at once. */
+        ShedDefer           = 1     /**< Leave it in the backlog until a session has closed. */
+    };
 
+    /**
+     * Listener taking fabulas over TCP.
+     *
+     * Each acceptor thread has a socket of its own, all bound to the same port
+     * with SO_REUSEPORT, so that the kernel spreads connections among them.
+     */
+    class Listener
+    {
     private:
         /**
-         * Thread handler of service thread.
+         * Thread handlers of acceptor threads.
          */
-        std::thread         thread;
+        std::vector<std::thread>    acceptors;
 
     private:
         std::string         listenerName;
         std::string         listenerAddress;
         unsigned short      listenerPortNumber;
+        unsigned int        numberOfAcceptors;
 
     public:
         unsigned int        waitForFirstTransmission;
         unsigned int        waitForTransmissionCompletion;
+        unsigned int        pipelineDepth;
+        bool                pauseWhenCongested;
 
-        struct
-        {
-            unsigned int    receivedFabulas;
-            unsigned int    receivedBytes;
-        }
-        statistics;
+        /**
+         * Limit of open sessions, zero for no limit, and what happens beyond it.
+         */
+        unsigned int        maximalSessions;
+        Fabulatorium::ShedPolicy shedPolicy;
+
+        Fabulatorium::Traffic   statistics;
 
     public:
         Listener(
             const std::string&      listenerName,
             const std::string&      listenerAddress,
-            const unsigned short    listenerPortNumber);
+            const unsigned short    listenerPortNumber,
+            const unsigned int      numberOfAcceptors);
 
         ~Listener();
 
@@ -52,8 +84,28 @@ namespace Fabulatorium
             const unsigned int waitForFirstTransmission,
             const unsigned int waitForTransmissionCompletion);
 
+        void
+        setPipelineDepth(const unsigned int pipelineDepth);
+
+        void
+        setPauseWhenCongested(const bool pauseWhenCongested);
+
+        void
+        setAdmission(
+            const unsigned int          maximalSessions,
+            const Fabulatorium::ShedPolicy shedPolicy);
+
+        void
+        start();
+
     private:
         static void
         ThreadHandler(Listener*);
+
+        int
+        open();
+
+        bool
+        acceptSession(const int socket);
     };
 };
@@ -0,0 +1,265 @@
+// System definition files.
+//
+#include <pwd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Common definition files.
+//
+#include "Toolkit/Report.h"
+
+// Local definition files.
+//
+#include "Servus/Configuration.hpp"
+#include "Servus/Fabulatorium/LocalListener.hpp"
+#include "Servus/Fabulatorium/Reactor.hpp"
+#include "Servus/Fabulatorium/Session.hpp"
+#include "Servus/Fabulatorium/Statistics.hpp"
+
+/**
+ * Connections waiting to be accepted by a local listener at most.
+ */
+static const int LocalListenerBacklog = 64;
+
+Fabulatorium::LocalListener::LocalListener(
+    const std::string&  listenerName,
+    const std::string&  socketPath) :
+listenerName(listenerName),
+socketPath(socketPath),
+socket(-1)
+{
+    this->waitForFirstTransmission =
+            Servus::DefaultListenerWaitForFirstTransmission;
+    this->waitForTransmissionCompletion =
+            Servus::DefaultListenerWaitForTransmissionCompletion;
+    this->pipelineDepth =
+            Servus::DefaultListenerPipelineDepth;
+    this->pauseWhenCongested = false;
+
+    Fabulatorium::Statistics::SharedInstance().registerListener(
+            listenerName,
+            &this->statistics);
+
+    ReportInfo("[Listener] Defined local listener \"%s\" on %s",
+            listenerName.c_str(),
+            socketPath.c_str());
+}
+
+Fabulatorium::LocalListener::~LocalListener()
+{
+    this->close();
+}
+
+void
+Fabulatorium::LocalListener::setConnectionIntervals(
+    const unsigned int waitForFirstTransmission,
+    const unsigned int waitForTransmissionCompletion)
+{
+    this->waitForFirstTransmission = waitForFirstTransmission;
+    this->waitForTransmissionCompletion = waitForTransmissionCompletion;
+}
+
+/**
+ * @brief   Set number of requests a fabulator may keep outstanding on a connection.
+ */
+void
+Fabulatorium::LocalListener::setPipelineDepth(const unsigned int pipelineDepth)
+{
+    this->pipelineDepth = (pipelineDepth == 0) ? 1 : pipelineDepth;
+}
+
+/**
+ * @brief   Let sessions stop reading from their sockets while the queue is congested.
+ */
+void
+Fabulatorium::LocalListener::setPauseWhenCongested(const bool pauseWhenCongested)
+{
+    this->pauseWhenCongested = pauseWhenCongested;
+}
+
+/**
+ * @brief   Start the service thread, once all settings of the listener have been applied.
+ */
+void
+Fabulatorium::LocalListener::start()
+{
+    this->thread = std::thread(&Fabulatorium::LocalListener::ThreadHandler, this);
+}
+
+/**
+ * @brief   Thread handler for service.
+ */
+void
+Fabulatorium::LocalListener::ThreadHandler(Fabulatorium::LocalListener* listener)
+{
+    ReportDebug("[Listener] Local service thread has been started");
+
+    for (;;)
+    {
+        try
+        {
+            listener->close();
+            listener->open();
+
+            for (;;)
+            {
+                listener->acceptSession();
+            }
+        }
+        catch (std::runtime_error& exception)
+        {
+            ReportError("[Listener] Exception: %s: errno=%d",
+                    exception.what(),
+                    errno);
+
+            std::this_thread::sleep_for(
+                    std::chrono::seconds { Servus::WaitBeforeNetworkRetry } );
+
+            continue;
+        }
+    }
+
+    // Make sure the socket is closed.
+    //
+    listener->close();
+
+    ReportWarning("[Listener] Local service thread is going to quit");
+}
+
+void
+Fabulatorium::LocalListener::open()
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (this->socketPath.length() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path too long");
+
+    strncpy(address.sun_path, this->socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    this->socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->socket == -1)
+        throw std::runtime_error("Cannot create UNIX domain socket");
+
+    // A socket file left behind by a previous run would make bind fail.
+    //
+    unlink(this->socketPath.c_str());
+
+    if (bind(this->socket, (struct sockaddr*) &address, sizeof(address)) == -1)
+        throw std::runtime_error("Cannot bind UNIX domain socket");
+
+    // Any local user may deliver fabulas, as each one is identified by the kernel.
+    //
+    chmod(this->socketPath.c_str(), 0666);
+
+    if (listen(this->socket, LocalListenerBacklog) == -1)
+        throw std::runtime_error("Cannot listen on UNIX domain socket");
+}
+
+void
+Fabulatorium::LocalListener::close()
+{
+    if (this->socket != -1)
+    {
+        ::close(this->socket);
+
+        unlink(this->socketPath.c_str());
+
+        this->socket = -1;
+    }
+}
+
+/**
+ * @brief   Wait for a fabulator to connect and hand its session over to the reactor.
+ */
+void
+Fabulatorium::LocalListener::acceptSession()
+{
+    const int socket = accept4(this->socket, NULL, NULL, SOCK_CLOEXEC);
+    if (socket == -1)
+    {
+        if ((errno == EINTR) || (errno == ECONNABORTED))
+            return;
+
+        throw std::runtime_error("Cannot accept connection");
+    }
+
+    std::string peerIdentity;
+
+    try
+    {
+        peerIdentity = PeerIdentity(socket);
+    }
+    catch (std::runtime_error& exception)
+    {
+        ReportWarning("[Listener] Refused local connection: %s: errno=%d",
+                exception.what(),
+                errno);
+
+        ::close(socket);
+
+        return;
+    }
+
+    // Local fabulators are not limited in number.
+    //
+    this->statistics.admitSession(0);
+
+    Fabulatorium::Session* session = new Fabulatorium::Session
+    {
+        this->statistics,
+        socket,
+        this->waitForFirstTransmission,
+        this->waitForTransmissionCompletion,
+        this->pipelineDepth,
+        this->pauseWhenCongested
+    };
+
+    session->identifyPeer(peerIdentity);
+
+    ReportDebug("[Listener] Accepted local connection from \"%s\"",
+            peerIdentity.c_str());
+
+    Fabulatorium::Reactor::SharedInstance().adopt(session);
+}
+
+/**
+ * @brief   Identify the process on the other side of a UNIX domain socket.
+ *
+ * @return  Name of the user the process runs as, or its user ID if it has no name.
+ */
+std::string
+Fabulatorium::LocalListener::PeerIdentity(const int socket)
+{
+    struct ucred credentials;
+    socklen_t credentialsLength = sizeof(credentials);
+
+    if (getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &credentialsLength) == -1)
+        throw std::runtime_error("Cannot get peer credentials");
+
+    struct passwd entry;
+    struct passwd* result = NULL;
+    char buffer[1024];
+
+    if ((getpwuid_r(credentials.uid, &entry, buffer, sizeof(buffer), &result) == 0) &&
+        (result != NULL))
+    {
+        return std::string(entry.pw_name);
+    }
+
+    char identity[32];
+    snprintf(identity, sizeof(identity), "uid:%u", (unsigned int) credentials.uid);
+
+    return std::string(identity);
+}
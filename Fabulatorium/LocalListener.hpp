@@ -0,0 +1,79 @@
+#pragma once
+
+// System definition files.
+//
+#include <string>
+#include <thread>
+
+// Local definition files.
+//
+#include "Servus/Fabulatorium/Statistics.hpp"
+
+namespace Fabulatorium
+{
+    /**
+     * Listener taking fabulas from fabulators on the same host over a UNIX domain socket.
+     *
+     * Sessions speak the same protocol as over TCP. The fabulator is identified
+     * by the user its process runs as, taken from the kernel through SO_PEERCRED,
+     * and an Originator header sent by the fabulator is ignored.
+     */
+    class LocalListener
+    {
+    private:
+        /**
+         * Thread handler of service thread.
+         */
+        std::thread         thread;
+
+        std::string         listenerName;
+        std::string         socketPath;
+
+        int                 socket;
+
+    public:
+        unsigned int        waitForFirstTransmission;
+        unsigned int        waitForTransmissionCompletion;
+        unsigned int        pipelineDepth;
+        bool                pauseWhenCongested;
+
+        Fabulatorium::Traffic   statistics;
+
+    public:
+        LocalListener(
+            const std::string&  listenerName,
+            const std::string&  socketPath);
+
+        ~LocalListener();
+
+        void
+        setConnectionIntervals(
+            const unsigned int waitForFirstTransmission,
+            const unsigned int waitForTransmissionCompletion);
+
+        void
+        setPipelineDepth(const unsigned int pipelineDepth);
+
+        void
+        setPauseWhenCongested(const bool pauseWhenCongested);
+
+        void
+        start();
+
+    private:
+        static void
+        ThreadHandler(LocalListener*);
+
+        void
+        open();
+
+        void
+        close();
+
+        void
+        acceptSession();
+
+        static std::string
+        PeerIdentity(const int socket);
+    };
+};
@@ -0,0 +1,483 @@
+// System definition files.
+//
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Common definition files.
+//
+#include "Toolkit/Report.h"
+
+// Local definition files.
+//
+#include "Servus/Fabulatorium/Reactor.hpp"
+#include "Servus/Fabulatorium/Session.hpp"
+
+static Fabulatorium::Reactor* instance = NULL;
+
+Fabulatorium::Reactor&
+Fabulatorium::Reactor::InitInstance()
+{
+    if (instance != NULL)
+        throw std::runtime_error("[Fabulatorium] Reactor already initialized");
+
+    instance = new Fabulatorium::Reactor();
+
+    return *instance;
+}
+
+Fabulatorium::Reactor&
+Fabulatorium::Reactor::SharedInstance()
+{
+    if (instance == NULL)
+        throw std::runtime_error("[Fabulatorium] Reactor not initialized");
+
+    return *instance;
+}
+
+Fabulatorium::Reactor::Reactor()
+{
+    this->nextWorker.store(0, std::memory_order_relaxed);
+}
+
+Fabulatorium::Reactor::~Reactor()
+{
+    for (std::vector<Fabulatorium::Worker*>::iterator worker = this->workers.begin();
+         worker != this->workers.end();
+         worker++)
+    {
+        delete *worker;
+    }
+}
+
+/**
+ * @brief   Start worker threads.
+ *
+ * Must be called once, before any listener hands over a session.
+ */
+void
+Fabulatorium::Reactor::start(const unsigned int numberOfWorkers)
+{
+    if (this->workers.empty() == false)
+        throw std::runtime_error("[Fabulatorium] Reactor already started");
+
+    for (unsigned int workerIndex = 0;
+         workerIndex < ((numberOfWorkers == 0) ? 1 : numberOfWorkers);
+         workerIndex++)
+    {
+        this->workers.push_back(new Fabulatorium::Worker());
+    }
+
+    ReportInfo("[Fabulatorium] Started %u workers",
+            (unsigned int) this->workers.size());
+}
+
+/**
+ * @brief   Hand over an accepted session to one of the workers.
+ *
+ * May be called by any listener thread. The reactor takes over the session.
+ */
+void
+Fabulatorium::Reactor::adopt(Fabulatorium::Session* session)
+{
+    if (this->workers.empty() == true)
+    {
+        delete session;
+
+        throw std::runtime_error("[Fabulatorium] Reactor not started");
+    }
+
+    const int flags = fcntl(session->socket(), F_GETFL, 0);
+
+    fcntl(session->socket(), F_SETFL, flags | O_NONBLOCK);
+
+    const unsigned int workerIndex =
+            this->nextWorker.fetch_add(1, std::memory_order_relaxed) % this->workers.size();
+
+    this->workers[workerIndex]->adopt(session);
+}
+
+Fabulatorium::TimerWheel::TimerWheel()
+{
+    for (unsigned int slotIndex = 0;
+         slotIndex < Fabulatorium::TimerWheelSlots;
+         slotIndex++)
+    {
+        this->slots[slotIndex] = NULL;
+    }
+
+    this->currentTick = Fabulatorium::TimerWheel::CurrentTick();
+    this->numberOfTimers = 0;
+}
+
+/**
+ * @brief   Let the session time out after the given time, replacing an earlier timeout.
+ */
+void
+Fabulatorium::TimerWheel::arm(
+    Fabulatorium::Session*  session,
+    const unsigned int      milliseconds)
+{
+    this->cancel(session);
+
+    // Round up, so that a timeout never fires early.
+    //
+    const uint64_t expiryTick = Fabulatorium::TimerWheel::CurrentTick() +
+            (milliseconds + Fabulatorium::TimerWheelTick - 1) / Fabulatorium::TimerWheelTick;
+
+    Fabulatorium::Session*& slot = this->slots[expiryTick & (Fabulatorium::TimerWheelSlots - 1)];
+
+    session->timer.expiryTick = expiryTick;
+    session->timer.previous = NULL;
+    session->timer.next = slot;
+
+    if (slot != NULL)
+        slot->timer.previous = session;
+
+    slot = session;
+
+    session->timer.armed = true;
+
+    this->numberOfTimers++;
+}
+
+void
+Fabulatorium::TimerWheel::cancel(Fabulatorium::Session* session)
+{
+    if (session->timer.armed == false)
+        return;
+
+    if (session->timer.previous != NULL)
+    {
+        session->timer.previous->timer.next = session->timer.next;
+    }
+    else
+    {
+        this->slots[session->timer.expiryTick & (Fabulatorium::TimerWheelSlots - 1)] =
+                session->timer.next;
+    }
+
+    if (session->timer.next != NULL)
+        session->timer.next->timer.previous = session->timer.previous;
+
+    session->timer.armed = false;
+
+    this->numberOfTimers--;
+}
+
+/**
+ * @brief   Take out all sessions whose timeout has come.
+ *
+ * Each slot passed since the last call is visited once.
+ */
+void
+Fabulatorium::TimerWheel::expire(std::vector<Fabulatorium::Session*>& expired)
+{
+    const uint64_t nowTick = Fabulatorium::TimerWheel::CurrentTick();
+
+    uint64_t tick = (nowTick - this->currentTick > Fabulatorium::TimerWheelSlots)
+            ? nowTick - Fabulatorium::TimerWheelSlots
+            : this->currentTick;
+
+    for (; tick <= nowTick; tick++)
+    {
+        Fabulatorium::Session* session = this->slots[tick & (Fabulatorium::TimerWheelSlots - 1)];
+
+        while (session != NULL)
+        {
+            Fabulatorium::Session* next = session->timer.next;
+
+            if (session->timer.expiryTick <= nowTick)
+            {
+                this->cancel(session);
+
+                expired.push_back(session);
+            }
+
+            session = next;
+        }
+    }
+
+    this->currentTick = nowTick;
+}
+
+uint64_t
+Fabulatorium::TimerWheel::CurrentTick()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count() /
+            Fabulatorium::TimerWheelTick;
+}
+
+Fabulatorium::Worker::Worker()
+{
+    this->pollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (this->pollDescriptor == -1)
+    {
+        ReportSoftAlert("[Fabulatorium] Cannot create poll descriptor: errno=%d",
+                errno);
+
+        throw std::runtime_error("[Fabulatorium] Cannot create poll descriptor");
+    }
+
+    this->arrivals.eventDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->arrivals.eventDescriptor == -1)
+    {
+        ReportSoftAlert("[Fabulatorium] Cannot create event descriptor: errno=%d",
+                errno);
+
+        ::close(this->pollDescriptor);
+
+        throw std::runtime_error("[Fabulatorium] Cannot create event descriptor");
+    }
+
+    // Event descriptor is told apart from sessions by its empty pointer.
+    //
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events    = EPOLLIN;
+    event.data.ptr  = NULL;
+
+    epoll_ctl(this->pollDescriptor, EPOLL_CTL_ADD, this->arrivals.eventDescriptor, &event);
+
+    this->thread = std::thread(&Fabulatorium::Worker::ThreadHandler, this);
+    this->thread.detach();
+}
+
+Fabulatorium::Worker::~Worker()
+{
+    ::close(this->arrivals.eventDescriptor);
+    ::close(this->pollDescriptor);
+}
+
+/**
+ * @brief   Hand over a session to the worker thread.
+ *
+ * May be called by any thread.
+ */
+void
+Fabulatorium::Worker::adopt(Fabulatorium::Session* session)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->arrivals.lock);
+
+        this->arrivals.sessions.push_back(session);
+    }
+
+    eventfd_write(this->arrivals.eventDescriptor, 1);
+}
+
+/**
+ * @brief   Thread handler of worker.
+ */
+void
+Fabulatorium::Worker::ThreadHandler(Fabulatorium::Worker* worker)
+{
+    ReportDebug("[Fabulatorium] Worker thread has been started");
+
+    struct epoll_event events[Fabulatorium::ReactorEventsPerWait];
+
+    for (;;)
+    {
+        // Wake up once per tick only as long as some session may time out.
+        //
+        const int numberOfEvents = epoll_wait(
+                worker->pollDescriptor,
+                events,
+                Fabulatorium::ReactorEventsPerWait,
+                (worker->wheel.empty() == true) ? -1 : (int) Fabulatorium::TimerWheelTick);
+
+        if (numberOfEvents == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            ReportError("[Fabulatorium] Worker cannot wait for events: errno=%d",
+                    errno);
+
+            std::this_thread::sleep_for(
+                    std::chrono::milliseconds { Fabulatorium::TimerWheelTick } );
+
+            continue;
+        }
+
+        for (int eventIndex = 0; eventIndex < numberOfEvents; eventIndex++)
+        {
+            Fabulatorium::Session* session = (Fabulatorium::Session*) events[eventIndex].data.ptr;
+
+            if (session == NULL)
+            {
+                worker->takeArrivals();
+            }
+            else
+            {
+                worker->serve(session);
+            }
+        }
+
+        worker->wheel.expire(worker->expired);
+
+        for (std::vector<Fabulatorium::Session*>::iterator session = worker->expired.begin();
+             session != worker->expired.end();
+             session++)
+        {
+            // Paused sessions have not timed out but look again whether to go on.
+            //
+            if ((*session)->inputPaused() == true)
+            {
+                worker->serve(*session);
+
+                continue;
+            }
+
+            (*session)->timedOut();
+
+            worker->close(*session);
+        }
+
+        worker->expired.clear();
+    }
+}
+
+/**
+ * @brief   Register sessions handed over by listeners.
+ */
+void
+Fabulatorium::Worker::takeArrivals()
+{
+    eventfd_t counter;
+
+    eventfd_read(this->arrivals.eventDescriptor, &counter);
+
+    {
+        std::lock_guard<std::mutex> lock(this->arrivals.lock);
+
+        this->arrivals.taken.swap(this->arrivals.sessions);
+    }
+
+    for (std::vector<Fabulatorium::Session*>::iterator session = this->arrivals.taken.begin();
+         session != this->arrivals.taken.end();
+         session++)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events    = EPOLLIN;
+        event.data.ptr  = *session;
+
+        if (epoll_ctl(this->pollDescriptor, EPOLL_CTL_ADD, (*session)->socket(), &event) == -1)
+        {
+            ReportWarning("[Fabulatorium] Cannot watch session: errno=%d",
+                    errno);
+
+            delete *session;
+
+            continue;
+        }
+
+        (*session)->watchedEvents = EPOLLIN;
+
+        this->wheel.arm(*session, (*session)->timeout());
+    }
+
+    this->arrivals.taken.clear();
+}
+
+/**
+ * @brief   Let a session handle what its socket is ready for.
+ *
+ * Errors and hang-ups are left to the session to find out by receiving or sending.
+ */
+void
+Fabulatorium::Worker::serve(Fabulatorium::Session* session)
+{
+    const bool sessionOK = (session->outputPending() == true)
+            ? session->handleOutput()
+            : session->handleInput();
+
+    if (sessionOK == false)
+    {
+        this->close(session);
+
+        return;
+    }
+
+    this->watch(session);
+
+    const unsigned int timeout = session->timeout();
+
+    if (timeout == 0)
+    {
+        this->wheel.cancel(session);
+    }
+    else
+    {
+        this->wheel.arm(session, timeout);
+    }
+}
+
+/**
+ * @brief   Watch for room to write while a response is pending, otherwise for input.
+ *
+ * Input is not read meanwhile, so that a fabulator which does not take its
+ * responses is slowed down. A session which has paused its input is not
+ * watched at all, as a hang-up would be reported over and over again,
+ * and is served again by its timer.
+ */
+void
+Fabulatorium::Worker::watch(Fabulatorium::Session* session)
+{
+    uint32_t events = EPOLLIN;
+
+    if (session->outputPending() == true)
+    {
+        events = EPOLLOUT;
+    }
+    else if (session->inputPaused() == true)
+    {
+        events = 0;
+    }
+
+    if (session->watchedEvents == events)
+        return;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events    = events;
+    event.data.ptr  = session;
+
+    if (events == 0)
+    {
+        epoll_ctl(this->pollDescriptor, EPOLL_CTL_DEL, session->socket(), NULL);
+    }
+    else if (session->watchedEvents == 0)
+    {
+        epoll_ctl(this->pollDescriptor, EPOLL_CTL_ADD, session->socket(), &event);
+    }
+    else
+    {
+        epoll_ctl(this->pollDescriptor, EPOLL_CTL_MOD, session->socket(), &event);
+    }
+
+    session->watchedEvents = events;
+}
+
+void
+Fabulatorium::Worker::close(Fabulatorium::Session* session)
+{
+    this->wheel.cancel(session);
+
+    if (session->watchedEvents != 0)
+        epoll_ctl(this->pollDescriptor, EPOLL_CTL_DEL, session->socket(), NULL);
+
+    delete session;
+}
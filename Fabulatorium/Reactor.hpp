@@ -0,0 +1,151 @@
+#pragma once
+
+// System definition files.
+//
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Fabulatorium
+{
+    /**
+     * Number of slots of a timer wheel. Must be a power of two.
+     */
+    static const unsigned int TimerWheelSlots = 512;
+
+    /**
+     * Resolution of a timer wheel in milliseconds.
+     */
+    static const unsigned int TimerWheelTick = 10;
+
+    /**
+     * Maximal number of events taken from the poll descriptor at once.
+     */
+    static const unsigned int ReactorEventsPerWait = 64;
+
+    class Session;
+
+    /**
+     * Hashed timer wheel of session timeouts.
+     *
+     * Sessions are linked into the slot of their expiry tick, so that arming
+     * and cancelling a timeout takes constant time however many sessions there are.
+     * Timeouts longer than one revolution stay in their slot until their tick has come.
+     */
+    class TimerWheel
+    {
+    private:
+        Fabulatorium::Session*      slots[Fabulatorium::TimerWheelSlots];
+        uint64_t                    currentTick;
+        unsigned int                numberOfTimers;
+
+    public:
+        TimerWheel();
+
+        bool
+        empty() const
+        { return this->numberOfTimers == 0; }
+
+        void
+        arm(
+            Fabulatorium::Session*  session,
+            const unsigned int      milliseconds);
+
+        void
+        cancel(Fabulatorium::Session*);
+
+        void
+        expire(std::vector<Fabulatorium::Session*>& expired);
+
+    private:
+        static uint64_t
+        CurrentTick();
+    };
+
+    /**
+     * Thread serving its share of sessions from one poll descriptor.
+     */
+    class Worker
+    {
+    private:
+        /**
+         * Thread handler of worker thread.
+         */
+        std::thread                 thread;
+
+        int                         pollDescriptor;
+
+        /**
+         * Sessions handed over by listeners, taken by the worker
+         * once the event descriptor has woken it up.
+         */
+        struct
+        {
+            int                                 eventDescriptor;
+            std::mutex                          lock;
+            std::vector<Fabulatorium::Session*> sessions;
+            std::vector<Fabulatorium::Session*> taken;
+        }
+        arrivals;
+
+        Fabulatorium::TimerWheel    wheel;
+
+        std::vector<Fabulatorium::Session*> expired;
+
+    public:
+        Worker();
+
+        ~Worker();
+
+        void
+        adopt(Fabulatorium::Session*);
+
+    private:
+        static void
+        ThreadHandler(Fabulatorium::Worker*);
+
+        void
+        takeArrivals();
+
+        void
+        serve(Fabulatorium::Session*);
+
+        void
+        watch(Fabulatorium::Session*);
+
+        void
+        close(Fabulatorium::Session*);
+    };
+
+    /**
+     * Fixed set of worker threads serving fabulator sessions of all listeners
+     * with non-blocking sockets, instead of a thread for each session.
+     */
+    class Reactor
+    {
+    private:
+        std::vector<Fabulatorium::Worker*>  workers;
+        std::atomic<unsigned int>           nextWorker;
+
+    public:
+        static Fabulatorium::Reactor&
+        InitInstance();
+
+        static Fabulatorium::Reactor&
+        SharedInstance();
+
+    private:
+        Reactor();
+
+        ~Reactor();
+
+    public:
+        void
+        start(const unsigned int numberOfWorkers);
+
+        void
+        adopt(Fabulatorium::Session*);
+    };
+};
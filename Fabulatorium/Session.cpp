@@ -1,16 +1,18 @@
 // System definition files.
 //
-#include <algorithm>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
 #include <cstdbool>
+#include <cstdint>
 #include <cstdlib>
 #include <stdexcept>
 #include <string>
-#include <thread>
 
 // Common definition files.
 //
-#include "Communicator/IP.hpp"
-#include "Communicator/TCP.hpp"
 #include "RTSP/RTSP.hpp"
 #include "Toolkit/Report.h"
 
@@ -19,301 +21,529 @@
 #include "Servus/Configuration.hpp"
 #include "Servus/Dispatcher/Aviso.hpp"
 #include "Servus/Dispatcher/Queue.hpp"
+#include "Servus/Fabulatorium/Fabulator.hpp"
 #include "Servus/Fabulatorium/Listener.hpp"
 #include "Servus/Fabulatorium/Session.hpp"
+#include "Servus/Fabulatorium/Statistics.hpp"
+#include "Servus/Fabulatorium/Suppressor.hpp"
 
 Fabulatorium::Session::Session(
-    TCP::Service&       service,
-    const unsigned int  waitForFirstTransmission,
-    const unsigned int  waitForTransmissionCompletion) :
-Inherited(service),
+    Fabulatorium::Traffic&  statistics,
+    const int               socket,
+    const unsigned int      waitForFirstTransmission,
+    const unsigned int      waitForTransmissionCompletion,
+    const unsigned int      pipelineDepth,
+    const bool              pauseWhenCongested) :
+descriptor(socket),
+statistics(statistics),
 waitForFirstTransmission(waitForFirstTransmission),
-waitForTransmissionCompletion(waitForTransmissionCompletion)
+waitForTransmissionCompletion(waitForTransmissionCompletion),
+pipelineDepth(pipelineDepth),
+pauseWhenCongested(pauseWhenCongested),
+reception(Fabulatorium::MaximalFabulaLength)
 {
-    this->receiveBuffer = (char*) malloc(Fabulatorium::MaximalFabulaLength);
-    if (this->receiveBuffer == NULL)
-    {
-        ReportSoftAlert("[Fabulatorium] Out of memory");
+    // Any CSeq other than expected means that either servus had a problem
+    // or be interpreted as intrusion attack.
+    //
+    this->expectedCSeq = 1;
+    this->transmissionBegan = false;
+    this->paused = false;
 
-        throw std::runtime_error("[Fabulatorium] Out of memory");
-    }
+    this->response.sentBytes = 0;
+    this->response.pending = false;
+
+    this->timer.previous = NULL;
+    this->timer.next = NULL;
+    this->timer.expiryTick = 0;
+    this->timer.armed = false;
+
+    this->watchedEvents = 0;
 }
 
 Fabulatorium::Session::~Session()
 {
-    free(this->receiveBuffer);
+    close(this->descriptor);
+
+    this->statistics.countClosed();
 }
 
-void
-Fabulatorium::Session::ThreadHandler(Fabulatorium::Session* session)
+/**
+ * @brief   Receive whatever the socket has available and answer every complete fabula.
+ *
+ * Receiving stops as soon as a response cannot be sent completely,
+ * so that the session does not take more than it can answer. It also stops
+ * while the queue is congested if the session is to pause then; fabulas
+ * already received are answered nevertheless.
+ *
+ * @return  Boolean false if the session has to be closed.
+ */
+bool
+Fabulatorium::Session::handleInput()
 {
-    Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
+    for (;;)
+    {
+        if (this->processDatagrams() == false)
+            return false;
 
-    bool sessionOK = true;
+        if (this->response.pending == true)
+            return true;
 
-    // Session should begin with CSeq 1 incrementing for each new datagram.
-    // Any other value means that either servus had a problem or be interpreted as intrusion attack.
-    //
-    unsigned int expectedCSeq = 1;
+        this->paused = (this->pauseWhenCongested == true) &&
+                (Dispatcher::Queue::SharedInstance().congested() == true);
 
-    RTSP::Datagram request;
-    RTSP::Datagram response;
+        if (this->paused == true)
+            return true;
+
+        size_t receivedBytes;
+
+        try
+        {
+            receivedBytes = this->reception.receive(this->socket());
+        }
+        catch (Dispatcher::ReceiveError& exception)
+        {
+            if (exception.errorNumber == 0)
+            {
+                ReportDebug("[Fabulatorium] Disconnected");
+            }
+            else
+            {
+                ReportWarning("[Fabulatorium] Connection is broken: errno=%d",
+                        exception.errorNumber);
+            }
+
+            return false;
+        }
+        catch (Dispatcher::BrokenDatagram& exception)
+        {
+            ReportWarning("[Fabulatorium] Rejected fabula: %s", exception.what());
+
+            this->statistics.countReject(Fabulatorium::RejectMalformed);
+
+            return false;
+        }
+
+        if (receivedBytes == 0)
+        {
+            this->reception.release();
+
+            return true;
+        }
+
+        this->transmissionBegan = true;
+
+        this->statistics.countBytes(receivedBytes);
+    }
+}
+
+/**
+ * @brief   Continue sending the pending response and answer fabulas received meanwhile.
+ *
+ * @return  Boolean false if the session has to be closed.
+ */
+bool
+Fabulatorium::Session::handleOutput()
+{
+    if (this->sendResponse() == false)
+        return false;
+
+    if (this->response.pending == true)
+        return true;
+
+    return this->processDatagrams();
+}
+
+/**
+ * @brief   Time the worker may wait for the socket before the session times out.
+ *
+ * @return  Time in milliseconds, zero for no timeout.
+ */
+unsigned int
+Fabulatorium::Session::timeout() const
+{
+    // Look again at the queue after a while, as nothing will come from the socket.
+    //
+    if (this->paused == true)
+        return Servus::CongestionRecheckInterval;
 
     // Wait for the beginning of transmission (it should not explicitly begin immediately).
-    // Cancel session in case of timeout.
     //
-    try
+    if (this->transmissionBegan == false)
+        return this->waitForFirstTransmission;
+
+    // Wait until next chunk of datagram or of response is through.
+    //
+    if ((this->response.pending == true) || (this->reception.pending() != 0))
+        return this->waitForTransmissionCompletion;
+
+    // Keep-alive sessions wait for the next datagram as long as it takes.
+    //
+    return 0;
+}
+
+void
+Fabulatorium::Session::timedOut()
+{
+    if (this->transmissionBegan == false)
     {
-        Communicator::Poll(
-                session->socket(),
-                session->waitForFirstTransmission);
+        ReportNotice("[Fabulatorium] Poll for transmission timed out");
     }
-    catch (Communicator::PollError& exception)
+    else if (this->response.pending == true)
     {
-        ReportNotice("[Fabulatorium] Poll for transmission did break");
-
-        goto out;
+        ReportWarning("[Fabulatorium] Send of response timed out");
     }
-    catch (Communicator::PollTimeout& exception)
+    else
     {
-        ReportNotice("[Fabulatorium] Poll for transmission timed out");
-
-        goto out;
+        ReportWarning("[Fabulatorium] Poll for chunk timed out");
     }
+}
 
-    // Manage an endless loop of:
-    //   - Receive datagram - if necessary receive several chunks until datagram is complete.
-    //   - Process datagram.
-    //   - Based on received fabula generate aviso.
-    //   - Enqueue aviso.
-    //   - Generate response.
-    //   - Send response.
-    //
-    do
+/**
+ * @brief   Answer complete fabulas in the receive ring until a response stays pending.
+ *
+ * Fabulas already received are processed in CSeq order, up to the pipeline depth,
+ * and their responses are sent together.
+ *
+ * @return  Boolean false if the session has to be closed.
+ */
+bool
+Fabulatorium::Session::processDatagrams()
+{
+    Dispatcher::DatagramView request;
+
+    while (this->response.pending == false)
     {
-        request.reset();
+        unsigned int numberOfRequests = 0;
+        bool sessionOK = true;
+        bool exhausted = false;
 
-        // Receive datagram chunks continuously until either complete datagram
-        // is received or timeout ocures.
-        //
-        for (;;)
+        while (numberOfRequests < this->pipelineDepth)
         {
-            unsigned int receivedBytes;
-
             try
             {
-                receivedBytes = Communicator::Receive(
-                        session->socket(),
-                        session->receiveBuffer,
-                        Fabulatorium::MaximalFabulaLength);
-            }
-            catch (Communicator::TransmissionError& exception)
-            {
-                ReportWarning("[Fabulatorium] Connection is broken: errno=%d",
-                        exception.errorNumber);
+                if (this->reception.take(request) == false)
+                {
+                    exhausted = true;
 
-                goto out;
+                    break;
+                }
             }
-            catch (Communicator::NothingReceived& exception)
+            catch (Dispatcher::BrokenDatagram& exception)
             {
-                ReportDebug("[Fabulatorium] Disconnected");
-
-                goto out;
-            }
+                ReportWarning("[Fabulatorium] Rejected fabula: %s", exception.what());
 
-            // Statistics.
-            //
-            {
-                //listener->statistics.receivedBytes += receivedBytes;
-            }
+                this->statistics.countReject(Fabulatorium::RejectMalformed);
 
-            try
-            {
-                request.push(session->receiveBuffer, receivedBytes);
-            }
-            catch (std::exception& exception)
-            {
-                ReportWarning("[Fabulatorium] Rejected fabula: %s", exception.what());
+                sessionOK = false;
 
                 break;
             }
 
-            if (request.datagramComplete() == true)
-            {
+            const std::chrono::steady_clock::time_point processingBegan =
+                    std::chrono::steady_clock::now();
+
+            sessionOK = this->handleDatagram(request);
+
+            this->statistics.countFabula(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - processingBegan).count());
+
+            this->response.output.append(
+                    this->response.datagram.contentBuffer,
+                    this->response.datagram.contentLength);
+
+            numberOfRequests++;
+
+            if (sessionOK == false)
                 break;
-            }
 
-            // Wait until next chunk of datagram is available.
-            // Cancel session in case of timeout.
+            // CSeq for each new datagram should be incremented by one.
             //
-            try
-            {
-                Communicator::Poll(
-                        session->socket(),
-                        session->waitForTransmissionCompletion);
-            }
-            catch (Communicator::PollError& exception)
-            {
-                ReportWarning("[Fabulatorium] Poll for chunk did break");
+            this->expectedCSeq++;
+        }
 
-                goto out;
-            }
-            catch (Communicator::PollTimeout& exception)
-            {
-                ReportWarning("[Fabulatorium] Poll for chunk timed out");
+        if (numberOfRequests != 0)
+        {
+            this->response.sentBytes = 0;
+            this->response.pending = true;
 
-                goto out;
-            }
+            if (this->sendResponse() == false)
+                return false;
         }
 
-        // Statistics.
+        // Responses to a rejected datagram and to those before it are sent at best effort.
         //
+        if (sessionOK == false)
+            return false;
+
+        if (exhausted == true)
         {
-            //listener->statistics.receivedFabulas++;
+            // Idle keep-alive sessions hold no buffer.
+            //
+            this->reception.release();
+
+            return true;
         }
+    }
 
+    return true;
+}
+
+/**
+ * @brief   Process datagram, enqueue aviso based on received fabula and generate response.
+ *
+ * @return  Boolean false if the datagram has been rejected.
+ */
+bool
+Fabulatorium::Session::handleDatagram(Dispatcher::DatagramView& request)
+{
+    Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
+
+    RTSP::Datagram& response = this->response.datagram;
+
+    try
+    {
         try
+        {
+            const unsigned int providedCSeq = request.number("CSeq");
+
+            if (providedCSeq != this->expectedCSeq)
+            {
+                response.reset();
+                response["CSeq"] = this->expectedCSeq;
+                response["Agent"] = Servus::SoftwareVersion;
+                response["Reason"] = "Unexpected CSeq";
+                response.generateResponse(RTSP::BadRequest);
+
+                throw Fabulatorium::RejectDatagram("Unexpected CSeq",
+                        Fabulatorium::RejectCSeq);
+            }
+        }
+        catch (RTSP::StatementNotFound& exception)
+        {
+            response.reset();
+            response["CSeq"] = this->expectedCSeq;
+            response["Agent"] = Servus::SoftwareVersion;
+            response["Reason"] = "Missing CSeq";
+            response.generateResponse(RTSP::BadRequest);
+
+            throw Fabulatorium::RejectDatagram("Missing CSeq",
+                    Fabulatorium::RejectCSeq);
+        }
+
+        if (request.methodIs("FABULA") == true)
         {
             try
             {
-                const unsigned int providedCSeq = request["CSeq"];
+                const std::string     timestamp         = request.text("Timestamp");
+                const std::string     fabulatorName     = (this->peerIdentity.empty() == true)
+                        ? request.text("Originator")
+                        : this->peerIdentity;
 
-                if (providedCSeq != expectedCSeq)
+                if (fabulatorName.length() == 0)
                 {
                     response.reset();
-                    response["CSeq"] = expectedCSeq;
+                    response["CSeq"] = this->expectedCSeq;
                     response["Agent"] = Servus::SoftwareVersion;
-                    response["Reason"] = "Unexpected CSeq";
+                    response["Reason"] = "Missing fabulator";
                     response.generateResponse(RTSP::BadRequest);
 
-                    throw Fabulatorium::RejectDatagram("Unexpected CSeq");
+                    throw Fabulatorium::RejectDatagram("Missing fabulator",
+                            Fabulatorium::RejectMalformed);
                 }
-            }
-            catch (RTSP::StatementNotFound& exception)
-            {
-                response.reset();
-                response["CSeq"] = expectedCSeq;
-                response["Agent"] = Servus::SoftwareVersion;
-                response["Reason"] = "Missing CSeq";
-                response.generateResponse(RTSP::BadRequest);
 
-                throw Fabulatorium::RejectDatagram("Missing CSeq");
-            }
+                Fabulatorium::Registry& registry = Fabulatorium::Registry::SharedInstance();
 
-            if (request.methodIs("FABULA") == true)
-            {
-                try
+                Fabulatorium::Fabulator* fabulator = registry.lookup(fabulatorName);
+
+                if ((fabulator == NULL) && (registry.acceptsUnknown() == false))
                 {
-                    const std::string     timestamp         = request["Timestamp"];
-                    const std::string     fabulatorName     = request["Originator"];
-                    const unsigned short  severityLevel     = request["Severity"];
-                    const bool            notificationFlag  = request["Notification"];
-
-                    if (fabulatorName.length() == 0)
-                    {
-                        response.reset();
-                        response["CSeq"] = expectedCSeq;
-                        response["Agent"] = Servus::SoftwareVersion;
-                        response["Reason"] = "Missing fabulator";
-                        response.generateResponse(RTSP::BadRequest);
-
-                        throw Fabulatorium::RejectDatagram("Missing fabulator");
-                    }
-
-                    if (request.payloadLength() == 0)
-                    {
-                        response.reset();
-                        response["CSeq"] = expectedCSeq;
-                        response["Agent"] = Servus::SoftwareVersion;
-                        response["Reason"] = "Missing payload";
-                        response.generateResponse(RTSP::BadRequest);
-
-                        throw Fabulatorium::RejectDatagram("Missing payload");
-                    }
-
-                    ReportDebug("[Fabulatorium] Received fabula from \"%s\"",
-                            fabulatorName.c_str());
+                    response.reset();
+                    response["CSeq"] = this->expectedCSeq;
+                    response["Agent"] = Servus::SoftwareVersion;
+                    response["Reason"] = "Unknown fabulator";
+                    response.generateResponse(RTSP::Forbidden);
+
+                    throw Fabulatorium::RejectDatagram("Unknown fabulator",
+                            Fabulatorium::RejectUnknown);
+                }
 
-                    Dispatcher::FabulaAviso* aviso = new Dispatcher::FabulaAviso(
-                            timestamp,
-                            fabulatorName,
-                            severityLevel,
-                            notificationFlag,
-                            request.payload());
+                // Fabulators from the configuration may leave out what their defaults tell.
+                //
+                Dispatcher::DatagramSpan value;
 
-                    queue.enqueueAviso(aviso);
+                const unsigned short  severityLevel     =
+                        ((fabulator == NULL) || (request.find("Severity", value) == true))
+                        ? request.number("Severity")
+                        : fabulator->defaultSeverityLevel;
+                const bool            notificationFlag  =
+                        ((fabulator == NULL) || (request.find("Notification", value) == true))
+                        ? request.flag("Notification")
+                        : fabulator->defaultNotificationFlag;
 
+                if (request.payload.length == 0)
+                {
                     response.reset();
-                    response["CSeq"] = expectedCSeq;
+                    response["CSeq"] = this->expectedCSeq;
                     response["Agent"] = Servus::SoftwareVersion;
-                    response.generateResponse(RTSP::Created);
+                    response["Reason"] = "Missing payload";
+                    response.generateResponse(RTSP::BadRequest);
+
+                    throw Fabulatorium::RejectDatagram("Missing payload",
+                            Fabulatorium::RejectPayload);
                 }
-                catch (std::exception& exception)
+
+                // Fabulators held back are answered without closing the session,
+                // so that they may go on once they have waited.
+                //
+                if ((fabulator != NULL) && (fabulator->admit() == false))
                 {
+                    this->statistics.countReject(Fabulatorium::RejectThrottled);
+
                     response.reset();
-                    response["CSeq"] = expectedCSeq;
+                    response["CSeq"] = this->expectedCSeq;
                     response["Agent"] = Servus::SoftwareVersion;
-                    response["Reason"] = "Error by parsing";
-                    response.generateResponse(RTSP::BadRequest);
+                    response["Reason"] = "Rate limit exceeded";
+                    response.generateResponse(RTSP::ServiceUnavailable);
+
+                    return true;
+                }
+
+                if (queue.congested() == true)
+                {
+                    this->statistics.countReject(Fabulatorium::RejectCongested);
+
+                    response.reset();
+                    response["CSeq"] = this->expectedCSeq;
+                    response["Agent"] = Servus::SoftwareVersion;
+                    response["Reason"] = "Queue congested";
+                    response["Retry-After"] = queue.retryAfter();
+                    response.generateResponse(RTSP::ServiceUnavailable);
 
-                    throw Fabulatorium::RejectDatagram("Error by parsing");
+                    return true;
+                }
+
+                ReportDebug("[Fabulatorium] Received fabula from \"%s\"",
+                        fabulatorName.c_str());
+
+                Dispatcher::FabulaAviso* aviso = new Dispatcher::FabulaAviso(
+                        timestamp,
+                        fabulatorName,
+                        severityLevel,
+                        notificationFlag,
+                        request.at(request.payload),
+                        request.payload.length);
+
+                try
+                {
+                    if (Fabulatorium::Suppressor::SharedInstance().absorb(aviso) == true)
+                        this->statistics.countSuppressed();
+                    else
+                        queue.enqueueAviso(aviso);
+
+                    response.reset();
+                    response["CSeq"] = this->expectedCSeq;
+                    response["Agent"] = Servus::SoftwareVersion;
+
+                    // Let the fabulator know how many requests it may keep outstanding.
+                    //
+                    if (this->expectedCSeq == 1)
+                        response["Pipeline-Depth"] = this->pipelineDepth;
+
+                    response.generateResponse(RTSP::Created);
+                }
+                catch (Dispatcher::QueueOverflow&)
+                {
+                    this->statistics.countOverflow();
+
+                    ReportWarning("[Fabulatorium] Dropped fabula from \"%s\": queue overflow",
+                            fabulatorName.c_str());
+
+                    delete aviso;
+
+                    response.reset();
+                    response["CSeq"] = this->expectedCSeq;
+                    response["Agent"] = Servus::SoftwareVersion;
+                    response["Reason"] = "Queue overflow";
+                    response.generateResponse(RTSP::ServiceUnavailable);
                 }
             }
-            else
+            catch (Fabulatorium::RejectDatagram&)
+            {
+                throw;
+            }
+            catch (std::exception& exception)
             {
                 response.reset();
-                response["CSeq"] = expectedCSeq;
+                response["CSeq"] = this->expectedCSeq;
                 response["Agent"] = Servus::SoftwareVersion;
-                response.generateResponse(RTSP::MethodNotAllowed);
+                response["Reason"] = "Error by parsing";
+                response.generateResponse(RTSP::BadRequest);
 
-                throw Fabulatorium::RejectDatagram("Unknown method");
+                throw Fabulatorium::RejectDatagram("Error by parsing",
+                        Fabulatorium::RejectMalformed);
             }
         }
-        catch (Fabulatorium::RejectDatagram& exception)
+        else
         {
-            ReportWarning("[Fabulatorium] Rejected: %s", exception.what());
+            response.reset();
+            response["CSeq"] = this->expectedCSeq;
+            response["Agent"] = Servus::SoftwareVersion;
+            response.generateResponse(RTSP::MethodNotAllowed);
 
-            sessionOK = false;
+            throw Fabulatorium::RejectDatagram("Unknown method",
+                    Fabulatorium::RejectMethod);
         }
+    }
+    catch (Fabulatorium::RejectDatagram& exception)
+    {
+        ReportWarning("[Fabulatorium] Rejected: %s", exception.what());
 
-        try
-        {
-            Communicator::Send(
-                    session->socket(),
-                    response.contentBuffer,
-                    response.contentLength);
-        }
-        catch (...)
-        { }
+        this->statistics.countReject(exception.cause);
 
-        if (sessionOK == false)
-            break;
+        return false;
+    }
 
-        // Wait until next datagram is available.
-        //
-        try
-        {
-            Communicator::Poll(session->socket());
-        }
-        catch (Communicator::PollError&)
-        {
-            ReportNotice("[Fabulatorium] Keep-alive polling did break");
+    return true;
+}
 
-            goto out;
-        }
-        catch (Communicator::PollTimeout&)
+/**
+ * @brief   Send as much of the pending responses as the socket takes without blocking.
+ *
+ * @return  Boolean false if the connection is broken.
+ */
+bool
+Fabulatorium::Session::sendResponse()
+{
+    const std::string& output = this->response.output;
+
+    while (this->response.sentBytes < output.length())
+    {
+        ssize_t sentBytes = send(this->socket(),
+                output.data() + this->response.sentBytes,
+                output.length() - this->response.sentBytes,
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (sentBytes > 0)
         {
-            ReportNotice("[Fabulatorium] Session timed out");
+            this->response.sentBytes += sentBytes;
 
-            goto out;
+            continue;
         }
 
-        // CSeq for each new datagram should be incremented by one.
-        //
-        expectedCSeq++;
+        if ((sentBytes == -1) && (errno == EINTR))
+            continue;
+
+        if ((sentBytes == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            return true;
+
+        ReportNotice("[Fabulatorium] Cannot send response: errno=%d", errno);
+
+        return false;
     }
-    while (sessionOK == true);
 
-out:
-    delete session;
+    this->response.output.clear();
+    this->response.pending = false;
+
+    return true;
 }
@@ -2,41 +2,162 @@
 
 // System definition files.
 //
+#include <cstdint>
 #include <stdexcept>
+#include <string>
 
 // Common definition files.
 //
-#include "Communicator/TCP.hpp"
+#include "RTSP/RTSP.hpp"
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/ReceiveRing.hpp"
+#include "Servus/Fabulatorium/Statistics.hpp"
 
 namespace Fabulatorium
 {
-    class Session : public TCP::Connection
+    /**
+     * Connection of a fabulator, driven by the worker it has been handed over to.
+     *
+     * The session never blocks: it handles whatever its socket is ready for
+     * and tells the worker how long it may wait for the next chunk.
+     * It owns the socket accepted by its listener, be it TCP or UNIX domain.
+     */
+    class Session
     {
-        typedef TCP::Connection Inherited;
-
     private:
+        int                 descriptor;
+
+        /**
+         * Traffic counters of the listener which accepted the session.
+         */
+        Fabulatorium::Traffic&  statistics;
+
+        /**
+         * Fabulator as identified by the operating system, taken instead
+         * of the originator told by the fabulator if not empty.
+         */
+        std::string         peerIdentity;
+
         unsigned int        waitForFirstTransmission;
         unsigned int        waitForTransmissionCompletion;
 
-        char*               receiveBuffer;
+        /**
+         * Number of requests answered with one send at most.
+         */
+        unsigned int        pipelineDepth;
+
+        /**
+         * Whether the session stops reading while the queue is congested, and does.
+         */
+        bool                pauseWhenCongested;
+        bool                paused;
+
+        /**
+         * Fabulas are parsed in place and their messages taken straight out of it.
+         */
+        Dispatcher::ReceiveRing reception;
+
+        /**
+         * Session should begin with CSeq 1 incrementing for each new datagram.
+         */
+        unsigned int        expectedCSeq;
+
+        bool                transmissionBegan;
+
+        /**
+         * Responses to a batch of pipelined requests, sent together
+         * and not yet taken completely by the socket.
+         */
+        struct
+        {
+            RTSP::Datagram      datagram;
+            std::string         output;
+            uint32_t            sentBytes;
+            bool                pending;
+        }
+        response;
+
+    public:
+        /**
+         * Links of the timer wheel, owned by the worker serving the session.
+         */
+        struct
+        {
+            Fabulatorium::Session*  previous;
+            Fabulatorium::Session*  next;
+            uint64_t                expiryTick;
+            bool                    armed;
+        }
+        timer;
+
+        /**
+         * Events the worker polls the socket for, none while input is paused.
+         */
+        uint32_t            watchedEvents;
 
     public:
         Session(
-            TCP::Service&,
-            const unsigned int waitForFirstTransmission,
-            const unsigned int waitForTransmissionCompletion);
+            Fabulatorium::Traffic&  statistics,
+            const int               socket,
+            const unsigned int      waitForFirstTransmission,
+            const unsigned int      waitForTransmissionCompletion,
+            const unsigned int      pipelineDepth,
+            const bool              pauseWhenCongested);
 
         ~Session();
 
-        static void
-        ThreadHandler(Session*);
+        int
+        socket() const
+        { return this->descriptor; }
+
+        void
+        identifyPeer(const std::string& peerIdentity)
+        { this->peerIdentity = peerIdentity; }
+
+        bool
+        handleInput();
+
+        bool
+        handleOutput();
+
+        bool
+        outputPending() const
+        { return this->response.pending; }
+
+        bool
+        inputPaused() const
+        { return this->paused; }
+
+        unsigned int
+        timeout() const;
+
+        void
+        timedOut();
+
+    private:
+        bool
+        processDatagrams();
+
+        bool
+        handleDatagram(Dispatcher::DatagramView&);
+
+        bool
+        sendResponse();
     };
 
     class RejectDatagram : public std::runtime_error
     {
     public:
-        RejectDatagram(const char* const reason) throw() :
-        std::runtime_error(reason)
+        Fabulatorium::RejectReason cause;
+
+    public:
+        RejectDatagram(
+            const char* const                   reason,
+            const Fabulatorium::RejectReason    cause) throw() :
+        std::runtime_error(reason),
+        cause(cause)
         { }
     };
 };
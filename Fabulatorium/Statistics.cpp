@@ -0,0 +1,424 @@
+// System definition files.
+//
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+// Local definition files.
+//
+#include "Servus/Fabulatorium/Statistics.hpp"
+
+using namespace rapidjson;
+
+static const char* const RejectReasonNames[Fabulatorium::RejectReasons] =
+{
+    "cseq",
+    "payload",
+    "method",
+    "malformed",
+    "unknown",
+    "throttled",
+    "congested"
+};
+
+static std::atomic<unsigned int> nextThreadSlot(0);
+
+static thread_local int threadSlot = -1;
+
+static Fabulatorium::Statistics* instance = NULL;
+
+Fabulatorium::Traffic::Traffic()
+{
+    for (unsigned int slotIndex = 0;
+         slotIndex < Fabulatorium::StatisticsSlots;
+         slotIndex++)
+    {
+        Fabulatorium::TrafficCounters& counters = this->slots[slotIndex];
+
+        counters.acceptedConnections.store(0, std::memory_order_relaxed);
+        counters.closedConnections.store(0, std::memory_order_relaxed);
+        counters.receivedFabulas.store(0, std::memory_order_relaxed);
+        counters.receivedBytes.store(0, std::memory_order_relaxed);
+        counters.overflows.store(0, std::memory_order_relaxed);
+        counters.lostFabulas.store(0, std::memory_order_relaxed);
+        counters.suppressedFabulas.store(0, std::memory_order_relaxed);
+        counters.shedConnections.store(0, std::memory_order_relaxed);
+
+        for (unsigned int reasonIndex = 0;
+             reasonIndex < Fabulatorium::RejectReasons;
+             reasonIndex++)
+        {
+            counters.rejects[reasonIndex].store(0, std::memory_order_relaxed);
+        }
+
+        for (unsigned int bucketIndex = 0;
+             bucketIndex < Fabulatorium::LatencyBuckets;
+             bucketIndex++)
+        {
+            counters.latency[bucketIndex].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    this->openSessions.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief   Count a new session unless the listener has as many open as it may.
+ *
+ * @param   maximalSessions     Limit of open sessions, zero for no limit.
+ *
+ * @return  Boolean false if the session is not to be opened.
+ */
+bool
+Fabulatorium::Traffic::admitSession(const unsigned int maximalSessions)
+{
+    unsigned int openSessions = this->openSessions.load(std::memory_order_relaxed);
+
+    do
+    {
+        if ((maximalSessions != 0) && (openSessions >= maximalSessions))
+            return false;
+    }
+    while (this->openSessions.compare_exchange_weak(
+            openSessions,
+            openSessions + 1,
+            std::memory_order_relaxed) == false);
+
+    Increment(this->local().acceptedConnections);
+
+    return true;
+}
+
+/**
+ * @brief   Wait until fewer sessions are open than the limit.
+ *
+ * @param   maximalSessions     Limit of open sessions, zero for no limit.
+ */
+void
+Fabulatorium::Traffic::waitForRoom(const unsigned int maximalSessions)
+{
+    if (maximalSessions == 0)
+        return;
+
+    std::unique_lock<std::mutex> closingLock { this->closing.lock };
+
+    this->closing.condition.wait(closingLock, [this, maximalSessions] {
+        return this->openSessions.load(std::memory_order_relaxed) < maximalSessions;
+    });
+}
+
+/**
+ * @brief   Count a closed session and wake acceptors waiting for room.
+ */
+void
+Fabulatorium::Traffic::countClosed()
+{
+    Increment(this->local().closedConnections);
+
+    // Decrement under the lock, so that an acceptor cannot miss it
+    // between looking at the number and going to sleep.
+    //
+    {
+        std::unique_lock<std::mutex> closingLock { this->closing.lock };
+
+        this->openSessions.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    this->closing.condition.notify_all();
+}
+
+/**
+ * @brief   Count a fabula together with the time it took to process it.
+ */
+void
+Fabulatorium::Traffic::countFabula(const uint64_t nanoseconds)
+{
+    Fabulatorium::TrafficCounters& counters = this->local();
+
+    uint64_t microseconds = nanoseconds / 1000;
+
+    unsigned int bucketIndex = 0;
+
+    while ((microseconds != 0) && (bucketIndex < Fabulatorium::LatencyBuckets - 1))
+    {
+        microseconds >>= 1;
+        bucketIndex++;
+    }
+
+    Increment(counters.receivedFabulas);
+    Increment(counters.latency[bucketIndex]);
+}
+
+/**
+ * @brief   Sum up the counters of all threads.
+ *
+ * Counters are read one by one while they are being written,
+ * so that the sums may be off by the fabulas processed meanwhile.
+ */
+void
+Fabulatorium::Traffic::snapshot(Fabulatorium::TrafficSnapshot& snapshot) const
+{
+    uint64_t closedConnections = 0;
+
+    snapshot.acceptedConnections = 0;
+    snapshot.receivedFabulas = 0;
+    snapshot.receivedBytes = 0;
+    snapshot.overflows = 0;
+    snapshot.lostFabulas = 0;
+    snapshot.suppressedFabulas = 0;
+    snapshot.shedConnections = 0;
+
+    for (unsigned int reasonIndex = 0;
+         reasonIndex < Fabulatorium::RejectReasons;
+         reasonIndex++)
+    {
+        snapshot.rejects[reasonIndex] = 0;
+    }
+
+    for (unsigned int bucketIndex = 0;
+         bucketIndex < Fabulatorium::LatencyBuckets;
+         bucketIndex++)
+    {
+        snapshot.latency[bucketIndex] = 0;
+    }
+
+    for (unsigned int slotIndex = 0;
+         slotIndex < Fabulatorium::StatisticsSlots;
+         slotIndex++)
+    {
+        const Fabulatorium::TrafficCounters& counters = this->slots[slotIndex];
+
+        snapshot.acceptedConnections += counters.acceptedConnections.load(std::memory_order_relaxed);
+        closedConnections += counters.closedConnections.load(std::memory_order_relaxed);
+        snapshot.receivedFabulas += counters.receivedFabulas.load(std::memory_order_relaxed);
+        snapshot.receivedBytes += counters.receivedBytes.load(std::memory_order_relaxed);
+        snapshot.overflows += counters.overflows.load(std::memory_order_relaxed);
+        snapshot.lostFabulas += counters.lostFabulas.load(std::memory_order_relaxed);
+        snapshot.suppressedFabulas += counters.suppressedFabulas.load(std::memory_order_relaxed);
+        snapshot.shedConnections += counters.shedConnections.load(std::memory_order_relaxed);
+
+        for (unsigned int reasonIndex = 0;
+             reasonIndex < Fabulatorium::RejectReasons;
+             reasonIndex++)
+        {
+            snapshot.rejects[reasonIndex] += counters.rejects[reasonIndex].load(std::memory_order_relaxed);
+        }
+
+        for (unsigned int bucketIndex = 0;
+             bucketIndex < Fabulatorium::LatencyBuckets;
+             bucketIndex++)
+        {
+            snapshot.latency[bucketIndex] += counters.latency[bucketIndex].load(std::memory_order_relaxed);
+        }
+    }
+
+    snapshot.activeConnections = (snapshot.acceptedConnections > closedConnections)
+            ? snapshot.acceptedConnections - closedConnections
+            : 0;
+}
+
+/**
+ * @brief   Set of counters of the calling thread, assigned on its first call.
+ */
+unsigned int
+Fabulatorium::Traffic::ThreadSlot()
+{
+    if (threadSlot == -1)
+    {
+        threadSlot = nextThreadSlot.fetch_add(1, std::memory_order_relaxed) %
+                Fabulatorium::StatisticsSlots;
+    }
+
+    return threadSlot;
+}
+
+/**
+ * @brief   Upper bound of the latency below which the given percentage of fabulas was processed.
+ *
+ * @return  Latency in microseconds, zero if no fabula has been processed yet.
+ */
+unsigned int
+Fabulatorium::TrafficSnapshot::latencyPercentile(const unsigned int percent) const
+{
+    uint64_t total = 0;
+
+    for (unsigned int bucketIndex = 0;
+         bucketIndex < Fabulatorium::LatencyBuckets;
+         bucketIndex++)
+    {
+        total += this->latency[bucketIndex];
+    }
+
+    if (total == 0)
+        return 0;
+
+    const uint64_t wanted = (total * percent + 99) / 100;
+
+    uint64_t counted = 0;
+
+    for (unsigned int bucketIndex = 0;
+         bucketIndex < Fabulatorium::LatencyBuckets;
+         bucketIndex++)
+    {
+        counted += this->latency[bucketIndex];
+
+        if (counted >= wanted)
+            return 1 << bucketIndex;
+    }
+
+    return 1 << (Fabulatorium::LatencyBuckets - 1);
+}
+
+Fabulatorium::Statistics&
+Fabulatorium::Statistics::InitInstance()
+{
+    if (instance != NULL)
+        throw std::runtime_error("[Fabulatorium] Statistics already initialized");
+
+    instance = new Fabulatorium::Statistics();
+
+    return *instance;
+}
+
+Fabulatorium::Statistics&
+Fabulatorium::Statistics::SharedInstance()
+{
+    if (instance == NULL)
+        throw std::runtime_error("[Fabulatorium] Statistics not initialized");
+
+    return *instance;
+}
+
+Fabulatorium::Statistics::Statistics()
+{ }
+
+void
+Fabulatorium::Statistics::registerListener(
+    const std::string&      listenerName,
+    Fabulatorium::Traffic*  traffic)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    Entry entry;
+    entry.listenerName = listenerName;
+    entry.traffic = traffic;
+
+    this->listeners.push_back(entry);
+}
+
+unsigned int
+Fabulatorium::Statistics::size()
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    return this->listeners.size();
+}
+
+void
+Fabulatorium::Statistics::snapshot(
+    const unsigned int              listenerIndex,
+    std::string&                    listenerName,
+    Fabulatorium::TrafficSnapshot&  snapshot)
+{
+    Fabulatorium::Traffic* traffic;
+
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+
+        if (listenerIndex >= this->listeners.size())
+            throw std::out_of_range("[Fabulatorium] No such listener");
+
+        listenerName = this->listeners[listenerIndex].listenerName;
+        traffic = this->listeners[listenerIndex].traffic;
+    }
+
+    traffic->snapshot(snapshot);
+}
+
+/**
+ * @brief   Traffic of all listeners as JSON document.
+ *
+ * Latency is given as the counts of the histogram buckets, bucket n
+ * counting fabulas processed in less than 2^n microseconds.
+ */
+std::string
+Fabulatorium::Statistics::json()
+{
+    StringBuffer buffer;
+    Writer<StringBuffer> writer(buffer);
+
+    writer.StartObject();
+    writer.Key("listeners");
+    writer.StartArray();
+
+    for (unsigned int listenerIndex = 0;
+         listenerIndex < this->size();
+         listenerIndex++)
+    {
+        std::string listenerName;
+        Fabulatorium::TrafficSnapshot traffic;
+
+        this->snapshot(listenerIndex, listenerName, traffic);
+
+        writer.StartObject();
+
+        // Listener names come from the configuration, writer escapes them.
+        //
+        writer.Key("name");
+        writer.String(listenerName.c_str(), (SizeType) listenerName.length());
+
+        writer.Key("accepted");
+        writer.Uint64(traffic.acceptedConnections);
+        writer.Key("active");
+        writer.Uint64(traffic.activeConnections);
+        writer.Key("fabulas");
+        writer.Uint64(traffic.receivedFabulas);
+        writer.Key("bytes");
+        writer.Uint64(traffic.receivedBytes);
+        writer.Key("overflows");
+        writer.Uint64(traffic.overflows);
+        writer.Key("lost");
+        writer.Uint64(traffic.lostFabulas);
+        writer.Key("suppressed");
+        writer.Uint64(traffic.suppressedFabulas);
+        writer.Key("shed");
+        writer.Uint64(traffic.shedConnections);
+
+        writer.Key("rejects");
+        writer.StartObject();
+
+        for (unsigned int reasonIndex = 0;
+             reasonIndex < Fabulatorium::RejectReasons;
+             reasonIndex++)
+        {
+            writer.Key(RejectReasonNames[reasonIndex]);
+            writer.Uint64(traffic.rejects[reasonIndex]);
+        }
+
+        writer.EndObject();
+
+        writer.Key("latency");
+        writer.StartArray();
+
+        for (unsigned int bucketIndex = 0;
+             bucketIndex < Fabulatorium::LatencyBuckets;
+             bucketIndex++)
+        {
+            writer.Uint64(traffic.latency[bucketIndex]);
+        }
+
+        writer.EndArray();
+
+        writer.EndObject();
+    }
+
+    writer.EndArray();
+    writer.EndObject();
+
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+// System definition files.
+//
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/Queue.hpp"
+
+namespace Fabulatorium
+{
+    /**
+     * Number of counter sets of each listener. Threads beyond this number share sets.
+     */
+    static const unsigned int StatisticsSlots = 16;
+
+    /**
+     * Buckets of the processing latency histogram. Bucket n counts fabulas
+     * processed in less than 2^n microseconds, the last one all others.
+     */
+    static const unsigned int LatencyBuckets = 16;
+
+    enum RejectReason
+    {
+        RejectCSeq          = 0,    /**< Missing or unexpected CSeq. */
+        RejectPayload       = 1,    /**< Missing payload. */
+        RejectMethod        = 2,    /**< Unknown method. */
+        RejectMalformed     = 3,    /**< Datagram or fabula cannot be parsed. */
+        RejectUnknown       = 4,    /**< Fabulator not in the configuration. */
+        RejectThrottled     = 5,    /**< Fabulator exceeded its rate. */
+        RejectCongested     = 6     /**< Queue above its high watermark. */
+    };
+
+    static const unsigned int RejectReasons = 7;
+
+    /**
+     * Counters of one thread, kept on cache lines of their own.
+     */
+    struct TrafficCounters
+    {
+        std::atomic<uint64_t>   acceptedConnections;
+        std::atomic<uint64_t>   closedConnections;
+        std::atomic<uint64_t>   receivedFabulas;
+        std::atomic<uint64_t>   receivedBytes;
+        std::atomic<uint64_t>   rejects[Fabulatorium::RejectReasons];
+        std::atomic<uint64_t>   overflows;
+        std::atomic<uint64_t>   lostFabulas;
+        std::atomic<uint64_t>   suppressedFabulas;
+        std::atomic<uint64_t>   shedConnections;
+        std::atomic<uint64_t>   latency[Fabulatorium::LatencyBuckets];
+        char                    padding[Dispatcher::CacheLineSize];
+    };
+
+    /**
+     * Sum of the counters of all threads at the time it was taken.
+     */
+    struct TrafficSnapshot
+    {
+        uint64_t                acceptedConnections;
+        uint64_t                activeConnections;
+        uint64_t                receivedFabulas;
+        uint64_t                receivedBytes;
+        uint64_t                rejects[Fabulatorium::RejectReasons];
+        uint64_t                overflows;
+        uint64_t                lostFabulas;
+        uint64_t                suppressedFabulas;
+        uint64_t                shedConnections;
+        uint64_t                latency[Fabulatorium::LatencyBuckets];
+
+        unsigned int
+        latencyPercentile(const unsigned int percent) const;
+    };
+
+    /**
+     * Traffic counters of a listener.
+     *
+     * Each thread counts into a set of its own, so that listener and worker
+     * threads never write to the same cache line. Counters are summed up
+     * only when they are read.
+     */
+    class Traffic
+    {
+    private:
+        Fabulatorium::TrafficCounters   slots[Fabulatorium::StatisticsSlots];
+
+        /**
+         * Sessions open at the moment, kept apart from the counters
+         * as it is compared against the limit of a listener.
+         */
+        std::atomic<unsigned int>       openSessions;
+
+        /**
+         * Signalled whenever a session closes, for acceptors deferring connections.
+         */
+        struct
+        {
+            std::mutex                  lock;
+            std::condition_variable     condition;
+        }
+        closing;
+
+    public:
+        Traffic();
+
+        bool
+        admitSession(const unsigned int maximalSessions);
+
+        void
+        waitForRoom(const unsigned int maximalSessions);
+
+        unsigned int
+        sessions() const
+        { return this->openSessions.load(std::memory_order_relaxed); }
+
+        void
+        countClosed();
+
+        void
+        countShed()
+        { Increment(this->local().shedConnections); }
+
+        void
+        countBytes(const uint64_t receivedBytes)
+        { Increment(this->local().receivedBytes, receivedBytes); }
+
+        void
+        countFabula(const uint64_t nanoseconds);
+
+        void
+        countReject(const Fabulatorium::RejectReason reason)
+        { Increment(this->local().rejects[reason]); }
+
+        void
+        countOverflow()
+        { Increment(this->local().overflows); }
+
+        void
+        countLost(const uint64_t lostFabulas)
+        { Increment(this->local().lostFabulas, lostFabulas); }
+
+        void
+        countSuppressed()
+        { Increment(this->local().suppressedFabulas); }
+
+        void
+        snapshot(Fabulatorium::TrafficSnapshot&) const;
+
+    private:
+        Fabulatorium::TrafficCounters&
+        local()
+        { return this->slots[ThreadSlot()]; }
+
+        static void
+        Increment(
+            std::atomic<uint64_t>&  counter,
+            const uint64_t          value = 1)
+        { counter.fetch_add(value, std::memory_order_relaxed); }
+
+        static unsigned int
+        ThreadSlot();
+    };
+
+    /**
+     * Traffic of all listeners, for the web interface.
+     */
+    class Statistics
+    {
+    private:
+        std::mutex                  lock;
+
+        struct Entry
+        {
+            std::string             listenerName;
+            Fabulatorium::Traffic*  traffic;
+        };
+
+        std::vector<Entry>          listeners;
+
+    public:
+        static Fabulatorium::Statistics&
+        InitInstance();
+
+        static Fabulatorium::Statistics&
+        SharedInstance();
+
+    private:
+        Statistics();
+
+    public:
+        void
+        registerListener(
+            const std::string&      listenerName,
+            Fabulatorium::Traffic*  traffic);
+
+        unsigned int
+        size();
+
+        void
+        snapshot(
+            const unsigned int              listenerIndex,
+            std::string&                    listenerName,
+            Fabulatorium::TrafficSnapshot&  snapshot);
+
+        std::string
+        json();
+    };
+};
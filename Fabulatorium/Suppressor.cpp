@@ -0,0 +1,319 @@
+// System definition files.
+//
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Common definition files.
+//
+#include "Toolkit/Report.h"
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/Aviso.hpp"
+#include "Servus/Dispatcher/Queue.hpp"
+#include "Servus/Fabulatorium/Suppressor.hpp"
+
+static const uint64_t FingerprintOffsetBasis    = 14695981039346656037ULL;
+static const uint64_t FingerprintPrime          = 1099511628211ULL;
+
+static Fabulatorium::Suppressor* instance = NULL;
+
+Fabulatorium::Suppressor&
+Fabulatorium::Suppressor::InitInstance()
+{
+    if (instance != NULL)
+        throw std::runtime_error("[Fabulatorium] Suppressor already initialized");
+
+    instance = new Fabulatorium::Suppressor();
+
+    return *instance;
+}
+
+Fabulatorium::Suppressor&
+Fabulatorium::Suppressor::SharedInstance()
+{
+    if (instance == NULL)
+        throw std::runtime_error("[Fabulatorium] Suppressor not initialized");
+
+    return *instance;
+}
+
+Fabulatorium::Suppressor::Suppressor() :
+sets(NULL),
+setMask(0),
+window(0)
+{ }
+
+/**
+ * @brief   Allocate the table and start enqueueing repeats of closed windows.
+ *
+ * Until started the suppressor passes on every fabula.
+ *
+ * @param   window          Milliseconds within which repeats are folded.
+ * @param   capacity        Number of distinct fabulas remembered at most,
+ *                          rounded up to a power of two.
+ */
+void
+Fabulatorium::Suppressor::start(
+    const unsigned int window,
+    const unsigned int capacity)
+{
+    if ((this->sets != NULL) || (window == 0))
+        return;
+
+    unsigned int numberOfSets = 1;
+
+    while (numberOfSets * Fabulatorium::SuppressionWays < capacity)
+        numberOfSets <<= 1;
+
+    Fabulatorium::SuppressionSet* sets = new Fabulatorium::SuppressionSet[numberOfSets];
+
+    for (unsigned int setIndex = 0; setIndex < numberOfSets; setIndex++)
+    {
+        Fabulatorium::SuppressionSet& set = sets[setIndex];
+
+        set.hand = 0;
+
+        for (unsigned int wayIndex = 0; wayIndex < Fabulatorium::SuppressionWays; wayIndex++)
+        {
+            Fabulatorium::SuppressionEntry& entry = set.entries[wayIndex];
+
+            entry.fingerprint = 0;
+            entry.windowEnd = 0;
+            entry.referenced = false;
+            entry.repeats = NULL;
+        }
+    }
+
+    this->window = window;
+    this->setMask = numberOfSets - 1;
+    this->sets = sets;
+
+    ReportInfo("[Fabulatorium] Suppressing repeated fabulas within %u ms, %u remembered",
+            window,
+            numberOfSets * Fabulatorium::SuppressionWays);
+
+    this->thread = std::thread(&Fabulatorium::Suppressor::ThreadHandler, this);
+}
+
+/**
+ * @brief   Thread handler for enqueueing repeats.
+ */
+void
+Fabulatorium::Suppressor::ThreadHandler(Fabulatorium::Suppressor* suppressor)
+{
+    ReportDebug("[Fabulatorium] Suppressor thread has been started");
+
+    for (;;)
+    {
+        std::this_thread::sleep_for(
+                std::chrono::milliseconds { suppressor->window } );
+
+        suppressor->sweep();
+    }
+}
+
+/**
+ * @brief   Take over the aviso if it repeats a fabula of an open window.
+ *
+ * May be called by any thread.
+ *
+ * @return  Boolean true if the suppressor has taken the aviso. Otherwise
+ *          the caller has to enqueue it.
+ */
+bool
+Fabulatorium::Suppressor::absorb(Dispatcher::FabulaAviso* aviso)
+{
+    if (this->sets == NULL)
+        return false;
+
+    const uint64_t fingerprint = Fingerprint(*aviso);
+    const uint64_t now = Now();
+
+    Fabulatorium::SuppressionSet& set = this->sets[fingerprint & this->setMask];
+
+    Dispatcher::FabulaAviso* closedRepeats = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(set.lock);
+
+        Fabulatorium::SuppressionEntry* entry = NULL;
+
+        for (unsigned int wayIndex = 0; wayIndex < Fabulatorium::SuppressionWays; wayIndex++)
+        {
+            if (set.entries[wayIndex].fingerprint == fingerprint)
+            {
+                entry = &set.entries[wayIndex];
+
+                break;
+            }
+        }
+
+        if ((entry != NULL) && (now < entry->windowEnd))
+        {
+            entry->referenced = true;
+
+            if (entry->repeats == NULL)
+            {
+                aviso->countRepeat(aviso->timestamp);
+
+                entry->repeats = aviso;
+            }
+            else
+            {
+                entry->repeats->countRepeat(aviso->timestamp);
+
+                delete aviso;
+            }
+
+            return true;
+        }
+
+        // Repeats of a closed window or of an evicted fabula go out
+        // before the fabula opening the new window.
+        //
+        if (entry == NULL)
+            entry = &Victim(set);
+
+        closedRepeats = entry->repeats;
+
+        entry->fingerprint = fingerprint;
+        entry->windowEnd = now + this->window;
+        entry->referenced = true;
+        entry->repeats = NULL;
+    }
+
+    if (closedRepeats != NULL)
+        this->release(closedRepeats);
+
+    return false;
+}
+
+/**
+ * @brief   Enqueue repeats of all windows which have closed.
+ */
+void
+Fabulatorium::Suppressor::sweep()
+{
+    std::vector<Dispatcher::FabulaAviso*> closedRepeats;
+
+    const uint64_t now = Now();
+
+    for (uint64_t setIndex = 0; setIndex <= this->setMask; setIndex++)
+    {
+        Fabulatorium::SuppressionSet& set = this->sets[setIndex];
+
+        std::lock_guard<std::mutex> lock(set.lock);
+
+        for (unsigned int wayIndex = 0; wayIndex < Fabulatorium::SuppressionWays; wayIndex++)
+        {
+            Fabulatorium::SuppressionEntry& entry = set.entries[wayIndex];
+
+            if ((entry.repeats != NULL) && (entry.windowEnd <= now))
+            {
+                closedRepeats.push_back(entry.repeats);
+
+                entry.repeats = NULL;
+            }
+        }
+    }
+
+    for (std::vector<Dispatcher::FabulaAviso*>::iterator aviso = closedRepeats.begin();
+         aviso != closedRepeats.end();
+         aviso++)
+    {
+        this->release(*aviso);
+    }
+}
+
+/**
+ * @brief   Hand the repeats of a window over to the queue.
+ */
+void
+Fabulatorium::Suppressor::release(Dispatcher::FabulaAviso* aviso)
+{
+    ReportDebug("[Fabulatorium] Fabula from \"%s\" repeated %u times",
+            aviso->fabulatorName.c_str(),
+            aviso->repeatCount);
+
+    try
+    {
+        Dispatcher::Queue::SharedInstance().enqueueAviso(aviso);
+    }
+    catch (Dispatcher::QueueOverflow&)
+    {
+        ReportWarning("[Fabulatorium] Dropped repeats of fabula from \"%s\": queue overflow",
+                aviso->fabulatorName.c_str());
+
+        delete aviso;
+    }
+}
+
+/**
+ * @brief   Hash originator, severity and message of a fabula (FNV-1a).
+ *
+ * @return  Fingerprint, never zero.
+ */
+uint64_t
+Fabulatorium::Suppressor::Fingerprint(const Dispatcher::FabulaAviso& aviso)
+{
+    uint64_t fingerprint = FingerprintOffsetBasis;
+
+    for (std::string::const_iterator character = aviso.fabulatorName.begin();
+         character != aviso.fabulatorName.end();
+         character++)
+    {
+        fingerprint = (fingerprint ^ (unsigned char) *character) * FingerprintPrime;
+    }
+
+    fingerprint = (fingerprint ^ 0) * FingerprintPrime;
+    fingerprint = (fingerprint ^ (aviso.severityLevel & 0xFF)) * FingerprintPrime;
+    fingerprint = (fingerprint ^ (aviso.severityLevel >> 8)) * FingerprintPrime;
+
+    for (std::string::const_iterator character = aviso.message.begin();
+         character != aviso.message.end();
+         character++)
+    {
+        fingerprint = (fingerprint ^ (unsigned char) *character) * FingerprintPrime;
+    }
+
+    return (fingerprint == 0) ? 1 : fingerprint;
+}
+
+uint64_t
+Fabulatorium::Suppressor::Now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief   Find the entry of a set to be taken over by a new fabula.
+ *
+ * The clock hand clears the reference bits it passes and stops at the
+ * first free or unreferenced entry.
+ */
+Fabulatorium::SuppressionEntry&
+Fabulatorium::Suppressor::Victim(Fabulatorium::SuppressionSet& set)
+{
+    for (;;)
+    {
+        Fabulatorium::SuppressionEntry& entry = set.entries[set.hand];
+
+        set.hand = (set.hand + 1) % Fabulatorium::SuppressionWays;
+
+        if ((entry.fingerprint != 0) && (entry.referenced == true))
+        {
+            entry.referenced = false;
+
+            continue;
+        }
+
+        return entry;
+    }
+}
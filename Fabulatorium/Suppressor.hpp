@@ -0,0 +1,110 @@
+#pragma once
+
+// System definition files.
+//
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Local definition files.
+//
+#include "Servus/Dispatcher/Aviso.hpp"
+
+namespace Fabulatorium
+{
+    /**
+     * Entries of a set of the suppression table, among which the clock hand turns.
+     */
+    static const unsigned int SuppressionWays = 4;
+
+    struct SuppressionEntry
+    {
+        /**
+         * Hash of originator, severity and message, zero if the entry is free.
+         */
+        uint64_t                    fingerprint;
+
+        /**
+         * Steady time in milliseconds when the window of the first fabula closes.
+         */
+        uint64_t                    windowEnd;
+
+        bool                        referenced;
+
+        /**
+         * Aviso holding the repeats seen within the window, if any.
+         */
+        Dispatcher::FabulaAviso*    repeats;
+    };
+
+    struct SuppressionSet
+    {
+        std::mutex                      lock;
+        unsigned int                    hand;
+        Fabulatorium::SuppressionEntry  entries[Fabulatorium::SuppressionWays];
+    };
+
+    /**
+     * Suppression of identical fabulas repeated within a window.
+     *
+     * The first fabula of a window is passed on at once. Its repeats are
+     * folded into one more aviso, which counts them and tells when the last
+     * one was seen, and which is enqueued as soon as the window has closed.
+     *
+     * The table has a fixed number of set-associative entries. A fabula
+     * not in its set takes the place of the entry the clock hand of the set
+     * finds unreferenced first, so that fabulas seen least recently are
+     * forgotten first, approximately.
+     */
+    class Suppressor
+    {
+    private:
+        /**
+         * Thread handler of the thread enqueueing repeats of closed windows.
+         */
+        std::thread                     thread;
+
+        Fabulatorium::SuppressionSet*   sets;
+        uint64_t                        setMask;
+
+        unsigned int                    window;
+
+    public:
+        static Fabulatorium::Suppressor&
+        InitInstance();
+
+        static Fabulatorium::Suppressor&
+        SharedInstance();
+
+    private:
+        Suppressor();
+
+    public:
+        void
+        start(
+            const unsigned int window,
+            const unsigned int capacity);
+
+        bool
+        absorb(Dispatcher::FabulaAviso*);
+
+    private:
+        static void
+        ThreadHandler(Suppressor*);
+
+        void
+        sweep();
+
+        void
+        release(Dispatcher::FabulaAviso*);
+
+        static uint64_t
+        Fingerprint(const Dispatcher::FabulaAviso&);
+
+        static uint64_t
+        Now();
+
+        static Fabulatorium::SuppressionEntry&
+        Victim(Fabulatorium::SuppressionSet&);
+    };
+};
@@ -25,8 +25,13 @@
 #include "Servus/Configuration.hpp"
 #include "Servus/GKrellM.hpp"
 #include "Servus/Kernel.hpp"
+#include "Servus/Dispatcher/BufferPool.hpp"
 #include "Servus/Dispatcher/Communicator.hpp"
 #include "Servus/Dispatcher/Queue.hpp"
+#include "Servus/Fabulatorium/Fabulator.hpp"
+#include "Servus/Fabulatorium/Reactor.hpp"
+#include "Servus/Fabulatorium/Statistics.hpp"
+#include "Servus/Fabulatorium/Suppressor.hpp"
 #include "Servus/Peripherique/HumiditySensor.hpp"
 #include "Servus/Peripherique/HumidityStation.hpp"
 #include "Servus/Peripherique/ThermiqueSensor.hpp"
@@ -113,8 +118,13 @@ Workspace::Kernel::kernelInit()
     try
     {
         Servus::Configuration::InitInstance("/opt/castellum/servus.conf");
+        Dispatcher::BufferPool::InitInstance();
         Dispatcher::Communicator::InitInstance();
         Dispatcher::Queue::InitInstance();
+        Fabulatorium::Reactor::InitInstance();
+        Fabulatorium::Statistics::InitInstance();
+        Fabulatorium::Registry::InitInstance();
+        Fabulatorium::Suppressor::InitInstance();
     }
     catch (std::exception& exception)
     {
@@ -125,6 +135,15 @@ Workspace::Kernel::kernelInit()
 
     configuration.load();
 
+    try
+    {
+        Dispatcher::Communicator::SharedInstance().applyCachedConfiguration();
+    }
+    catch (std::exception& exception)
+    {
+        ReportWarning("[Workspace] Cannot apply cached configuration: %s", exception.what());
+    }
+
     this->modbus = new MODBUS::Service(configuration.modbus.portNumber);
 
     // Start HTTP service.
@@ -13,12 +13,56 @@
 // Local definition files.
 //
 #include "Servus/Configuration.hpp"
+#include "Servus/Dispatcher/Archive.hpp"
 #include "Servus/Dispatcher/Communicator.hpp"
+#include "Servus/Dispatcher/Queue.hpp"
+#include "Servus/Dispatcher/Spool.hpp"
+#include "Servus/Fabulatorium/DatagramListener.hpp"
 #include "Servus/Fabulatorium/Fabulator.hpp"
 #include "Servus/Fabulatorium/Listener.hpp"
+#include "Servus/Fabulatorium/LocalListener.hpp"
+#include "Servus/Fabulatorium/Reactor.hpp"
+#include "Servus/Fabulatorium/Suppressor.hpp"
 
 using namespace libconfig;
 
+/**
+ * @brief   Apply optional connection settings of a listener taking sessions.
+ */
+template <class ListenerType>
+static void
+ParseConnection(Setting& listenerSetting, ListenerType* listener)
+{
+    try
+    {
+        Setting& connectionSetting = listenerSetting["Connection"];
+
+        listener->setConnectionIntervals(
+                connectionSetting["WaitForFirstTransmission"],
+                connectionSetting["WaitForTransmissionCompletion"]);
+    }
+    catch (SettingNotFoundException& exception)
+    { }
+
+    try
+    {
+        Setting& connectionSetting = listenerSetting["Connection"];
+
+        listener->setPipelineDepth(connectionSetting["PipelineDepth"]);
+    }
+    catch (SettingNotFoundException& exception)
+    { }
+
+    try
+    {
+        Setting& connectionSetting = listenerSetting["Connection"];
+
+        listener->setPauseWhenCongested(connectionSetting["PauseWhenCongested"]);
+    }
+    catch (SettingNotFoundException& exception)
+    { }
+}
+
 void
 Servus::Configuration::load()
 {
@@ -106,6 +150,125 @@ Servus::Configuration::load()
             }
             catch (SettingNotFoundException& exception)
             { }
+
+            try
+            {
+                Setting& connectionSetting = primusSetting["Connection"];
+
+                communicator.setTransmissionWindow(
+                        connectionSetting["TransmissionWindow"]);
+            }
+            catch (SettingNotFoundException& exception)
+            { }
+
+            try
+            {
+                Setting& batchSetting = primusSetting["Batch"];
+
+                communicator.setBatchLimits(
+                        batchSetting["MaximalAvisos"],
+                        batchSetting["MaximalLength"]);
+            }
+            catch (SettingNotFoundException& exception)
+            { }
+
+            try
+            {
+                Setting& queueSetting = primusSetting["Queue"];
+
+                const bool coalescing = queueSetting["Coalescing"];
+
+                Dispatcher::Queue::SharedInstance().setCoalescing(coalescing);
+            }
+            catch (SettingNotFoundException& exception)
+            { }
+
+            try
+            {
+                Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
+
+                Setting& lanesSetting = primusSetting["Queue"]["Lanes"];
+
+                const unsigned int  criticalSeverity    = lanesSetting["CriticalSeverity"];
+                const unsigned int  memoryCeiling       = lanesSetting["MemoryCeiling"];
+                const unsigned int  criticalWeight      = lanesSetting["CriticalWeight"];
+                const unsigned int  normalWeight        = lanesSetting["NormalWeight"];
+                const unsigned int  telemetryWeight     = lanesSetting["TelemetryWeight"];
+
+                queue.setPriorities(criticalSeverity, memoryCeiling);
+                queue.setLaneWeight(Dispatcher::LaneCritical, criticalWeight);
+                queue.setLaneWeight(Dispatcher::LaneNormal, normalWeight);
+                queue.setLaneWeight(Dispatcher::LaneTelemetry, telemetryWeight);
+            }
+            catch (SettingNotFoundException& exception)
+            { }
+
+            // Watermarks section.
+            //
+            try
+            {
+                Setting& watermarksSetting = primusSetting["Queue"]["Watermarks"];
+
+                const unsigned int  highCount   = watermarksSetting["HighCount"];
+                const unsigned int  lowCount    = watermarksSetting["LowCount"];
+                const unsigned int  highBytes   = watermarksSetting["HighBytes"];
+                const unsigned int  lowBytes    = watermarksSetting["LowBytes"];
+                const unsigned int  retryAfter  = watermarksSetting["RetryAfter"];
+
+                Dispatcher::Queue::SharedInstance().setWatermarks(
+                        highCount,
+                        lowCount,
+                        highBytes,
+                        lowBytes,
+                        retryAfter);
+            }
+            catch (SettingNotFoundException& exception)
+            { }
+
+            // Spool section. Without it avisos are kept in memory only.
+            //
+            try
+            {
+                Setting& spoolSetting = primusSetting["Spool"];
+
+                const std::string   directoryPath   = spoolSetting["Directory"];
+                const unsigned int  segmentSize     = spoolSetting["SegmentSize"];
+                const unsigned int  maximalSegments = spoolSetting["MaximalSegments"];
+                const unsigned int  syncInterval    = spoolSetting["SyncInterval"];
+
+                Dispatcher::Queue::SharedInstance().openSpool(
+                        directoryPath,
+                        segmentSize,
+                        maximalSegments,
+                        syncInterval);
+            }
+            catch (SettingNotFoundException& exception)
+            { }
+            catch (Dispatcher::SpoolError& exception)
+            {
+                ReportError("[Workspace] Cannot open spool, avisos are kept in memory only: %s",
+                        exception.what());
+            }
+
+            // Archive section. Without it Primus is the only reader of the queue.
+            //
+            try
+            {
+                Setting& archiveSetting = primusSetting["Archive"];
+
+                const std::string   filePath    = archiveSetting["FilePath"];
+                const bool          lossy       = archiveSetting["Lossy"];
+
+                new Dispatcher::Archive(filePath, lossy);
+            }
+            catch (SettingNotFoundException& exception)
+            { }
+            catch (Dispatcher::ArchiveError& exception)
+            {
+                ReportError("[Workspace] Cannot open archive, avisos are not archived: %s: errno=%d",
+                        exception.what(),
+                        exception.errorNumber);
+            }
         }
 
         // Fabulatorium block.
@@ -113,6 +276,104 @@ Servus::Configuration::load()
         {
             Setting& fabulatoriumSetting = rootSetting["Fabulatorium"];
 
+            // Workers serving the sessions of all listeners.
+            //
+            {
+                unsigned int numberOfWorkers = Servus::DefaultFabulatoriumWorkers;
+
+                try
+                {
+                    const unsigned int workers = fabulatoriumSetting["Workers"];
+
+                    numberOfWorkers = workers;
+                }
+                catch (SettingNotFoundException& exception)
+                { }
+
+                Fabulatorium::Reactor::SharedInstance().start(numberOfWorkers);
+            }
+
+            // Suppression of repeated fabulas. A window of zero switches it off.
+            //
+            {
+                unsigned int window     = Servus::DefaultSuppressionWindow;
+                unsigned int capacity   = Servus::DefaultSuppressionCapacity;
+
+                try
+                {
+                    Setting& suppressionSetting = fabulatoriumSetting["Suppression"];
+
+                    const unsigned int configuredWindow     = suppressionSetting["Window"];
+                    const unsigned int configuredCapacity   = suppressionSetting["Capacity"];
+
+                    window = configuredWindow;
+                    capacity = configuredCapacity;
+                }
+                catch (SettingNotFoundException& exception)
+                { }
+
+                Fabulatorium::Suppressor::SharedInstance().start(window, capacity);
+            }
+
+            // Fabulators section, before any listener takes fabulas.
+            //
+            {
+                Fabulatorium::Registry& registry = Fabulatorium::Registry::SharedInstance();
+
+                try
+                {
+                    registry.setAcceptUnknown(fabulatoriumSetting["AcceptUnknownFabulators"]);
+                }
+                catch (SettingNotFoundException& exception)
+                { }
+
+                // Without a fabulators section only unknown fabulators are heard of,
+                // if they are accepted at all.
+                //
+                Setting* fabulatorsSetting = NULL;
+
+                try
+                {
+                    fabulatorsSetting = &fabulatoriumSetting["Fabulators"];
+                }
+                catch (SettingNotFoundException& exception)
+                {
+                    ReportNotice("[Workspace] No fabulators defined");
+                }
+
+                for (int fabulatorIndex = 0;
+                     (fabulatorsSetting != NULL) && (fabulatorIndex < fabulatorsSetting->getLength());
+                     fabulatorIndex++)
+                {
+                    Setting& fabulatorSetting = (*fabulatorsSetting)[fabulatorIndex];
+
+                    const std::string fabulatorName          = fabulatorSetting["FabulatorName"];
+                    const unsigned int defaultSeverityLevel  = fabulatorSetting["DefaultSeverity"];
+                    const bool defaultNotificationFlag       = fabulatorSetting["DefaultNotificationFlag"];
+
+                    unsigned int rate   = Servus::DefaultFabulatorRate;
+                    unsigned int burst  = Servus::DefaultFabulatorBurst;
+
+                    try
+                    {
+                        const unsigned int configuredRate   = fabulatorSetting["Rate"];
+                        const unsigned int configuredBurst  = fabulatorSetting["Burst"];
+
+                        rate = configuredRate;
+                        burst = configuredBurst;
+                    }
+                    catch (SettingNotFoundException& exception)
+                    { }
+
+                    registry.define(new Fabulatorium::Fabulator(
+                            fabulatorName,
+                            defaultSeverityLevel,
+                            defaultNotificationFlag,
+                            rate,
+                            burst));
+                }
+            }
+
             // Listeners section.
             //
             {
@@ -125,48 +386,94 @@ Servus::Configuration::load()
                     Setting& listenerSetting = listenersSetting[listenerIndex];
 
                     const std::string listenerName  = listenerSetting["ListenerName"];
+
+                    // Listeners take fabulas over TCP unless told otherwise.
+                    //
+                    std::string protocol = "TCP";
+
+                    try
+                    {
+                        const std::string protocolName = listenerSetting["Protocol"];
+
+                        protocol = protocolName;
+                    }
+                    catch (SettingNotFoundException& exception)
+                    { }
+
+                    if (protocol == "UNIX")
+                    {
+                        const std::string socketPath = listenerSetting["SocketPath"];
+
+                        Fabulatorium::LocalListener *localListener = new Fabulatorium::LocalListener(
+                                listenerName,
+                                socketPath);
+
+                        ParseConnection(listenerSetting, localListener);
+
+                        localListener->start();
+
+                        continue;
+                    }
+
                     const std::string interface     = listenerSetting["Interface"];
                     const unsigned int portNumber   = listenerSetting["PortNumberIPv4"];
 
-                    Fabulatorium::Listener *listener = new Fabulatorium::Listener(
-                            listenerName,
-                            interface,
-                            portNumber);
+                    if (protocol == "UDP")
+                    {
+                        Fabulatorium::DatagramListener *datagramListener = new Fabulatorium::DatagramListener(
+                                listenerName,
+                                interface,
+                                portNumber);
+
+                        datagramListener->start();
+
+                        continue;
+                    }
+
+                    unsigned int numberOfAcceptors = Servus::DefaultListenerAcceptors;
 
                     try
                     {
-                        Setting& connectionSetting = listenerSetting["Connection"];
+                        const unsigned int acceptors = listenerSetting["Acceptors"];
 
-                        listener->setConnectionIntervals(
-                                connectionSetting["WaitForFirstTransmission"],
-                                connectionSetting["WaitForTransmissionCompletion"]);
+                        numberOfAcceptors = acceptors;
                     }
                     catch (SettingNotFoundException& exception)
                     { }
-                }
-            }
 
-            // Fabulators section.
-            //
-            {
-                Setting& fabulatorsSetting = fabulatoriumSetting["Fabulators"];
+                    Fabulatorium::Listener *listener = new Fabulatorium::Listener(
+                            listenerName,
+                            interface,
+                            portNumber,
+                            numberOfAcceptors);
 
-                for (int fabulatorIndex = 0;
-                     fabulatorIndex < fabulatoriumSetting.getLength();
-                     fabulatorIndex++)
-                {
-                    Setting& fabulatorSetting = fabulatorsSetting[fabulatorIndex];
+                    ParseConnection(listenerSetting, listener);
 
-                    const std::string fabulatorName          = fabulatorSetting["FabulatorName"];
-                    const unsigned int defaultSeverityLevel  = fabulatorSetting["DefaultSeverity"];
-                    const bool defaultNotificationFlag       = fabulatorSetting["DefaultNotificationFlag"];
+                    // Admission section. Without it the default limit applies
+                    // and connections beyond it are closed.
+                    //
+                    try
+                    {
+                        Setting& admissionSetting = listenerSetting["Admission"];
 
-                    new Fabulatorium::Fabulator(
-                            fabulatorName,
-                            defaultSeverityLevel,
-                            defaultNotificationFlag);
+                        const unsigned int maximalSessions  = admissionSetting["MaximalSessions"];
+                        const std::string shedPolicy        = admissionSetting["ShedPolicy"];
+
+                        listener->setAdmission(
+                                maximalSessions,
+                                (shedPolicy == "Defer")
+                                        ? Fabulatorium::ShedDefer
+                                        : Fabulatorium::ShedClose);
+                    }
+                    catch (SettingNotFoundException& exception)
+                    { }
+
+                    // Acceptors start once all settings of the listener are in place.
+                    //
+                    listener->start();
                 }
             }
+
         }
     }
     catch (SettingNotFoundException& exception)
@@ -98,7 +98,18 @@ Peripherique::HumidityStation::ThreadHandler(Peripherique::HumidityStation* humi
 
                     Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
 
-                    queue.enqueueAviso(aviso);
+                    try
+                    {
+                        queue.enqueueAviso(aviso);
+                    }
+                    catch (Dispatcher::QueueOverflow& exception)
+                    {
+                        ReportWarning("[Périphérique] Dropped aviso of sensor '%s': %s",
+                                sensor->title.c_str(),
+                                exception.what());
+
+                        delete aviso;
+                    }
                 }
 
                 if (sensor->changedTemperature == true)
@@ -111,7 +122,18 @@ Peripherique::HumidityStation::ThreadHandler(Peripherique::HumidityStation* humi
 
                     Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
 
-                    queue.enqueueAviso(aviso);
+                    try
+                    {
+                        queue.enqueueAviso(aviso);
+                    }
+                    catch (Dispatcher::QueueOverflow& exception)
+                    {
+                        ReportWarning("[Périphérique] Dropped aviso of sensor '%s': %s",
+                                sensor->title.c_str(),
+                                exception.what());
+
+                        delete aviso;
+                    }
 
                     try
                     {
@@ -108,7 +108,18 @@ Peripherique::ThermiqueStation::ThreadHandler(Peripherique::ThermiqueStation* th
 
                     Dispatcher::Queue& queue = Dispatcher::Queue::SharedInstance();
 
-                    queue.enqueueAviso(aviso);
+                    try
+                    {
+                        queue.enqueueAviso(aviso);
+                    }
+                    catch (Dispatcher::QueueOverflow& exception)
+                    {
+                        ReportWarning("[Périphérique] Dropped aviso of sensor '%s': %s",
+                                sensor->title.c_str(),
+                                exception.what());
+
+                        delete aviso;
+                    }
 
                     try
                     {
@@ -0,0 +1,209 @@
+// System definition files.
+//
+#include <unistd.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Common definition files.
+//
+#include "HTTP/Connection.hpp"
+#include "HTTP/HTML.hpp"
+#include "HTTP/HTTP.hpp"
+#include "Toolkit/Report.h"
+
+// Local definition files.
+//
+#include "Servus/Fabulatorium/Statistics.hpp"
+#include "Servus/Kernel.hpp"
+#include "Servus/WWW/Home.hpp"
+
+/**
+ * Traffic of all listeners is written to this file in the workspace
+ * for each request of the JSON endpoint.
+ */
+static const std::string SnapshotFileName = "fabulatorium.json";
+
+/**
+ * @brief   Write traffic of all listeners to the snapshot file for download.
+ *
+ * The file is replaced atomically, so that concurrent requests
+ * never serve a file that is being written.
+ *
+ * @param   snapshotPath    Path of the snapshot file.
+ *
+ * @return  Boolean false if the snapshot could not be written.
+ */
+bool
+WWW::Site::fabulatoriumSnapshot(std::string& snapshotPath)
+{
+    const std::string document = Fabulatorium::Statistics::SharedInstance().json();
+
+    snapshotPath = Workspace::RootPath + SnapshotFileName;
+
+    std::string temporaryPath = snapshotPath + ".XXXXXX";
+
+    const int fileDescriptor = mkstemp(&temporaryPath[0]);
+    if (fileDescriptor == -1)
+    {
+        ReportWarning("[WWW] Cannot create traffic snapshot: errno=%d",
+                errno);
+
+        return false;
+    }
+
+    const bool written =
+            (write(fileDescriptor, document.data(), document.length()) ==
+                    (ssize_t) document.length());
+
+    close(fileDescriptor);
+
+    if ((written == false) || (rename(temporaryPath.c_str(), snapshotPath.c_str()) != 0))
+    {
+        ReportWarning("[WWW] Cannot write traffic snapshot");
+
+        unlink(temporaryPath.c_str());
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Generate HTML page for the 'Fabulatorium' tab.
+ *
+ * @param   connection      HTTP connection.
+ * @param   instance        HTML instance.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+void
+WWW::Site::pageFabulatorium(HTTP::Connection& connection, HTML::Instance& instance)
+{
+    HTML::Division division(instance, HTML::Nothing, "workspace");
+
+    division.meta("refresh", "10");
+
+    { // HTML.Division
+        HTML::Division division(instance, "full", "slice");
+
+        { // HTML.HeadingText
+            HTML::HeadingText headingText(instance, HTML::H2, HTML::Left);
+
+            headingText.plain("Fabulatorium");
+        } // HTML.HeadingText
+
+        {
+            HTML::Table table(instance);
+
+            {
+                HTML::TableHeader tableHeader(instance);
+
+                {
+                    HTML::TableRow tableRow(instance);
+
+                    static const char* const titles[] =
+                    {
+                        "Listener",
+                        "Verbindungen",
+                        "Aktiv",
+                        "Abgewiesen",
+                        "Fabulas",
+                        "Bytes",
+                        "CSeq",
+                        "Payload",
+                        "Methode",
+                        "Fehlerhaft",
+                        "Unbekannt",
+                        "Gedrosselt",
+                        "Überlastet",
+                        "Überlauf",
+                        "Verloren",
+                        "Unterdrückt",
+                        "Latenz 50%",
+                        "Latenz 99%"
+                    };
+
+                    for (unsigned int titleIndex = 0;
+                         titleIndex < sizeof(titles) / sizeof(titles[0]);
+                         titleIndex++)
+                    {
+                        HTML::TableDataCell tableDataCell(instance,
+                                HTML::Nothing,
+                                (titleIndex == 0) ? HTML::Nothing : "centered");
+
+                        tableDataCell.plain(titles[titleIndex]);
+                    }
+                }
+            }
+
+            Fabulatorium::Statistics& statistics = Fabulatorium::Statistics::SharedInstance();
+
+            {
+                HTML::TableBody tableBody(instance);
+
+                for (unsigned int listenerIndex = 0;
+                     listenerIndex < statistics.size();
+                     listenerIndex++)
+                {
+                    std::string listenerName;
+                    Fabulatorium::TrafficSnapshot traffic;
+
+                    statistics.snapshot(listenerIndex, listenerName, traffic);
+
+                    HTML::TableRow tableRow(instance);
+
+                    {
+                        HTML::TableDataCell tableDataCell(instance, HTML::Nothing, "label");
+
+                        tableDataCell.plain(listenerName);
+                    }
+
+                    const uint64_t counters[] =
+                    {
+                        traffic.acceptedConnections,
+                        traffic.activeConnections,
+                        traffic.shedConnections,
+                        traffic.receivedFabulas,
+                        traffic.receivedBytes,
+                        traffic.rejects[Fabulatorium::RejectCSeq],
+                        traffic.rejects[Fabulatorium::RejectPayload],
+                        traffic.rejects[Fabulatorium::RejectMethod],
+                        traffic.rejects[Fabulatorium::RejectMalformed],
+                        traffic.rejects[Fabulatorium::RejectUnknown],
+                        traffic.rejects[Fabulatorium::RejectThrottled],
+                        traffic.rejects[Fabulatorium::RejectCongested],
+                        traffic.overflows,
+                        traffic.lostFabulas,
+                        traffic.suppressedFabulas
+                    };
+
+                    for (unsigned int counterIndex = 0;
+                         counterIndex < sizeof(counters) / sizeof(counters[0]);
+                         counterIndex++)
+                    {
+                        HTML::TableDataCell tableDataCell(instance, HTML::Nothing, "value");
+
+                        tableDataCell.plain("%" PRIu64, counters[counterIndex]);
+                    }
+
+                    {
+                        HTML::TableDataCell tableDataCell(instance, HTML::Nothing, "value");
+
+                        tableDataCell.plain("&lt; %u &micro;s", traffic.latencyPercentile(50));
+                    }
+
+                    {
+                        HTML::TableDataCell tableDataCell(instance, HTML::Nothing, "value");
+
+                        tableDataCell.plain("&lt; %u &micro;s", traffic.latencyPercentile(99));
+                    }
+                }
+            }
+        }
+    } // HTML.Division
+}
+#pragma GCC diagnostic pop
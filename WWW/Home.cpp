@@ -79,6 +79,15 @@ WWW::Site::generateDocument(HTTP::Connection& connection)
     {
         connection.download(Workspace::RootPath + connection.pageName());
     }
+    else if (connection.pageName() == WWW::PageFabulatoriumJSON)
+    {
+        std::string snapshotPath;
+
+        // Without a snapshot there is nothing to download, rather than an outdated one.
+        //
+        if (this->fabulatoriumSnapshot(snapshotPath) == true)
+            connection.download(snapshotPath);
+    }
     else
     { // HTML.Document
         HTML::Document document(instance);
@@ -370,6 +379,32 @@ WWW::Site::generateNorth(HTTP::Connection& connection, HTML::Instance& instance)
                     } // HTML.Span
                 } // HTML.URL
             } // HTML.ListItem
+
+            // 'Fabulatorium' tab.
+            //
+            { // HTML.ListItem
+                HTML::ListItem listItem(instance,
+                        HTML::Nothing,
+                        (connection.pageName() == WWW::PageFabulatorium)
+                                ? "tabs_item active"
+                                : "tabs_item");
+
+                { // HTML.URL
+                    HTML::URL url(instance, WWW::PageFabulatorium);
+
+                    { // HTML.Span
+                        HTML::Span span(instance, HTML::Nothing, "title");
+
+                        span.plain("Fabulatorium");
+                    } // HTML.Span
+
+                    { // HTML.Span
+                        HTML::Span span(instance, HTML::Nothing, "subtitle");
+
+                        span.plain("Eingangsverkehr");
+                    } // HTML.Span
+                } // HTML.URL
+            } // HTML.ListItem
         } // HTML.UnorderedList
     } // HTML.Division
 }
@@ -399,6 +434,10 @@ WWW::Site::generateSouth(HTTP::Connection& connection, HTML::Instance& instance)
     {
         this->pageRelay(connection, instance);
     }
+    else if (connection.pageName() == WWW::PageFabulatorium)
+    {
+        this->pageFabulatorium(connection, instance);
+    }
     else
     {
         this->pageSystemInformation(connection, instance);
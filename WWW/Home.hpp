@@ -3,6 +3,7 @@
 // System definition files.
 //
 #include <cstdbool>
+#include <string>
 
 // Common definition files.
 //
@@ -15,6 +16,8 @@ namespace WWW
     static const std::string PageSystemInformation      = "sysinfo";
     static const std::string PageTherma                 = "therma";
     static const std::string PageRelay                  = "relay";
+    static const std::string PageFabulatorium           = "fabulatorium";
+    static const std::string PageFabulatoriumJSON       = "fabulatorium.json";
 
     static const std::string Images                     = "img";
     static const std::string Download                   = "download";
@@ -100,6 +103,25 @@ namespace WWW
         void
         pageRelay(HTTP::Connection&, HTML::Instance&);
 
+        /**
+         * @brief   Generate HTML page for the 'Fabulatorium' tab.
+         *
+         * @param   connection      HTTP connection.
+         * @param   instance        HTML instance.
+         */
+        void
+        pageFabulatorium(HTTP::Connection&, HTML::Instance&);
+
+        /**
+         * @brief   Write traffic of all listeners to the snapshot file for download.
+         *
+         * @param   snapshotPath    Path of the snapshot file.
+         *
+         * @return  Boolean false if the snapshot could not be written.
+         */
+        bool
+        fabulatoriumSnapshot(std::string& snapshotPath);
+
         /**
          * @brief   Check whether some HTML form has been submitted by user.
          *